@@ -0,0 +1,554 @@
+// Throughput / latency harness for the core operations.
+// One JSON object per line on stdout, one line per (policy, index) run plus a stack_fx run:
+//
+//   bench [--policy LRU|LFU|FIFO|TTL|RANDOM|APPROX_LRU|WTINYLFU|SLRU|all] [--index rbtree|hash|all]
+//         [--dist zipf|uniform] [--theta 0.99] [--keys N] [--ops N] [--value-size B]
+//         [--reads PCT] [--threads T] [--shards S] [--maxmemory B] [--ttl SEC]
+//         [--concurrent-reads] [--seed N]
+//
+// threads == 1 drives a flexcache directly, more threads go through fcache_sharded.
+// maxmemory defaults to half of keys * value size so the eviction path is part of the run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../src/flexcache.h"
+#include "../src/fcache_sharded.h"
+#include "../src/stack_fx.h"
+
+typedef struct bench_args{
+    const char*     policy;
+    const char*     index;
+    bool_t          zipf;
+    double          theta;
+    size_fx         keys;
+    size_fx         ops;
+    size_fx         value_size;
+    size_fx         read_pct;
+    size_fx         threads;
+    size_fx         shards;
+    size_fx         maxmemory;
+    long            ttl;
+    bool_t          concurrent_reads;
+    size_fx         seed;
+} bench_args;
+
+/* ---------------- counting allocator: bytes per key ---------------- */
+
+static _Atomic size_fx bench_live_bytes;
+
+//16 bytes keep the user pointer aligned like malloc
+static void* bench_alloc(size_fx size){
+
+    size_fx* block = malloc(size + 16);
+    if(!block)
+        return 0;
+
+    block[0] = size;
+    atomic_fetch_add_explicit(&bench_live_bytes, size, memory_order_relaxed);
+    return (char*)block + 16;
+}
+
+static void bench_free(void* ptr){
+
+    if(!ptr)
+        return;
+
+    size_fx* block = (size_fx*)((char*)ptr - 16);
+    atomic_fetch_sub_explicit(&bench_live_bytes, block[0], memory_order_relaxed);
+    free(block);
+}
+
+static alloc_fx bench_alloc_fx = bench_alloc;
+static free_fx bench_free_fx = bench_free;
+static const allocator_fx bench_allocator = {
+    .alloc = &bench_alloc_fx,
+    .free = &bench_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+/* ---------------- keys, values and cache funcs ---------------- */
+
+typedef struct bench_value{
+    size_fx         size;
+    char            bytes[];
+} bench_value;
+
+static long* bench_keys; //keys must outlive the cache, they are stored by pointer
+
+static size_fx bench_value_len(void* data){
+    return ((bench_value*)data)->size;
+}
+
+static void* bench_value_copy(void* data){
+
+    bench_value* value = data;
+    bench_value* copy = bench_alloc(sizeof(bench_value) + value->size);
+    if(copy)
+        memcpy(copy, value, sizeof(bench_value) + value->size);
+    return copy;
+}
+
+static bench_value* bench_value_new(size_fx size, size_fx fill){
+
+    bench_value* value = bench_alloc(sizeof(bench_value) + size);
+    if(!value)
+        return 0;
+
+    value->size = size;
+    memset(value->bytes, (int)fill, size);
+    return value;
+}
+
+static int bench_key_cmp(const void* key1, const void* key2){
+    long a = *(const long*)key1;
+    long b = *(const long*)key2;
+    return (a > b) - (a < b);
+}
+
+static size_fx bench_key_hash(const void* key){
+    return (size_fx)*(const long*)key;
+}
+
+static size_fx bench_key_len(void* key){
+    (void)key;
+    return sizeof(long);
+}
+
+static void bench_now(time_fx* now){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now->tv_sec = ts.tv_sec;
+    now->tv_nsec = ts.tv_nsec;
+}
+
+static const len_func bench_value_len_fx = bench_value_len;
+static const len_func bench_key_len_fx = bench_key_len;
+static const copy_func bench_value_copy_fx = bench_value_copy;
+static const cmp_func bench_key_cmp_fx = bench_key_cmp;
+static const hash_func bench_key_hash_fx = bench_key_hash;
+static const now_func bench_now_fx = bench_now;
+
+static data_aux_funcs_t bench_funcs(void){
+
+    data_aux_funcs_t funcs = {
+        &bench_value_len_fx,
+        &bench_key_len_fx,
+        &bench_value_copy_fx,
+        &bench_key_cmp_fx,
+        &bench_key_hash_fx,
+        &bench_allocator,
+        &bench_now_fx
+    };
+    return funcs;
+}
+
+/* ---------------- key distributions ---------------- */
+
+// Gray et al. "Quickly generating billion-record synthetic databases" (the YCSB generator)
+typedef struct bench_zipf{
+    size_fx         n;
+    double          theta;
+    double          alpha;
+    double          zetan;
+    double          eta;
+} bench_zipf;
+
+static double bench_zeta(size_fx n, double theta){
+
+    double sum = 0;
+    for(size_fx i = 1; i <= n; i++)
+        sum += 1.0 / pow((double)i, theta);
+    return sum;
+}
+
+static void bench_zipf_init(bench_zipf* zipf, size_fx n, double theta){
+
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = bench_zeta(n, theta);
+    zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - bench_zeta(2, theta) / zipf->zetan);
+}
+
+static FX_INLINE double bench_uniform01(size_fx* rnd){
+    return (double)(rand_fx(rnd) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static size_fx bench_zipf_next(const bench_zipf* zipf, size_fx* rnd){
+
+    double u = bench_uniform01(rnd);
+    double uz = u * zipf->zetan;
+
+    if(uz < 1.0)
+        return 0;
+    if(uz < 1.0 + pow(0.5, zipf->theta))
+        return 1;
+
+    size_fx rank = (size_fx)((double)zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+//hot ranks are spread over the key space, not clustered on the low keys
+static FX_INLINE size_fx bench_scatter(size_fx rank, size_fx n){
+    return (rank * 0x9E3779B97F4A7C15UL) % n;
+}
+
+/* ---------------- latency histogram ---------------- */
+
+// log linear: 16 sub buckets per power of two, about 6% precision
+#define BENCH_HIST_SUB      16
+#define BENCH_HIST_BUCKETS  (64 * BENCH_HIST_SUB)
+
+typedef struct bench_hist{
+    size_fx         count[BENCH_HIST_BUCKETS];
+    size_fx         total;
+} bench_hist;
+
+static FX_INLINE size_fx bench_hist_bucket(size_fx ns){
+
+    if(ns < BENCH_HIST_SUB)
+        return ns;
+
+    size_fx msb = 63 - __builtin_clzl(ns);
+    size_fx sub = (ns >> (msb - 4)) & (BENCH_HIST_SUB - 1);
+    return (msb - 3) * BENCH_HIST_SUB + sub;
+}
+
+static size_fx bench_hist_value(size_fx bucket){
+
+    if(bucket < BENCH_HIST_SUB)
+        return bucket;
+
+    size_fx msb = bucket / BENCH_HIST_SUB + 3;
+    size_fx sub = bucket % BENCH_HIST_SUB;
+    return ((size_fx)1 << msb) | (sub << (msb - 4));
+}
+
+static FX_INLINE void bench_hist_add(bench_hist* hist, size_fx ns){
+    hist->count[bench_hist_bucket(ns)]++;
+    hist->total++;
+}
+
+static void bench_hist_merge(bench_hist* dst, const bench_hist* src){
+
+    for(size_fx i = 0; i < BENCH_HIST_BUCKETS; i++)
+        dst->count[i] += src->count[i];
+    dst->total += src->total;
+}
+
+static size_fx bench_hist_percentile(const bench_hist* hist, double pct){
+
+    size_fx target = (size_fx)ceil((double)hist->total * pct);
+    size_fx seen = 0;
+
+    for(size_fx i = 0; i < BENCH_HIST_BUCKETS; i++){
+        seen += hist->count[i];
+        if(seen >= target && hist->count[i])
+            return bench_hist_value(i);
+    }
+
+    return 0;
+}
+
+static FX_INLINE size_fx bench_ns(void){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_fx)ts.tv_sec * 1000000000UL + (size_fx)ts.tv_nsec;
+}
+
+/* ---------------- one configuration ---------------- */
+
+typedef struct bench_run{
+    const bench_args*   args;
+    enum EVICTION_POLICY policy;
+    enum INDEX_TYPE     index;
+    bench_zipf          zipf;
+
+    flexcache*          cache; //threads == 1
+    fcache_sharded*     sharded;
+} bench_run;
+
+typedef struct bench_worker{
+    bench_run*          run;
+    pthread_t           thread;
+    size_fx             ops;
+    size_fx             seed;
+    size_fx             hits;
+    bench_hist          hist;
+} bench_worker;
+
+static void bench_reader(const void* value, void* aux_data){
+    *(size_fx*)aux_data += ((const bench_value*)value)->bytes[0];
+}
+
+static FX_INLINE void bench_op_set(bench_run* run, long* key, size_fx fill){
+
+    set_option options = {0};
+    options.EX = run->args->ttl;
+
+    bench_value* value = bench_value_new(run->args->value_size, fill);
+    if(run->cache)
+        fcache_set_free(run->cache, key, value, &options, &bench_free_fx);
+    else
+        fcache_sharded_set_free(run->sharded, key, value, &options, &bench_free_fx);
+}
+
+static FX_INLINE bool_t bench_op_get(bench_run* run, long* key, size_fx* sink){
+
+    if(run->cache){
+        const bench_value* value = fcache_get_ptr(run->cache, key);
+        if(value)
+            *sink += value->bytes[0];
+        return value != 0;
+    }
+
+    return fcache_sharded_read(run->sharded, key, bench_reader, sink);
+}
+
+static void* bench_worker_main(void* arg){
+
+    bench_worker* worker = arg;
+    bench_run* run = worker->run;
+    const bench_args* args = run->args;
+    size_fx rnd = worker->seed;
+    size_fx sink = 0;
+
+    for(size_fx i = 0; i < worker->ops; i++){
+        size_fx rank = args->zipf ? bench_zipf_next(&run->zipf, &rnd) : rand_fx(&rnd) % args->keys;
+        long* key = &bench_keys[bench_scatter(rank, args->keys)];
+        bool_t read = rand_fx(&rnd) % 100 < args->read_pct;
+
+        size_fx start = bench_ns();
+        if(read)
+            worker->hits += bench_op_get(run, key, &sink);
+        else
+            bench_op_set(run, key, i);
+        bench_hist_add(&worker->hist, bench_ns() - start);
+    }
+
+    if(sink == 1) //keeps the reads
+        fputs("", stderr);
+
+    return 0;
+}
+
+static const char* bench_policy_name(enum EVICTION_POLICY policy){
+
+    switch(policy){
+        case LRU:           return "LRU";
+        case LFU:           return "LFU";
+        case FIFO:          return "FIFO";
+        case TTL:           return "TTL";
+        case RANDOM:        return "RANDOM";
+        case APPROX_LRU:    return "APPROX_LRU";
+        case WTINYLFU:      return "WTINYLFU";
+        case SLRU:          return "SLRU";
+    }
+    return "?";
+}
+
+static bool_t bench_setup(bench_run* run){
+
+    const bench_args* args = run->args;
+
+    init_option options = {0};
+    options.index = run->index;
+    options.concurrent_reads = args->concurrent_reads;
+
+    if(args->threads == 1){
+        run->cache = fcache_new(&bench_allocator);
+        return run->cache && fcache_init(run->cache, run->policy, bench_funcs(), args->maxmemory, &options);
+    }
+
+    run->sharded = fcache_sharded_init(args->shards, run->policy, bench_funcs(), args->maxmemory, &options);
+    return run->sharded != 0;
+}
+
+static void bench_teardown(bench_run* run){
+
+    if(run->cache)
+        fcache_free(run->cache, &bench_free_fx);
+    if(run->sharded)
+        fcache_sharded_free(run->sharded, &bench_free_fx);
+}
+
+static bool_t bench_exists(bench_run* run, long* key){
+    return run->cache ? fcache_key_exists(run->cache, key) : fcache_sharded_key_exists(run->sharded, key);
+}
+
+static void bench_cache(const bench_args* args, enum EVICTION_POLICY policy, enum INDEX_TYPE index, const bench_zipf* zipf){
+
+    bench_run run = {args, policy, index, *zipf, 0, 0};
+    const char* index_name = index == INDEX_HASH ? "hash" : "rbtree";
+
+    if(args->concurrent_reads && index != INDEX_HASH)
+        return;
+
+    size_fx base_bytes = atomic_load(&bench_live_bytes);
+    if(!bench_setup(&run)){
+        fprintf(stderr, "bench: init failed for %s/%s\n", bench_policy_name(policy), index_name);
+        return;
+    }
+
+    //prefill: every key once, the cache keeps what fits
+    for(size_fx i = 0; i < args->keys; i++)
+        bench_op_set(&run, &bench_keys[i], i);
+
+    bench_worker* workers = calloc(args->threads, sizeof(bench_worker));
+    size_fx start = bench_ns();
+
+    for(size_fx t = 0; t < args->threads; t++){
+        workers[t].run = &run;
+        workers[t].ops = args->ops / args->threads;
+        workers[t].seed = (args->seed + t * 0x9E3779B97F4A7C15UL) | 1;
+        pthread_create(&workers[t].thread, 0, bench_worker_main, &workers[t]);
+    }
+
+    bench_hist* hist = calloc(1, sizeof(bench_hist));
+    size_fx hits = 0;
+    for(size_fx t = 0; t < args->threads; t++){
+        pthread_join(workers[t].thread, 0);
+        bench_hist_merge(hist, &workers[t].hist);
+        hits += workers[t].hits;
+    }
+
+    double seconds = (double)(bench_ns() - start) / 1e9;
+
+    size_fx resident = 0;
+    for(size_fx i = 0; i < args->keys; i++)
+        resident += bench_exists(&run, &bench_keys[i]) != 0;
+
+    size_fx bytes = atomic_load(&bench_live_bytes) - base_bytes;
+    size_fx reads = hist->total * args->read_pct / 100;
+
+    printf("{\"bench\":\"cache\",\"policy\":\"%s\",\"index\":\"%s\",\"dist\":\"%s\",\"theta\":%.3f,"
+           "\"keys\":%lu,\"value_size\":%lu,\"read_pct\":%lu,\"threads\":%lu,\"shards\":%lu,"
+           "\"concurrent_reads\":%d,\"maxmemory\":%lu,\"ops\":%lu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+           "\"hit_ratio\":%.4f,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,"
+           "\"resident_keys\":%lu,\"bytes_per_key\":%.1f}\n",
+           bench_policy_name(policy), index_name, args->zipf ? "zipf" : "uniform", args->theta,
+           args->keys, args->value_size, args->read_pct, args->threads, args->threads == 1 ? 0 : args->shards,
+           args->concurrent_reads, args->maxmemory, hist->total, seconds, (double)hist->total / seconds,
+           reads ? (double)hits / (double)reads : 0.0,
+           bench_hist_percentile(hist, 0.50), bench_hist_percentile(hist, 0.99), bench_hist_percentile(hist, 0.999),
+           resident, resident ? (double)bytes / (double)resident : 0.0);
+    fflush(stdout);
+
+    free(hist);
+    free(workers);
+    bench_teardown(&run);
+}
+
+// stack_fx growth: push ops pointers then pop them all, per op latency
+static void bench_stack(const bench_args* args){
+
+    bench_hist* hist = calloc(1, sizeof(bench_hist));
+    size_fx start = bench_ns();
+
+    stack_fx* stack = stack_new(&bench_allocator);
+    for(size_fx i = 0; i < args->ops; i++){
+        size_fx op_start = bench_ns();
+        stack_push(stack, &bench_keys[i % args->keys]);
+        bench_hist_add(hist, bench_ns() - op_start);
+    }
+    size_fx peak = atomic_load(&bench_live_bytes);
+
+    for(size_fx i = 0; i < args->ops; i++)
+        stack_pop(stack);
+    stack_free(stack);
+
+    double seconds = (double)(bench_ns() - start) / 1e9;
+
+    printf("{\"bench\":\"stack_push\",\"ops\":%lu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+           "\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,\"peak_bytes\":%lu}\n",
+           args->ops, seconds, (double)(2 * args->ops) / seconds,
+           bench_hist_percentile(hist, 0.50), bench_hist_percentile(hist, 0.99), bench_hist_percentile(hist, 0.999),
+           peak);
+    fflush(stdout);
+
+    free(hist);
+}
+
+/* ---------------- command line ---------------- */
+
+static void bench_usage(void){
+    fputs("usage: bench [--policy NAME|all] [--index rbtree|hash|all] [--dist zipf|uniform] [--theta F]\n"
+          "             [--keys N] [--ops N] [--value-size B] [--reads PCT] [--threads T] [--shards S]\n"
+          "             [--maxmemory B] [--ttl SEC] [--concurrent-reads] [--seed N]\n", stderr);
+    exit(2);
+}
+
+static void bench_parse(bench_args* args, int argc, char** argv){
+
+    for(int i = 1; i < argc; i++){
+        const char* opt = argv[i];
+
+        if(strcmp(opt, "--concurrent-reads") == 0){
+            args->concurrent_reads = 1;
+            continue;
+        }
+        if(i + 1 >= argc)
+            bench_usage();
+
+        const char* val = argv[++i];
+        if(strcmp(opt, "--policy") == 0)            args->policy = val;
+        else if(strcmp(opt, "--index") == 0)        args->index = val;
+        else if(strcmp(opt, "--dist") == 0)         args->zipf = strcmp(val, "uniform") != 0;
+        else if(strcmp(opt, "--theta") == 0)        args->theta = atof(val);
+        else if(strcmp(opt, "--keys") == 0)         args->keys = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--ops") == 0)          args->ops = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--value-size") == 0)   args->value_size = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--reads") == 0)        args->read_pct = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--threads") == 0)      args->threads = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--shards") == 0)       args->shards = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--maxmemory") == 0)    args->maxmemory = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--ttl") == 0)          args->ttl = atol(val);
+        else if(strcmp(opt, "--seed") == 0)         args->seed = strtoul(val, 0, 10);
+        else                                        bench_usage();
+    }
+
+    if(args->keys == 0 || args->threads == 0 || args->shards == 0 || args->read_pct > 100 || args->theta >= 1.0)
+        bench_usage();
+    if(args->maxmemory == 0)
+        args->maxmemory = args->keys * args->value_size / 2;
+}
+
+static const enum EVICTION_POLICY bench_policies[] = {LRU, LFU, FIFO, TTL, RANDOM, APPROX_LRU, WTINYLFU, SLRU};
+
+int main(int argc, char** argv){
+
+    bench_args args = {"all", "all", 1, 0.99, 100000, 1000000, 64, 90, 1, 16, 0, 0, 0, 1};
+    bench_parse(&args, argc, argv);
+
+    bench_keys = malloc(args.keys * sizeof(long));
+    for(size_fx i = 0; i < args.keys; i++)
+        bench_keys[i] = (long)i;
+
+    bench_zipf zipf;
+    bench_zipf_init(&zipf, args.keys, args.theta);
+
+    for(size_fx p = 0; p < sizeof(bench_policies) / sizeof(bench_policies[0]); p++){
+        enum EVICTION_POLICY policy = bench_policies[p];
+        if(strcmp(args.policy, "all") != 0 && strcmp(args.policy, bench_policy_name(policy)) != 0)
+            continue;
+
+        if(strcmp(args.index, "all") == 0 || strcmp(args.index, "rbtree") == 0)
+            bench_cache(&args, policy, INDEX_RBTREE, &zipf);
+        if(strcmp(args.index, "all") == 0 || strcmp(args.index, "hash") == 0)
+            bench_cache(&args, policy, INDEX_HASH, &zipf);
+    }
+
+    bench_stack(&args);
+
+    free(bench_keys);
+    return 0;
+}
@@ -0,0 +1,469 @@
+// Workload replay: runs a recorded key trace against every eviction policy.
+// One JSON object per line on stdout, one line per policy:
+//
+//   replay (--trace FILE | --synthetic N) [--policy NAME|all] [--index rbtree|hash]
+//          [--maxmemory B] [--value-size B] [--ttl SEC] [--threads T] [--shards S]
+//          [--keys N] [--seed N]
+//
+// Trace file: the 8 bytes "FXTRACE1" then 16 byte records, little endian:
+//   u64 key | u32 value_size | u8 op | 3 bytes padding
+// op 0 is a get (a miss loads the key, cache aside, value_size bytes... 0 for --value-size),
+// 1 a set and 2 a delete. --synthetic N replays N generated ops instead: --keys keys,
+// 80% of the gets on 20% of them, one set in ten.
+//
+// Reported per policy: hit ratio of the gets, throughput, used_memory high water mark (checked
+// against maxmemory after every write), allocator high water mark and the bytes still allocated
+// after fcache_free, which must be 0: every evicted, replaced and removed value goes back through
+// the fcache_set_free callback.
+//
+// threads == 1 drives a flexcache directly, more threads replay interleaved slices of the trace
+// through fcache_sharded... build those with -fsanitize=thread for the stress runs:
+//
+//   make BUILD=build-tsan CFLAGS="-O1 -g -fsanitize=thread" replay
+//   ./build-tsan/bench/replay --synthetic 2000000 --threads 8
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../src/flexcache.h"
+#include "../src/fcache_sharded.h"
+
+#define REPLAY_MAGIC        "FXTRACE1"
+#define REPLAY_GET          0
+#define REPLAY_SET          1
+#define REPLAY_DEL          2
+#define REPLAY_SAMPLE_OPS   1024 //sharded runs sample used_memory every this many ops per thread
+
+typedef struct replay_record{
+    unsigned long long  key;
+    unsigned int        value_size;
+    unsigned char       op;
+    unsigned char       pad[3];
+} replay_record;
+
+typedef struct replay_args{
+    const char*     trace;
+    size_fx         synthetic;
+    const char*     policy;
+    const char*     index;
+    size_fx         maxmemory;
+    size_fx         value_size;
+    long            ttl;
+    size_fx         threads;
+    size_fx         shards;
+    size_fx         keys;
+    size_fx         seed;
+} replay_args;
+
+/* ---------------- counting allocator: live bytes and high water mark ---------------- */
+
+static _Atomic size_fx replay_live_bytes;
+static _Atomic size_fx replay_peak_bytes;
+
+//16 bytes keep the user pointer aligned like malloc
+static void* replay_alloc(size_fx size){
+
+    size_fx* block = malloc(size + 16);
+    if(!block)
+        return 0;
+
+    block[0] = size;
+    size_fx live = atomic_fetch_add_explicit(&replay_live_bytes, size, memory_order_relaxed) + size;
+    size_fx peak = atomic_load_explicit(&replay_peak_bytes, memory_order_relaxed);
+    while(live > peak && !atomic_compare_exchange_weak_explicit(&replay_peak_bytes, &peak, live,
+                                                                memory_order_relaxed, memory_order_relaxed))
+        ;
+    return (char*)block + 16;
+}
+
+static void replay_free(void* ptr){
+
+    if(!ptr)
+        return;
+
+    size_fx* block = (size_fx*)((char*)ptr - 16);
+    atomic_fetch_sub_explicit(&replay_live_bytes, block[0], memory_order_relaxed);
+    free(block);
+}
+
+static alloc_fx replay_alloc_fx = replay_alloc;
+static free_fx replay_free_fx = replay_free;
+static const allocator_fx replay_allocator = {
+    .alloc = &replay_alloc_fx,
+    .free = &replay_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+/* ---------------- keys, values and cache funcs ---------------- */
+
+// keys point into the loaded trace (one record per key use), it outlives every cache
+typedef struct replay_value{
+    size_fx         size;
+    char            bytes[];
+} replay_value;
+
+static size_fx replay_value_len(void* data){
+    return ((replay_value*)data)->size;
+}
+
+static void* replay_value_copy(void* data){
+
+    replay_value* value = data;
+    replay_value* copy = replay_alloc(sizeof(replay_value) + value->size);
+    if(copy)
+        memcpy(copy, value, sizeof(replay_value) + value->size);
+    return copy;
+}
+
+static replay_value* replay_value_new(size_fx size){
+
+    replay_value* value = replay_alloc(sizeof(replay_value) + size);
+    if(!value)
+        return 0;
+
+    value->size = size;
+    memset(value->bytes, 0x5A, size);
+    return value;
+}
+
+static int replay_key_cmp(const void* key1, const void* key2){
+    unsigned long long a = *(const unsigned long long*)key1;
+    unsigned long long b = *(const unsigned long long*)key2;
+    return (a > b) - (a < b);
+}
+
+static size_fx replay_key_hash(const void* key){
+
+    size_fx h = *(const unsigned long long*)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    return h;
+}
+
+static size_fx replay_key_len(void* key){
+    (void)key;
+    return sizeof(unsigned long long);
+}
+
+static void replay_now(time_fx* now){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now->tv_sec = ts.tv_sec;
+    now->tv_nsec = ts.tv_nsec;
+}
+
+static const len_func replay_value_len_fx = replay_value_len;
+static const len_func replay_key_len_fx = replay_key_len;
+static const copy_func replay_value_copy_fx = replay_value_copy;
+static const cmp_func replay_key_cmp_fx = replay_key_cmp;
+static const hash_func replay_key_hash_fx = replay_key_hash;
+static const now_func replay_now_fx = replay_now;
+
+static data_aux_funcs_t replay_funcs(void){
+
+    data_aux_funcs_t funcs = {
+        &replay_value_len_fx,
+        &replay_key_len_fx,
+        &replay_value_copy_fx,
+        &replay_key_cmp_fx,
+        &replay_key_hash_fx,
+        &replay_allocator,
+        &replay_now_fx
+    };
+    return funcs;
+}
+
+static FX_INLINE size_fx replay_ns(void){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_fx)ts.tv_sec * 1000000000UL + (size_fx)ts.tv_nsec;
+}
+
+/* ---------------- traces ---------------- */
+
+static replay_record* replay_load(const char* path, size_fx* n){
+
+    FILE* file = fopen(path, "rb");
+    if(!file)
+        return 0;
+
+    char magic[8];
+    replay_record* records = 0;
+    if(fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, REPLAY_MAGIC, sizeof(magic)) == 0
+        && fseek(file, 0, SEEK_END) == 0){
+
+        long bytes = ftell(file) - (long)sizeof(magic);
+        *n = bytes > 0 ? (size_fx)bytes / sizeof(replay_record) : 0;
+        records = malloc(*n * sizeof(replay_record) + 1);
+        if(records && (fseek(file, sizeof(magic), SEEK_SET) != 0
+                        || fread(records, sizeof(replay_record), *n, file) != *n)){
+            free(records);
+            records = 0;
+        }
+    }
+
+    fclose(file);
+    return records;
+}
+
+//hot set: 80% of the gets on the first fifth of the key space, spread over it
+static replay_record* replay_synthetic(const replay_args* args, size_fx n){
+
+    replay_record* records = calloc(n, sizeof(replay_record));
+    if(!records)
+        return 0;
+
+    size_fx rnd = args->seed | 1;
+    size_fx hot = args->keys / 5 ? args->keys / 5 : 1;
+    for(size_fx i = 0; i < n; i++){
+        size_fx pick = rand_fx(&rnd);
+        size_fx rank = pick % 100 < 80 ? rand_fx(&rnd) % hot : rand_fx(&rnd) % args->keys;
+        records[i].key = (rank * 0x9E3779B97F4A7C15UL) % args->keys;
+        records[i].op = pick % 10 == 0 ? REPLAY_SET : REPLAY_GET;
+    }
+    return records;
+}
+
+/* ---------------- one policy ---------------- */
+
+typedef struct replay_run{
+    const replay_args*  args;
+    enum EVICTION_POLICY policy;
+    replay_record*      records;
+    size_fx             n;
+
+    flexcache*          cache; //threads == 1
+    fcache_sharded*     sharded;
+    _Atomic size_fx     used_peak;
+    _Atomic size_fx     over_budget; //writes that left used_memory over maxmemory
+} replay_run;
+
+typedef struct replay_worker{
+    replay_run*         run;
+    pthread_t           thread;
+    size_fx             first; //replays records first, first + step, ...
+    size_fx             step;
+    size_fx             gets;
+    size_fx             hits;
+} replay_worker;
+
+static void replay_reader(const void* value, void* aux_data){
+    *(size_fx*)aux_data += ((const replay_value*)value)->bytes[0];
+}
+
+static void replay_set(replay_run* run, replay_record* record){
+
+    set_option options = {0};
+    options.EX = run->args->ttl;
+
+    replay_value* value = replay_value_new(record->value_size ? record->value_size : run->args->value_size);
+    if(run->cache)
+        fcache_set_free(run->cache, &record->key, value, &options, &replay_free_fx);
+    else
+        fcache_sharded_set_free(run->sharded, &record->key, value, &options, &replay_free_fx);
+}
+
+static void replay_sample(replay_run* run){
+
+    size_fx used = run->cache ? fcache_used_memory(run->cache) : fcache_sharded_used_memory(run->sharded);
+    if(used > run->args->maxmemory)
+        atomic_fetch_add_explicit(&run->over_budget, 1, memory_order_relaxed);
+
+    size_fx peak = atomic_load_explicit(&run->used_peak, memory_order_relaxed);
+    while(used > peak && !atomic_compare_exchange_weak_explicit(&run->used_peak, &peak, used,
+                                                                memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+static void* replay_worker_main(void* arg){
+
+    replay_worker* worker = arg;
+    replay_run* run = worker->run;
+    size_fx sink = 0;
+    size_fx ops = 0;
+
+    for(size_fx i = worker->first; i < run->n; i += worker->step){
+        replay_record* record = &run->records[i];
+
+        if(record->op == REPLAY_GET){
+            bool_t hit = run->cache ? fcache_get_ptr(run->cache, &record->key) != 0
+                                    : fcache_sharded_read(run->sharded, &record->key, replay_reader, &sink);
+            worker->gets++;
+            worker->hits += hit;
+            if(!hit)
+                replay_set(run, record);
+        } else if(record->op == REPLAY_SET){
+            replay_set(run, record);
+        } else {
+            replay_free(run->cache ? fcache_remove(run->cache, &record->key)
+                                   : fcache_sharded_remove(run->sharded, &record->key));
+        }
+
+        //every op with one thread, the shards are sampled now and then
+        if(run->cache || ++ops % REPLAY_SAMPLE_OPS == 0)
+            replay_sample(run);
+    }
+
+    if(sink == 1) //keeps the reads
+        fputs("", stderr);
+
+    return 0;
+}
+
+static const char* replay_policy_name(enum EVICTION_POLICY policy){
+
+    switch(policy){
+        case LRU:           return "LRU";
+        case LFU:           return "LFU";
+        case FIFO:          return "FIFO";
+        case TTL:           return "TTL";
+        case RANDOM:        return "RANDOM";
+        case APPROX_LRU:    return "APPROX_LRU";
+        case WTINYLFU:      return "WTINYLFU";
+        case SLRU:          return "SLRU";
+    }
+    return "?";
+}
+
+static bool_t replay_setup(replay_run* run){
+
+    const replay_args* args = run->args;
+
+    init_option options = {0};
+    options.index = strcmp(args->index, "hash") == 0 ? INDEX_HASH : INDEX_RBTREE;
+
+    if(args->threads == 1){
+        run->cache = fcache_new(&replay_allocator);
+        return run->cache && fcache_init(run->cache, run->policy, replay_funcs(), args->maxmemory, &options);
+    }
+
+    run->sharded = fcache_sharded_init(args->shards, run->policy, replay_funcs(), args->maxmemory, &options);
+    return run->sharded != 0;
+}
+
+static void replay_policy(const replay_args* args, enum EVICTION_POLICY policy, replay_record* records, size_fx n){
+
+    replay_run run = {args, policy, records, n, 0, 0, 0, 0};
+
+    size_fx base_bytes = atomic_load(&replay_live_bytes);
+    atomic_store(&replay_peak_bytes, base_bytes);
+    if(!replay_setup(&run)){
+        fprintf(stderr, "replay: init failed for %s\n", replay_policy_name(policy));
+        return;
+    }
+
+    replay_worker* workers = calloc(args->threads, sizeof(replay_worker));
+    size_fx start = replay_ns();
+
+    for(size_fx t = 0; t < args->threads; t++){
+        workers[t].run = &run;
+        workers[t].first = t;
+        workers[t].step = args->threads;
+        pthread_create(&workers[t].thread, 0, replay_worker_main, &workers[t]);
+    }
+
+    size_fx gets = 0;
+    size_fx hits = 0;
+    for(size_fx t = 0; t < args->threads; t++){
+        pthread_join(workers[t].thread, 0);
+        gets += workers[t].gets;
+        hits += workers[t].hits;
+    }
+
+    double seconds = (double)(replay_ns() - start) / 1e9;
+
+    fcache_stats_t stats;
+    if(run.cache)
+        fcache_stats(run.cache, &stats);
+    else
+        fcache_sharded_stats(run.sharded, &stats, 0);
+    size_fx alloc_peak = atomic_load(&replay_peak_bytes) - base_bytes;
+
+    if(run.cache)
+        fcache_free(run.cache, &replay_free_fx);
+    else
+        fcache_sharded_free(run.sharded, &replay_free_fx);
+    size_fx leaked = atomic_load(&replay_live_bytes) - base_bytes;
+
+    printf("{\"bench\":\"replay\",\"trace\":\"%s\",\"policy\":\"%s\",\"index\":\"%s\",\"threads\":%lu,"
+           "\"shards\":%lu,\"maxmemory\":%lu,\"ops\":%lu,\"gets\":%lu,\"hit_ratio\":%.4f,\"seconds\":%.6f,"
+           "\"ops_per_sec\":%.0f,\"used_high_water\":%lu,\"over_budget\":%lu,\"alloc_high_water\":%lu,"
+           "\"evicted_memory\":%lu,\"evicted_ttl\":%lu,\"leaked_bytes\":%lu}\n",
+           args->trace ? args->trace : "synthetic", replay_policy_name(policy), args->index, args->threads,
+           args->threads == 1 ? 0 : args->shards, args->maxmemory, n, gets, gets ? (double)hits / (double)gets : 0.0,
+           seconds, (double)n / seconds, atomic_load(&run.used_peak), atomic_load(&run.over_budget), alloc_peak,
+           stats.evicted_memory, stats.evicted_ttl, leaked);
+    fflush(stdout);
+
+    free(workers);
+}
+
+/* ---------------- command line ---------------- */
+
+static void replay_usage(void){
+    fputs("usage: replay (--trace FILE | --synthetic N) [--policy NAME|all] [--index rbtree|hash]\n"
+          "              [--maxmemory B] [--value-size B] [--ttl SEC] [--threads T] [--shards S]\n"
+          "              [--keys N] [--seed N]\n", stderr);
+    exit(2);
+}
+
+static void replay_parse(replay_args* args, int argc, char** argv){
+
+    for(int i = 1; i < argc; i++){
+        const char* opt = argv[i];
+        if(i + 1 >= argc)
+            replay_usage();
+
+        const char* val = argv[++i];
+        if(strcmp(opt, "--trace") == 0)             args->trace = val;
+        else if(strcmp(opt, "--synthetic") == 0)    args->synthetic = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--policy") == 0)       args->policy = val;
+        else if(strcmp(opt, "--index") == 0)        args->index = val;
+        else if(strcmp(opt, "--maxmemory") == 0)    args->maxmemory = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--value-size") == 0)   args->value_size = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--ttl") == 0)          args->ttl = atol(val);
+        else if(strcmp(opt, "--threads") == 0)      args->threads = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--shards") == 0)       args->shards = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--keys") == 0)         args->keys = strtoul(val, 0, 10);
+        else if(strcmp(opt, "--seed") == 0)         args->seed = strtoul(val, 0, 10);
+        else                                        replay_usage();
+    }
+
+    if((!args->trace) == (args->synthetic == 0) || args->keys == 0 || args->threads == 0 || args->shards == 0)
+        replay_usage();
+    //about a quarter of the synthetic key space fits
+    if(args->maxmemory == 0)
+        args->maxmemory = args->keys * (args->value_size + 64) / 4;
+}
+
+static const enum EVICTION_POLICY replay_policies[] = {LRU, LFU, FIFO, TTL, RANDOM, APPROX_LRU, WTINYLFU, SLRU};
+
+int main(int argc, char** argv){
+
+    replay_args args = {0, 0, "all", "hash", 0, 64, 0, 1, 16, 100000, 1};
+    replay_parse(&args, argc, argv);
+
+    size_fx n = args.synthetic;
+    replay_record* records = args.trace ? replay_load(args.trace, &n) : replay_synthetic(&args, n);
+    if(!records){
+        fprintf(stderr, "replay: can not read %s\n", args.trace ? args.trace : "the synthetic trace");
+        return 1;
+    }
+
+    for(size_fx p = 0; p < sizeof(replay_policies) / sizeof(replay_policies[0]); p++){
+        enum EVICTION_POLICY policy = replay_policies[p];
+        if(strcmp(args.policy, "all") == 0 || strcmp(args.policy, replay_policy_name(policy)) == 0)
+            replay_policy(&args, policy, records, n);
+    }
+
+    free(records);
+    return 0;
+}
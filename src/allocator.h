@@ -1,3 +1,5 @@
+#ifndef __ALLOCATOR_H__
+#define __ALLOCATOR_H__
 
 typedef unsigned long size_fx;
 
@@ -5,8 +7,18 @@ typedef struct allocator_fx allocator_fx;
 
 typedef void (*free_fx) (void*);
 typedef void *(*alloc_fx)  (size_fx size);
+typedef size_fx (*held_fx) (void);
+typedef size_fx (*usable_fx) (size_fx size);
+
+//deferred free: ptr must be released with free once nothing can read it anymore
+typedef void (*reclaim_fx) (void* aux_data, void* ptr, free_fx* free);
 
 struct allocator_fx{
     alloc_fx* alloc;
     free_fx* free;
-};
\ No newline at end of file
+    held_fx* held; //OPTIONAL... bytes the allocator holds from the system, for reporting only: every user
+                   //of the allocator sees the same figure, caches charge usable per entry instead
+    usable_fx* usable; //OPTIONAL... bytes an alloc of size really takes (size class rounding), size when 0
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "cm_sketch.h"
+
+#define CM_DEPTH        4
+#define CM_MIN_WORDS    8
+#define CM_RESET_MASK   0x7777777777777777ULL
+
+static const size_fx cm_seeds[CM_DEPTH] = {
+    0xc3a5c85c97cb3127UL, 0xb492b66fbe98f273UL, 0x9ae16a3b2f90404fUL, 0xcbf29ce484222325UL
+};
+
+static FX_INLINE size_fx cm_spread(size_fx hash){
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdUL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static FX_INLINE size_fx cm_index(const cm_sketch_fx* sketch, size_fx hash, int row){
+
+    size_fx h = (hash + cm_seeds[row]) * cm_seeds[row];
+    h += h >> 32;
+    return h & sketch->mask;
+}
+
+//counter of row in its word: the low 2 bits of the hash pick one of 4 lanes of 4 rows
+static FX_INLINE unsigned int cm_shift(size_fx hash, int row){
+    return (unsigned int)((((hash & 3) << 2) + row) << 2);
+}
+
+static size_fx cm_words(size_fx expected_keys){
+
+    size_fx words = CM_MIN_WORDS;
+    while(words * 2 < expected_keys)
+        words <<= 1;
+
+    return words;
+}
+
+static int cm_alloc(cm_sketch_fx* sketch, size_fx words){
+
+    unsigned long long* table = (*sketch->allocator->alloc)(words * sizeof(unsigned long long));
+    if(!table)
+        return 0;
+
+    zero_mem_fx(table, words * sizeof(unsigned long long));
+
+    if(sketch->table)
+        (*sketch->allocator->free)(sketch->table);
+
+    sketch->table = table;
+    sketch->mask = words - 1;
+    sketch->additions = 0;
+    sketch->sample_size = 10 * words * 2;
+
+    return 1;
+}
+
+int cm_sketch_init(cm_sketch_fx* sketch, size_fx expected_keys, const allocator_fx* allocator){
+
+    sketch->table = 0;
+    sketch->allocator = allocator;
+
+    return cm_alloc(sketch, cm_words(expected_keys));
+}
+
+void cm_sketch_destroy(cm_sketch_fx* sketch){
+
+    if(sketch->table)
+        (*sketch->allocator->free)(sketch->table);
+    sketch->table = 0;
+}
+
+int cm_sketch_ensure(cm_sketch_fx* sketch, size_fx keys){
+
+    size_fx words = cm_words(keys);
+    if(words <= sketch->mask + 1)
+        return 1;
+
+    return cm_alloc(sketch, words);
+}
+
+static void cm_reset(cm_sketch_fx* sketch){
+
+    for(size_fx i = 0; i <= sketch->mask; i++)
+        sketch->table[i] = (sketch->table[i] >> 1) & CM_RESET_MASK;
+
+    sketch->additions >>= 1;
+}
+
+void cm_sketch_increment(cm_sketch_fx* sketch, size_fx hash){
+
+    hash = cm_spread(hash);
+    bool_t added = 0;
+
+    for(int row = 0; row < CM_DEPTH; row++){
+        unsigned long long* word = &sketch->table[cm_index(sketch, hash, row)];
+        unsigned int shift = cm_shift(hash, row);
+
+        if(((*word >> shift) & 0xF) != 0xF){
+            *word += 1ULL << shift;
+            added = 1;
+        }
+    }
+
+    if(added && ++sketch->additions >= sketch->sample_size)
+        cm_reset(sketch);
+}
+
+unsigned int cm_sketch_estimate(const cm_sketch_fx* sketch, size_fx hash){
+
+    hash = cm_spread(hash);
+    unsigned int estimate = 0xF;
+
+    for(int row = 0; row < CM_DEPTH; row++){
+        unsigned long long word = sketch->table[cm_index(sketch, hash, row)];
+        unsigned int count = (unsigned int)((word >> cm_shift(hash, row)) & 0xF);
+        if(count < estimate)
+            estimate = count;
+    }
+
+    return estimate;
+}
@@ -0,0 +1,39 @@
+#ifndef __CM_SKETCH_H__
+#define __CM_SKETCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+// Count-Min sketch of 4 bit counters, 4 rows, for the W-TinyLFU admission filter.
+// A word holds 16 counters, a key uses one counter per row, all rows indexed in the same
+// table (about 4 bytes per expected key). Counters saturate at 15 and every counter is halved
+// after 10 * expected_keys increments, so the estimate follows recent popularity.
+
+typedef struct cm_sketch_fx{
+    unsigned long long*     table;
+    size_fx                 mask; //words - 1
+    size_fx                 additions;
+    size_fx                 sample_size;
+    const allocator_fx*     allocator;
+} cm_sketch_fx;
+
+int cm_sketch_init(cm_sketch_fx* sketch, size_fx expected_keys, const allocator_fx* allocator);
+
+void cm_sketch_destroy(cm_sketch_fx* sketch);
+
+//grows (and clears) the table when the cache holds more keys than it was sized for
+int cm_sketch_ensure(cm_sketch_fx* sketch, size_fx keys);
+
+void cm_sketch_increment(cm_sketch_fx* sketch, size_fx hash);
+
+//0..15, never below the real count since the last aging (saturated at 15)
+unsigned int cm_sketch_estimate(const cm_sketch_fx* sketch, size_fx hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "commons.h"
 
 void swap_ptr_fx(void* a, void* b){
@@ -5,31 +7,24 @@ void swap_ptr_fx(void* a, void* b){
     a = b;
     b = tmp;
 }
+
+// libc picks its vector copy / fill (SSE2, AVX2, ERMS) at load time by CPUID
 void memcopy_fx(void *src, const void *dest, size_fx size){
-    char *csrc = (char *)src;  
-    char *cdest = (char *)dest;  
-  
-    for (size_fx i = 0; i < size; i++)
-        cdest[i] = csrc[i];
+    if(size)
+        memcpy((void*)dest, src, size);
 }
 
 void memcopy_zer_src_fx(void *src, const void *dest, size_fx size){
-    char *csrc = (char *)src;  
-    char *cdest = (char *)dest;  
-  
-    for (size_fx i = 0; i < size; i++){
-        cdest[i] = csrc[i];
-        csrc[i] = 0;
+    if(size){
+        memcpy((void*)dest, src, size);
+        memset(src, 0, size);
     }
 
 }
 
 void zero_mem_fx(void *mem, size_fx size){
-    
-    char *mem_c = (char *)mem;  
-    
-    for (size_fx i = 0; i < size; i++)
-        mem_c[i] = 0;
+    if(size)
+        memset(mem, 0, size);
 }
 
 
@@ -48,3 +43,40 @@ void time_fx_add(time_fx t1, time_fx t2, time_fx *td){
     td->tv_sec = sec;
     td->tv_nsec = nsec;
 }
+
+void time_fx_sub(time_fx t1, time_fx t2, time_fx *td){
+
+    long sec = t1.tv_sec - t2.tv_sec;
+    long nsec = t1.tv_nsec - t2.tv_nsec;
+
+    if (nsec < 0) {
+        nsec += NS_PER_SECOND;
+        sec--;
+    }
+
+    td->tv_sec = sec;
+    td->tv_nsec = nsec;
+}
+
+long time_fx_diff_ms(time_fx later, time_fx earlier){
+
+    time_fx diff;
+    time_fx_sub(later, earlier, &diff);
+
+    return diff.tv_sec * 1000 + diff.tv_nsec / 1000000;
+}
+
+unsigned long long time_fx_to_ms(time_fx t){
+    return (unsigned long long)t.tv_sec * 1000 + (unsigned long long)(t.tv_nsec / 1000000);
+}
+
+size_fx rand_fx(size_fx* state){
+
+    size_fx x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545F4914F6CDD1DUL;
+}
@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include "allocator.h"
 
 #define FX_INLINE inline
@@ -20,11 +21,14 @@ typedef size_fx (*len_func)(void* data);
 typedef void* (*copy_func)(void* data);
 typedef int (*cmp_func)(const void *key1, const void *key2);
 typedef void (*now_func)(time_fx*);
+typedef size_fx (*hash_func)(const void* key);
 
 typedef struct data_aux_funcs_t{
     const len_func*          len_func;
+    const len_func*          key_len; //OPTIONAL, bytes of a key... keys are only stored inline when set
     const copy_func*         copy_func;
     const cmp_func*          compare;
+    const hash_func*         hash; //only required by the INDEX_HASH key index
     
     const allocator_fx*      allocator;
     const now_func*          now;
@@ -48,6 +52,13 @@ void time_fx_add_seconds(time_fx t1, long t2, time_fx *td);
 
 void time_fx_sub(time_fx t1, time_fx t2, time_fx *td);
 
+long time_fx_diff_ms(time_fx later, time_fx earlier);
+
+unsigned long long time_fx_to_ms(time_fx t);
+
+//xorshift64*... state must be seeded non zero
+size_fx rand_fx(size_fx* state);
+
 #ifdef __cplusplus
 }
 #endif
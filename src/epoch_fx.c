@@ -0,0 +1,232 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "epoch_fx.h"
+
+#define EPOCH_LIMBOS            3
+#define EPOCH_COLLECT_EVERY     64 //retires between two collect attempts
+
+typedef struct epoch_retired{
+    void*                   ptr;
+    free_fx                 free;
+    struct epoch_retired*   next;
+} epoch_retired;
+
+typedef struct epoch_limbo{
+    size_fx                 epoch; //epoch the entries were retired in
+    epoch_retired*          head;
+} epoch_limbo;
+
+typedef struct epoch_record{
+    _Atomic size_fx         state; //(epoch << 1) | 1 while inside, 0 outside
+    _Atomic int             in_use;
+    struct epoch_record*    next;
+    epoch_fx*               domain;
+    epoch_limbo             limbo[EPOCH_LIMBOS];
+    size_fx                 retires;
+} epoch_record;
+
+struct epoch_fx{
+    _Atomic size_fx             epoch;
+    _Atomic(epoch_record*)      records;
+    const allocator_fx*         allocator;
+    pthread_key_t               self;
+
+    pthread_mutex_t             orphan_lock;
+    epoch_retired*              orphans; //left by exited threads, freed at epoch_free
+};
+
+static void epoch_free_list(epoch_retired* iter, const allocator_fx* allocator){
+
+    while(iter){
+        epoch_retired* next = iter->next;
+        iter->free(iter->ptr);
+        (*allocator->free)(iter);
+        iter = next;
+    }
+}
+
+// thread exit: what is still retired goes to the domain, the record is reused by the next thread
+static void epoch_thread_exit(void* arg){
+
+    epoch_record* record = arg;
+    epoch_fx* domain = record->domain;
+
+    pthread_mutex_lock(&domain->orphan_lock);
+    for(int i = 0; i < EPOCH_LIMBOS; i++){
+        epoch_retired* iter = record->limbo[i].head;
+        while(iter){
+            epoch_retired* next = iter->next;
+            iter->next = domain->orphans;
+            domain->orphans = iter;
+            iter = next;
+        }
+        record->limbo[i].head = 0;
+    }
+    pthread_mutex_unlock(&domain->orphan_lock);
+
+    atomic_store_explicit(&record->state, 0, memory_order_release);
+    atomic_store_explicit(&record->in_use, 0, memory_order_release);
+}
+
+epoch_fx* epoch_new(const allocator_fx* allocator){
+
+    epoch_fx* domain = (*allocator->alloc)(sizeof(epoch_fx));
+    if(!domain)
+        return 0;
+
+    if(pthread_key_create(&domain->self, epoch_thread_exit) != 0){
+        (*allocator->free)(domain);
+        return 0;
+    }
+
+    atomic_init(&domain->epoch, 0);
+    atomic_init(&domain->records, 0);
+    domain->allocator = allocator;
+    pthread_mutex_init(&domain->orphan_lock, 0);
+    domain->orphans = 0;
+
+    return domain;
+}
+
+void epoch_free(epoch_fx* domain){
+
+    const allocator_fx* allocator = domain->allocator;
+    epoch_record* record = atomic_load(&domain->records);
+
+    while(record){
+        epoch_record* next = record->next;
+        for(int i = 0; i < EPOCH_LIMBOS; i++)
+            epoch_free_list(record->limbo[i].head, allocator);
+        (*allocator->free)(record);
+        record = next;
+    }
+
+    epoch_free_list(domain->orphans, allocator);
+    pthread_key_delete(domain->self);
+    pthread_mutex_destroy(&domain->orphan_lock);
+    (*allocator->free)(domain);
+}
+
+static epoch_record* epoch_self(epoch_fx* domain){
+
+    epoch_record* record = pthread_getspecific(domain->self);
+    if(record)
+        return record;
+
+    //reuse the record of an exited thread
+    for(record = atomic_load(&domain->records); record; record = record->next){
+        int expected = 0;
+        if(atomic_compare_exchange_strong(&record->in_use, &expected, 1))
+            break;
+    }
+
+    if(!record){
+        record = (*domain->allocator->alloc)(sizeof(epoch_record));
+        if(!record)
+            return 0;
+
+        atomic_init(&record->state, 0);
+        atomic_init(&record->in_use, 1);
+        record->domain = domain;
+        for(int i = 0; i < EPOCH_LIMBOS; i++){
+            record->limbo[i].epoch = 0;
+            record->limbo[i].head = 0;
+        }
+
+        epoch_record* head = atomic_load(&domain->records);
+        do{
+            record->next = head;
+        } while(!atomic_compare_exchange_weak(&domain->records, &head, record));
+    }
+
+    record->retires = 0;
+    pthread_setspecific(domain->self, record);
+    return record;
+}
+
+void epoch_enter(epoch_fx* domain){
+
+    epoch_record* record = epoch_self(domain);
+    size_fx epoch = atomic_load_explicit(&domain->epoch, memory_order_relaxed);
+
+    //seq_cst: the pin must be visible before any read of the shared structure
+    atomic_store(&record->state, (epoch << 1) | 1);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void epoch_exit(epoch_fx* domain){
+
+    epoch_record* record = pthread_getspecific(domain->self);
+    atomic_store_explicit(&record->state, 0, memory_order_release);
+}
+
+// the epoch moves when every thread inside already saw the current one
+static size_fx epoch_try_advance(epoch_fx* domain){
+
+    size_fx epoch = atomic_load(&domain->epoch);
+
+    for(epoch_record* record = atomic_load(&domain->records); record; record = record->next){
+        size_fx state = atomic_load(&record->state);
+        if((state & 1) && (state >> 1) != epoch)
+            return epoch;
+    }
+
+    if(atomic_compare_exchange_strong(&domain->epoch, &epoch, epoch + 1))
+        return epoch + 1;
+
+    return epoch;
+}
+
+static void epoch_reclaim(epoch_fx* domain, epoch_record* record, size_fx epoch){
+
+    for(int i = 0; i < EPOCH_LIMBOS; i++){
+        epoch_limbo* limbo = &record->limbo[i];
+        if(limbo->head && limbo->epoch + 2 <= epoch){
+            epoch_free_list(limbo->head, domain->allocator);
+            limbo->head = 0;
+        }
+    }
+}
+
+void epoch_retire(epoch_fx* domain, void* ptr, free_fx free){
+
+    epoch_record* record = epoch_self(domain);
+    epoch_retired* retired = record ? (*domain->allocator->alloc)(sizeof(epoch_retired)) : 0;
+
+    //out of memory: wait for the readers right here
+    if(!retired){
+        size_fx target = atomic_load(&domain->epoch) + 2;
+        while(epoch_try_advance(domain) < target)
+            ;
+        free(ptr);
+        return;
+    }
+
+    size_fx epoch = atomic_load(&domain->epoch);
+    epoch_limbo* limbo = &record->limbo[epoch % EPOCH_LIMBOS];
+
+    //slot still holds entries of epoch - 3: safe since two epochs passed
+    if(limbo->head && limbo->epoch != epoch){
+        epoch_free_list(limbo->head, domain->allocator);
+        limbo->head = 0;
+    }
+
+    retired->ptr = ptr;
+    retired->free = free;
+    retired->next = limbo->head;
+    limbo->head = retired;
+    limbo->epoch = epoch;
+
+    if(++record->retires % EPOCH_COLLECT_EVERY == 0)
+        epoch_reclaim(domain, record, epoch_try_advance(domain));
+}
+
+void epoch_collect(epoch_fx* domain){
+
+    epoch_record* record = epoch_self(domain);
+    if(!record)
+        return;
+
+    epoch_reclaim(domain, record, epoch_try_advance(domain));
+}
@@ -0,0 +1,37 @@
+#ifndef __EPOCH_FX_H__
+#define __EPOCH_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+// Epoch based reclamation.
+// Readers wrap every access to shared nodes in epoch_enter / epoch_exit (no lock, no shared write
+// besides their own record). Writers unlink first and then epoch_retire: the memory is only freed
+// once the global epoch moved two steps, when no reader that could have seen it is still inside.
+// Each thread gets a record on first use, retired memory waits on the retiring thread record.
+
+typedef struct epoch_fx epoch_fx;
+
+epoch_fx* epoch_new(const allocator_fx* allocator);
+
+//frees everything still retired... no thread may be inside the domain
+void epoch_free(epoch_fx* domain);
+
+void epoch_enter(epoch_fx* domain);
+
+void epoch_exit(epoch_fx* domain);
+
+//free(ptr) after the grace period
+void epoch_retire(epoch_fx* domain, void* ptr, free_fx free);
+
+//tries to move the epoch and frees what the calling thread retired and is now safe
+void epoch_collect(epoch_fx* domain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+#include "evict_pool.h"
+
+void evict_pool_init(evict_pool_fx* pool){
+    pool->count = 0;
+}
+
+void evict_pool_offer(evict_pool_fx* pool, flexnode* node, size_fx score){
+
+    evict_pool_entry* entries = pool->entries;
+
+    for(size_fx i = 0; i < pool->count; i++){
+        if(entries[i].node == node)
+            return;
+    }
+
+    //pool full... only better than the worst candidate gets in (worst is dropped)
+    if(pool->count == EVICT_POOL_SIZE){
+        if(score <= entries[0].score)
+            return;
+
+        for(size_fx i = 1; i < pool->count; i++)
+            entries[i - 1] = entries[i];
+        pool->count--;
+    }
+
+    size_fx pos = pool->count;
+    while(pos > 0 && entries[pos - 1].score > score){
+        entries[pos] = entries[pos - 1];
+        pos--;
+    }
+
+    entries[pos].node = node;
+    entries[pos].score = score;
+    pool->count++;
+}
+
+flexnode* evict_pool_pop(evict_pool_fx* pool){
+
+    if(pool->count == 0)
+        return 0;
+
+    pool->count--;
+    return pool->entries[pool->count].node;
+}
+
+void evict_pool_forget(evict_pool_fx* pool, flexnode* node){
+
+    evict_pool_entry* entries = pool->entries;
+
+    for(size_fx i = 0; i < pool->count; i++){
+        if(entries[i].node != node)
+            continue;
+
+        for(size_fx j = i + 1; j < pool->count; j++)
+            entries[j - 1] = entries[j];
+        pool->count--;
+        return;
+    }
+}
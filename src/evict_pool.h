@@ -0,0 +1,42 @@
+#ifndef __EVICT_POOL_H__
+#define __EVICT_POOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+#include "flexnode.h"
+
+// Small pool of eviction candidates for the sampled policies (APPROX_LRU, LFU).
+// Each eviction samples a few random keys, the best ones
+// (highest score, ex: idle time) are kept here across evictions, so the victim
+// quality gets close to the exact policy without keeping the list ordered on reads.
+
+#define EVICT_POOL_SIZE 16
+#define EVICT_POOL_DEFAULT_SAMPLES 5
+
+typedef struct evict_pool_entry{
+    flexnode*       node;
+    size_fx         score;
+} evict_pool_entry;
+
+typedef struct evict_pool_fx{
+    size_fx             count;
+    evict_pool_entry    entries[EVICT_POOL_SIZE]; //ascending by score, best victim last
+} evict_pool_fx;
+
+void evict_pool_init(evict_pool_fx* pool);
+
+void evict_pool_offer(evict_pool_fx* pool, flexnode* node, size_fx score);
+
+flexnode* evict_pool_pop(evict_pool_fx* pool);
+
+//must be called when node leaves the cache by any other path
+void evict_pool_forget(evict_pool_fx* pool, flexnode* node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
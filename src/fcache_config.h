@@ -5,7 +5,7 @@
 extern "C" {
 #endif
 
-#include "com_types.h"
+#include "commons.h"
 
 typedef struct fcache_config fcache_config;
 
@@ -18,9 +18,6 @@ struct fcache_config{
     size_t                   volatilememory;
     size_t                   nonvolatilememory;
 
-    size_t                   volatile_check_frequency;
-    time_fx                   last_full_volatile_check;
-
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "fcache_sharded.h"
+#include "epoch_fx.h"
+
+#define FX_CACHE_LINE 64
+
+typedef struct fcache_load_waiter{
+    fcache_reader               done;
+    void*                       aux_data;
+    struct fcache_load_waiter*  next;
+} fcache_load_waiter;
+
+//a get_or_load running its loader, on the shard list until its value is stored
+typedef struct fcache_inflight{
+    void*                   key; //the loading caller key
+    pthread_cond_t          cond; //waits on the shard lock
+    bool_t                  finished;
+    void*                   result; //copy for the blocked callers, 0 when the load failed
+    size_fx                 refs; //loading caller and blocked callers
+    free_fx*                cb_free;
+    fcache_load_waiter*     waiters; //async callers
+    struct fcache_inflight* next;
+} fcache_inflight;
+
+typedef struct fcache_shard{
+    pthread_mutex_t     lock;
+    flexcache*          cache;
+    fcache_inflight*    loads;
+    size_fx             slice; //fair share of maxmemory
+    size_fx             used;  //shard usage already added to the global counter
+} fcache_shard;
+
+//keep each shard (and its lock) on its own cache lines
+typedef union fcache_shard_slot{
+    fcache_shard        shard;
+    char                pad[(sizeof(fcache_shard) + FX_CACHE_LINE - 1) / FX_CACHE_LINE * FX_CACHE_LINE];
+} fcache_shard_slot;
+
+struct fcache_sharded{
+    size_fx             n_shards;
+    size_fx             maxmemory;
+    size_fx             refresh_ahead; //percent of the ttl, 0 without stale while revalidate
+    data_aux_funcs_t    funcs;
+    fcache_shard_slot*  shards;
+    epoch_fx*           epoch; //lock free reads only, 0 otherwise
+
+    pthread_t           maint_thread;
+    bool_t              maint_running;
+    _Atomic int         maint_stop;
+    size_fx             maint_interval_ms;
+    size_fx             maint_budget_us;
+    free_fx             maint_free;
+
+    char                pad[FX_CACHE_LINE];
+    _Atomic size_fx     used; //sum of fcache_shard.used
+};
+
+static void fcache_sharded_reclaim(void* aux_data, void* ptr, free_fx* free){
+
+    fcache_sharded* cache = aux_data;
+    epoch_retire(cache->epoch, ptr, *free);
+}
+
+fcache_sharded* fcache_sharded_init(size_fx n_shards, enum EVICTION_POLICY evic_pol, data_aux_funcs_t funcs,
+                                    size_fx maxmemory, init_option* options){
+
+    if(n_shards == 0 || !funcs.hash)
+        return 0;
+
+    bool_t concurrent = options && options->concurrent_reads;
+    if(concurrent && options->index != INDEX_HASH)
+        return 0;
+
+    const allocator_fx* allocator = funcs.allocator;
+
+    fcache_sharded* cache = (*allocator->alloc)(sizeof(fcache_sharded));
+    if(!cache)
+        return 0;
+
+    //shards count once they are whole, a failure frees what was built through fcache_sharded_free
+    cache->n_shards = 0;
+    cache->maxmemory = maxmemory;
+    cache->refresh_ahead = options ? options->refresh_ahead : 0;
+    cache->funcs = funcs;
+    cache->epoch = 0;
+    cache->maint_running = 0;
+    atomic_init(&cache->maint_stop, 0);
+    atomic_init(&cache->used, 0);
+
+    cache->shards = (*allocator->alloc)(n_shards * sizeof(fcache_shard_slot));
+    if(!cache->shards)
+        goto fail;
+
+    if(concurrent && !(cache->epoch = epoch_new(allocator)))
+        goto fail;
+
+    for(size_fx i = 0; i < n_shards; i++){
+        fcache_shard* shard = &cache->shards[i].shard;
+
+        shard->slice = maxmemory / n_shards;
+        shard->used = 0;
+        shard->loads = 0;
+        shard->cache = fcache_new(allocator);
+
+        if(!shard->cache || !fcache_init(shard->cache, evic_pol, funcs, shard->slice, options)){
+            if(shard->cache)
+                (*allocator->free)(shard->cache);
+            goto fail;
+        }
+        if(cache->epoch)
+            fcache_set_reclaim(shard->cache, fcache_sharded_reclaim, cache);
+        pthread_mutex_init(&shard->lock, 0);
+        cache->n_shards = i + 1;
+    }
+
+    return cache;
+
+fail:
+    fcache_sharded_free(cache, 0);
+    return 0;
+}
+
+void fcache_sharded_free(fcache_sharded* cache, free_fx* cb_free){
+
+    const allocator_fx* allocator = cache->funcs.allocator;
+
+    fcache_sharded_stop_maintenance(cache);
+
+    for(size_fx i = 0; i < cache->n_shards; i++){
+        fcache_shard* shard = &cache->shards[i].shard;
+        fcache_free(shard->cache, cb_free);
+        pthread_mutex_destroy(&shard->lock);
+    }
+
+    //what the shards retired is still waiting here
+    if(cache->epoch)
+        epoch_free(cache->epoch);
+
+    if(cache->shards)
+        (*allocator->free)(cache->shards);
+    (*allocator->free)(cache);
+}
+
+static FX_INLINE size_fx fcache_shard_index(fcache_sharded* cache, const void* key){
+
+    //fibonacci mix, the shard index must not correlate with the bits used inside the shard index
+    size_fx hash = (*cache->funcs.hash)(key) * 0x9E3779B97F4A7C15UL;
+    return (hash >> 32) % cache->n_shards;
+}
+
+static FX_INLINE fcache_shard* fcache_shard_of(fcache_sharded* cache, const void* key){
+    return &cache->shards[fcache_shard_index(cache, key)].shard;
+}
+
+static FX_INLINE void fcache_shard_lock(fcache_shard* shard){
+    pthread_mutex_lock(&shard->lock);
+}
+
+static FX_INLINE void fcache_shard_unlock(fcache_shard* shard){
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Before a write: the shard may use its slice, or more while the other shards leave room.
+static void fcache_shard_budget(fcache_sharded* cache, fcache_shard* shard){
+
+    size_fx global_used = atomic_load_explicit(&cache->used, memory_order_relaxed);
+    size_fx global_free = global_used < cache->maxmemory ? cache->maxmemory - global_used : 0;
+    size_fx limit = shard->used + global_free;
+
+    if(limit < shard->slice)
+        limit = shard->slice;
+
+    fcache_set_maxmemory(shard->cache, limit);
+}
+
+// After every call that can change the shard usage, writes and also locked reads (a read expires
+// keys past their ttl, an L1 miss promotes from L2): publish the delta to the global counter.
+static void fcache_shard_account(fcache_sharded* cache, fcache_shard* shard){
+
+    size_fx used = fcache_used_memory(shard->cache);
+    if(used == shard->used)
+        return;
+
+    if(used > shard->used)
+        atomic_fetch_add_explicit(&cache->used, used - shard->used, memory_order_relaxed);
+    else
+        atomic_fetch_sub_explicit(&cache->used, shard->used - used, memory_order_relaxed);
+
+    shard->used = used;
+}
+
+// A lock free read found key past its ttl: the writer side unlinks it, the node is retired through
+// reclaim when its value is reported.
+static void fcache_shard_expire(fcache_sharded* cache, fcache_shard* shard, void* key){
+
+    fcache_shard_lock(shard);
+    fcache_key_exists(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+}
+
+void fcache_sharded_set_free(fcache_sharded* cache, void* key, const void* value, set_option* options, free_fx* cb_free){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    fcache_shard_lock(shard);
+    fcache_shard_budget(cache, shard);
+    fcache_set_free(shard->cache, key, value, options, cb_free);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+}
+
+stack_fx* fcache_sharded_set(fcache_sharded* cache, void* key, const void* value, set_option* options){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    fcache_shard_lock(shard);
+    fcache_shard_budget(cache, shard);
+    stack_fx* removed = fcache_set(shard->cache, key, value, options);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+
+    return removed;
+}
+
+static fcache_inflight* fcache_inflight_find(fcache_sharded* cache, fcache_shard* shard, const void* key){
+
+    fcache_inflight* load = shard->loads;
+    while(load && (*cache->funcs.compare)(load->key, key) != 0)
+        load = load->next;
+
+    return load;
+}
+
+static fcache_inflight* fcache_inflight_new(fcache_sharded* cache, fcache_shard* shard, void* key, free_fx* cb_free){
+
+    fcache_inflight* load = (*cache->funcs.allocator->alloc)(sizeof(fcache_inflight));
+    if(!load)
+        return 0;
+
+    load->key = key;
+    pthread_cond_init(&load->cond, 0);
+    load->finished = 0;
+    load->result = 0;
+    load->refs = 1;
+    load->cb_free = cb_free;
+    load->waiters = 0;
+    load->next = shard->loads;
+    shard->loads = load;
+
+    return load;
+}
+
+//the last caller out frees the load
+static void fcache_inflight_unref(fcache_sharded* cache, fcache_inflight* load){
+
+    if(--load->refs > 0)
+        return;
+
+    if(load->result && load->cb_free)
+        (*load->cb_free)(load->result);
+    pthread_cond_destroy(&load->cond);
+    (*cache->funcs.allocator->free)(load);
+}
+
+static void fcache_inflight_unlink(fcache_shard* shard, fcache_inflight* load){
+
+    fcache_inflight** iter = &shard->loads;
+    while(*iter != load)
+        iter = &(*iter)->next;
+    *iter = load->next;
+}
+
+// Runs the loader without the shard lock (held on entry and on return), stores the value and hands
+// it to every waiting caller. Returns the stored value, valid while the lock is held.
+static const void* fcache_load_lead(fcache_sharded* cache, fcache_shard* shard, fcache_inflight* load,
+                                    fcache_loader loader, void* ctx){
+
+    fcache_shard_unlock(shard);
+    set_option options = {0};
+    void* value = loader(load->key, ctx, &options);
+    fcache_shard_lock(shard);
+
+    const void* stored = 0;
+    if(value){
+        fcache_shard_budget(cache, shard);
+        fcache_set_free(shard->cache, load->key, value, &options, load->cb_free);
+        fcache_shard_account(cache, shard);
+
+        //an inline copy, or not stored at all: value is still ours... a peek, the store is no read
+        stored = fcache_peek(shard->cache, load->key);
+        if(stored != value && load->cb_free)
+            (*load->cb_free)(value);
+    }
+
+    if(stored && load->refs > 1)
+        load->result = (*cache->funcs.copy_func)((void*)stored);
+
+    for(fcache_load_waiter* waiter = load->waiters; waiter; ){
+        fcache_load_waiter* next = waiter->next;
+        waiter->done(stored, waiter->aux_data);
+        (*cache->funcs.allocator->free)(waiter);
+        waiter = next;
+    }
+    load->waiters = 0;
+
+    load->finished = 1;
+    fcache_inflight_unlink(shard, load);
+    pthread_cond_broadcast(&load->cond);
+
+    return stored;
+}
+
+//hit with less than refresh_ahead percent of its ttl left
+static FX_INLINE bool_t fcache_refresh_due(fcache_sharded* cache, fcache_shard* shard, void* key){
+
+    if(cache->refresh_ahead == 0)
+        return 0;
+
+    long total = 0;
+    long left = fcache_ttl_ms(shard->cache, key, &total);
+    return left >= 0 && total > 0 && (size_fx)left * 100 < (size_fx)total * cache->refresh_ahead;
+}
+
+void* fcache_sharded_get_or_load(fcache_sharded* cache, void* key, fcache_loader loader, void* ctx, free_fx* cb_free){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+    const copy_func* copy = cache->funcs.copy_func;
+
+    fcache_shard_lock(shard);
+    const void* data = fcache_get_ptr(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_inflight* load = fcache_inflight_find(cache, shard, key);
+
+    //a hit, or a refresh already running: the current value
+    if(data && (load || !fcache_refresh_due(cache, shard, key))){
+        void* value = (*copy)((void*)data);
+        fcache_shard_unlock(shard);
+        return value;
+    }
+
+    void* value = 0;
+    if(load){
+        load->refs++;
+        while(!load->finished)
+            pthread_cond_wait(&load->cond, &shard->lock);
+        if(load->result)
+            value = (*copy)(load->result);
+        fcache_inflight_unref(cache, load);
+    } else if((load = fcache_inflight_new(cache, shard, key, cb_free))){
+        const void* stored = fcache_load_lead(cache, shard, load, loader, ctx);
+        if(!stored) //a failed refresh keeps the current value
+            stored = fcache_peek(shard->cache, key);
+        fcache_shard_account(cache, shard);
+        if(stored)
+            value = (*copy)((void*)stored);
+        fcache_inflight_unref(cache, load);
+    } else if(data){
+        value = (*copy)((void*)data);
+    }
+    fcache_shard_unlock(shard);
+
+    return value;
+}
+
+bool_t fcache_sharded_get_or_load_async(fcache_sharded* cache, void* key, fcache_loader loader, void* ctx,
+                                        free_fx* cb_free, fcache_reader done, void* aux_data){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    fcache_shard_lock(shard);
+    const void* data = fcache_get_ptr(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_inflight* load = fcache_inflight_find(cache, shard, key);
+
+    if(data && (load || !fcache_refresh_due(cache, shard, key))){
+        done(data, aux_data);
+        fcache_shard_unlock(shard);
+        return 1;
+    }
+
+    if(load){
+        fcache_load_waiter* waiter = (*cache->funcs.allocator->alloc)(sizeof(fcache_load_waiter));
+        if(waiter){
+            waiter->done = done;
+            waiter->aux_data = aux_data;
+            waiter->next = load->waiters;
+            load->waiters = waiter;
+        } else{
+            done(0, aux_data);
+        }
+        fcache_shard_unlock(shard);
+        return waiter == 0;
+    }
+
+    const void* stored = data;
+    if((load = fcache_inflight_new(cache, shard, key, cb_free))){
+        stored = fcache_load_lead(cache, shard, load, loader, ctx);
+        if(!stored)
+            stored = fcache_peek(shard->cache, key);
+        fcache_shard_account(cache, shard);
+        fcache_inflight_unref(cache, load);
+    }
+    done(stored, aux_data);
+    fcache_shard_unlock(shard);
+
+    return 1;
+}
+
+bool_t fcache_sharded_key_exists(fcache_sharded* cache, void* key){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    if(cache->epoch){
+        bool_t expired;
+        epoch_enter(cache->epoch);
+        bool_t exists = fcache_get_ptr_concurrent(shard->cache, key, &expired) != 0;
+        epoch_exit(cache->epoch);
+        if(expired)
+            fcache_shard_expire(cache, shard, key);
+        return exists;
+    }
+
+    fcache_shard_lock(shard);
+    bool_t exists = fcache_key_exists(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+
+    return exists;
+}
+
+void* fcache_sharded_get_copy(fcache_sharded* cache, void* key){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    if(cache->epoch){
+        bool_t expired;
+        epoch_enter(cache->epoch);
+        const void* data = fcache_get_ptr_concurrent(shard->cache, key, &expired);
+        void* copy = data ? (*cache->funcs.copy_func)((void*)data) : 0;
+        epoch_exit(cache->epoch);
+        if(expired)
+            fcache_shard_expire(cache, shard, key);
+        return copy;
+    }
+
+    fcache_shard_lock(shard);
+    void* data = fcache_get_copy(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+
+    return data;
+}
+
+bool_t fcache_sharded_read(fcache_sharded* cache, void* key, fcache_reader reader, void* aux_data){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    if(cache->epoch){
+        bool_t expired;
+        epoch_enter(cache->epoch);
+        const void* data = fcache_get_ptr_concurrent(shard->cache, key, &expired);
+        if(data)
+            reader(data, aux_data);
+        epoch_exit(cache->epoch);
+        if(expired)
+            fcache_shard_expire(cache, shard, key);
+        return data != 0;
+    }
+
+    fcache_shard_lock(shard);
+    const void* data = fcache_get_ptr(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    if(data)
+        reader(data, aux_data);
+    fcache_shard_unlock(shard);
+
+    return data != 0;
+}
+
+fcache_handle* fcache_sharded_acquire(fcache_sharded* cache, void* key){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    fcache_shard_lock(shard);
+    fcache_handle* handle = fcache_acquire(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+
+    return handle;
+}
+
+void fcache_sharded_release(fcache_sharded* cache, void* key, fcache_handle* handle, free_fx* cb_free){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    fcache_shard_lock(shard);
+    fcache_release(shard->cache, handle, cb_free);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+}
+
+void* fcache_sharded_remove(fcache_sharded* cache, void* key){
+
+    fcache_shard* shard = fcache_shard_of(cache, key);
+
+    fcache_shard_lock(shard);
+    void* data = fcache_remove(shard->cache, key);
+    fcache_shard_account(cache, shard);
+    fcache_shard_unlock(shard);
+
+    return data;
+}
+
+void fcache_sharded_retire(fcache_sharded* cache, void* value, free_fx* cb_free){
+
+    if(cache->epoch)
+        epoch_retire(cache->epoch, value, *cb_free);
+    else
+        (*cb_free)(value);
+}
+
+static void fcache_stats_accumulate(fcache_stats_t* total, const fcache_stats_t* shard){
+
+    total->hits += shard->hits;
+    total->misses += shard->misses;
+    total->sets += shard->sets;
+    total->nx_rejects += shard->nx_rejects;
+    total->xx_rejects += shard->xx_rejects;
+    total->evicted_memory += shard->evicted_memory;
+    total->evicted_ttl += shard->evicted_ttl;
+    total->bytes_evicted += shard->bytes_evicted;
+    total->evict_ns += shard->evict_ns;
+    total->l2_hits += shard->l2_hits;
+    total->l2_demoted += shard->l2_demoted;
+    total->repl_dropped += shard->repl_dropped;
+    total->used_memory += shard->used_memory;
+    total->overhead_memory += shard->overhead_memory;
+#ifdef FCACHE_STATS_HISTOGRAM
+    for(size_fx i = 0; i < FCACHE_STATS_HIST; i++){
+        total->get_ns[i] += shard->get_ns[i];
+        total->set_ns[i] += shard->set_ns[i];
+    }
+#endif
+}
+
+//counters are atomics... no shard lock
+void fcache_sharded_stats(fcache_sharded* cache, fcache_stats_t* total, fcache_stats_t* per_shard){
+
+    zero_mem_fx(total, sizeof(fcache_stats_t));
+
+    for(size_fx i = 0; i < cache->n_shards; i++){
+        fcache_stats_t shard;
+        fcache_stats(cache->shards[i].shard.cache, &shard);
+        fcache_stats_accumulate(total, &shard);
+        if(per_shard)
+            per_shard[i] = shard;
+    }
+}
+
+bool_t fcache_sharded_tick(fcache_sharded* cache, size_fx budget_us, free_fx* cb_free){
+
+    bool_t done = 1;
+
+    for(size_fx i = 0; i < cache->n_shards; i++){
+        fcache_shard* shard = &cache->shards[i].shard;
+
+        fcache_shard_lock(shard);
+        fcache_shard_budget(cache, shard);
+        done &= fcache_tick(shard->cache, budget_us, cb_free);
+        fcache_shard_account(cache, shard);
+        fcache_shard_unlock(shard);
+    }
+
+    return done;
+}
+
+static void* fcache_sharded_maintenance(void* arg){
+
+    fcache_sharded* cache = arg;
+    free_fx* cb_free = cache->maint_free ? &cache->maint_free : 0;
+
+    while(!atomic_load_explicit(&cache->maint_stop, memory_order_relaxed)){
+        if(fcache_sharded_tick(cache, cache->maint_budget_us, cb_free)){
+            struct timespec interval = {(time_t)(cache->maint_interval_ms / 1000),
+                                        (long)(cache->maint_interval_ms % 1000) * 1000000L};
+            nanosleep(&interval, 0);
+        }
+    }
+
+    return 0;
+}
+
+int fcache_sharded_start_maintenance(fcache_sharded* cache, size_fx interval_ms, size_fx budget_us, free_fx cb_free){
+
+    if(cache->maint_running)
+        return 0;
+
+    cache->maint_interval_ms = interval_ms;
+    cache->maint_budget_us = budget_us;
+    cache->maint_free = cb_free;
+    atomic_store(&cache->maint_stop, 0);
+
+    if(pthread_create(&cache->maint_thread, 0, fcache_sharded_maintenance, cache) != 0)
+        return 0;
+
+    cache->maint_running = 1;
+    return 1;
+}
+
+void fcache_sharded_stop_maintenance(fcache_sharded* cache){
+
+    if(!cache->maint_running)
+        return;
+
+    atomic_store(&cache->maint_stop, 1);
+    pthread_join(cache->maint_thread, 0);
+    cache->maint_running = 0;
+}
+
+#define FCACHE_SHARD_PATH_MAX 4096
+
+static int fcache_shard_path(fcache_sharded* cache, const char* path, size_fx shard, char* out){
+    return snprintf(out, FCACHE_SHARD_PATH_MAX, "%s.%lu-%lu", path, shard, cache->n_shards) < FCACHE_SHARD_PATH_MAX;
+}
+
+int fcache_sharded_snapshot(fcache_sharded* cache, const char* path){
+
+    char shard_path[FCACHE_SHARD_PATH_MAX];
+    int ok = 1;
+
+    for(size_fx i = 0; i < cache->n_shards && ok; i++){
+        fcache_shard* shard = &cache->shards[i].shard;
+        if(!fcache_shard_path(cache, path, i, shard_path))
+            return 0;
+
+        fcache_shard_lock(shard);
+        ok = fcache_snapshot(shard->cache, shard_path);
+        fcache_shard_unlock(shard);
+    }
+
+    return ok;
+}
+
+typedef struct fcache_shard_loader{
+    fcache_sharded*     cache;
+    fcache_shard*       shard;
+    free_fx*            cb_free;
+    char                path[FCACHE_SHARD_PATH_MAX];
+    int                 ok;
+} fcache_shard_loader;
+
+static void* fcache_shard_load(void* arg){
+
+    fcache_shard_loader* loader = arg;
+    fcache_shard* shard = loader->shard;
+
+    fcache_shard_lock(shard);
+    fcache_shard_budget(loader->cache, shard);
+    loader->ok = fcache_load(shard->cache, loader->path, loader->cb_free);
+    fcache_shard_account(loader->cache, shard);
+    fcache_shard_unlock(shard);
+
+    return 0;
+}
+
+int fcache_sharded_load(fcache_sharded* cache, const char* path, free_fx* cb_free){
+
+    const allocator_fx* allocator = cache->funcs.allocator;
+    fcache_shard_loader* loaders = (*allocator->alloc)(cache->n_shards * sizeof(fcache_shard_loader));
+    pthread_t* threads = (*allocator->alloc)(cache->n_shards * sizeof(pthread_t));
+    int ok = loaders && threads;
+
+    for(size_fx i = 0; ok && i < cache->n_shards; i++){
+        loaders[i].cache = cache;
+        loaders[i].shard = &cache->shards[i].shard;
+        loaders[i].cb_free = cb_free;
+        loaders[i].ok = 0;
+        ok = fcache_shard_path(cache, path, i, loaders[i].path);
+    }
+
+    size_fx started = 0;
+    for(; ok && started < cache->n_shards; started++){
+        if(pthread_create(&threads[started], 0, fcache_shard_load, &loaders[started]) != 0){
+            ok = 0;
+            break;
+        }
+    }
+
+    for(size_fx i = 0; i < started; i++){
+        pthread_join(threads[i], 0);
+        ok = ok && loaders[i].ok;
+    }
+
+    if(loaders)
+        (*allocator->free)(loaders);
+    if(threads)
+        (*allocator->free)(threads);
+    return ok;
+}
+
+size_fx fcache_sharded_used_memory(fcache_sharded* cache){
+    return atomic_load_explicit(&cache->used, memory_order_relaxed);
+}
+
+size_fx fcache_sharded_n_shards(fcache_sharded* cache){
+    return cache->n_shards;
+}
+
+// One chunk of a batch grouped by shard: order[] holds the key positions sorted by shard
+// (counting sort), first[s]..first[s + 1] is the range of shard s.
+typedef struct fcache_batch{
+    size_fx         n;
+    unsigned short  order[FCACHE_SHARDED_BATCH];
+    void*           keys[FCACHE_SHARDED_BATCH];
+    const void*     values[FCACHE_SHARDED_BATCH];
+} fcache_batch;
+
+static void fcache_batch_group(fcache_sharded* cache, fcache_batch* batch, void** keys, size_fx n, size_fx* first){
+
+    size_fx shard_of[FCACHE_SHARDED_BATCH];
+
+    for(size_fx s = 0; s <= cache->n_shards; s++)
+        first[s] = 0;
+
+    for(size_fx i = 0; i < n; i++){
+        shard_of[i] = fcache_shard_index(cache, keys[i]);
+        first[shard_of[i] + 1]++;
+    }
+
+    for(size_fx s = 0; s < cache->n_shards; s++)
+        first[s + 1] += first[s];
+
+    //first[s] is used as the insert cursor of shard s, then shifted back to the range start
+    for(size_fx i = 0; i < n; i++){
+        size_fx pos = first[shard_of[i]]++;
+        batch->order[pos] = (unsigned short)i;
+        batch->keys[pos] = keys[i];
+    }
+
+    for(size_fx s = cache->n_shards; s > 0; s--)
+        first[s] = first[s - 1];
+    first[0] = 0;
+
+    batch->n = n;
+}
+
+// shard offsets of a chunk... on the stack when the shard count is small
+#define FCACHE_BATCH_STACK_SHARDS 64
+
+static size_fx* fcache_batch_offsets(fcache_sharded* cache, size_fx* local){
+
+    if(cache->n_shards < FCACHE_BATCH_STACK_SHARDS)
+        return local;
+
+    return (*cache->funcs.allocator->alloc)((cache->n_shards + 1) * sizeof(size_fx));
+}
+
+static void fcache_batch_offsets_free(fcache_sharded* cache, size_fx* first, size_fx* local){
+
+    if(first != local)
+        (*cache->funcs.allocator->free)(first);
+}
+
+// lock free batch: nothing to group, one epoch section for all the keys
+static size_fx fcache_sharded_mget_concurrent(fcache_sharded* cache, void** keys, size_fx n, void** values){
+
+    const copy_func* copy = cache->funcs.copy_func;
+    size_fx found = 0;
+
+    size_fx expired_keys = 0;
+
+    epoch_enter(cache->epoch);
+    for(size_fx i = 0; i < n; i++){
+        bool_t expired;
+        const void* data = fcache_get_ptr_concurrent(fcache_shard_of(cache, keys[i])->cache, keys[i], &expired);
+        values[i] = data ? (*copy)((void*)data) : 0;
+        found += data != 0;
+        expired_keys += expired;
+    }
+    epoch_exit(cache->epoch);
+
+    //unlink outside the read section... the misses hold the expired keys, a plain miss costs a lookup
+    for(size_fx i = 0; expired_keys && i < n; i++)
+        if(!values[i])
+            fcache_shard_expire(cache, fcache_shard_of(cache, keys[i]), keys[i]);
+
+    return found;
+}
+
+size_fx fcache_sharded_mget_copy(fcache_sharded* cache, void** keys, size_fx n, void** values){
+
+    if(cache->epoch)
+        return fcache_sharded_mget_concurrent(cache, keys, n, values);
+
+    const copy_func* copy = cache->funcs.copy_func;
+    size_fx local[FCACHE_BATCH_STACK_SHARDS + 1];
+    size_fx* first = fcache_batch_offsets(cache, local);
+    if(!first)
+        return 0;
+
+    fcache_batch batch;
+    size_fx found = 0;
+
+    for(size_fx start = 0; start < n; start += FCACHE_SHARDED_BATCH){
+        size_fx count = n - start < FCACHE_SHARDED_BATCH ? n - start : FCACHE_SHARDED_BATCH;
+        fcache_batch_group(cache, &batch, keys + start, count, first);
+
+        for(size_fx s = 0; s < cache->n_shards; s++){
+            size_fx m = first[s + 1] - first[s];
+            if(m == 0)
+                continue;
+
+            fcache_shard* shard = &cache->shards[s].shard;
+            const void** shard_values = batch.values + first[s];
+
+            fcache_shard_lock(shard);
+            found += fcache_mget(shard->cache, batch.keys + first[s], m, shard_values);
+            fcache_shard_account(cache, shard);
+            for(size_fx i = 0; i < m; i++){
+                size_fx pos = start + batch.order[first[s] + i];
+                values[pos] = shard_values[i] ? (*copy)((void*)shard_values[i]) : 0;
+            }
+            fcache_shard_unlock(shard);
+        }
+    }
+
+    fcache_batch_offsets_free(cache, first, local);
+    return found;
+}
+
+stack_fx* fcache_sharded_mset(fcache_sharded* cache, void** keys, const void** values, size_fx n, set_option* options){
+
+    size_fx local[FCACHE_BATCH_STACK_SHARDS + 1];
+    size_fx* first = fcache_batch_offsets(cache, local);
+    if(!first)
+        return 0;
+
+    fcache_batch batch;
+    stack_fx* removed = 0;
+
+    for(size_fx start = 0; start < n; start += FCACHE_SHARDED_BATCH){
+        size_fx count = n - start < FCACHE_SHARDED_BATCH ? n - start : FCACHE_SHARDED_BATCH;
+        fcache_batch_group(cache, &batch, keys + start, count, first);
+
+        for(size_fx i = 0; i < count; i++)
+            batch.values[i] = values[start + batch.order[i]];
+
+        for(size_fx s = 0; s < cache->n_shards; s++){
+            size_fx m = first[s + 1] - first[s];
+            if(m == 0)
+                continue;
+
+            fcache_shard* shard = &cache->shards[s].shard;
+
+            fcache_shard_lock(shard);
+            fcache_shard_budget(cache, shard);
+            stack_fx* shard_removed = fcache_mset(shard->cache, batch.keys + first[s], batch.values + first[s], m, options);
+            fcache_shard_account(cache, shard);
+            fcache_shard_unlock(shard);
+
+            if(!shard_removed)
+                continue;
+            if(!removed){
+                removed = shard_removed;
+                continue;
+            }
+            stack_concat(removed, shard_removed);
+            stack_free(shard_removed);
+        }
+    }
+
+    fcache_batch_offsets_free(cache, first, local);
+    return removed;
+}
+
+stack_fx* fcache_sharded_mdel(fcache_sharded* cache, void** keys, size_fx n){
+
+    size_fx local[FCACHE_BATCH_STACK_SHARDS + 1];
+    size_fx* first = fcache_batch_offsets(cache, local);
+    if(!first)
+        return 0;
+
+    fcache_batch batch;
+    stack_fx* removed = 0;
+
+    for(size_fx start = 0; start < n; start += FCACHE_SHARDED_BATCH){
+        size_fx count = n - start < FCACHE_SHARDED_BATCH ? n - start : FCACHE_SHARDED_BATCH;
+        fcache_batch_group(cache, &batch, keys + start, count, first);
+
+        for(size_fx s = 0; s < cache->n_shards; s++){
+            size_fx m = first[s + 1] - first[s];
+            if(m == 0)
+                continue;
+
+            fcache_shard* shard = &cache->shards[s].shard;
+
+            fcache_shard_lock(shard);
+            stack_fx* shard_removed = fcache_mdel(shard->cache, batch.keys + first[s], m);
+            fcache_shard_account(cache, shard);
+            fcache_shard_unlock(shard);
+
+            if(!shard_removed)
+                continue;
+            if(!removed){
+                removed = shard_removed;
+                continue;
+            }
+            stack_concat(removed, shard_removed);
+            stack_free(shard_removed);
+        }
+    }
+
+    fcache_batch_offsets_free(cache, first, local);
+    return removed;
+}
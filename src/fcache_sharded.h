@@ -0,0 +1,105 @@
+#ifndef __FCACHE_SHARDED_H__
+#define __FCACHE_SHARDED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexcache.h"
+
+// Thread safe front end: keys are hashed (funcs.hash is required) to independent flexcache
+// shards, each one with its own lock, eviction list, key index and memory budget.
+// Shards start with maxmemory / n_shards (their slice), a shard can grow over its slice while the
+// global budget still has room. The bound is soft: nothing takes back what a shard grew to and every
+// shard can fill its slice, so fcache_sharded_used_memory stays under the sum over the shards of
+// max(most it grew to, slice)... up to twice maxmemory, plus what writers on several shards take
+// at once from the same free room.
+// With init_option.concurrent_reads (INDEX_HASH) get_copy, read, key_exists and mget_copy take
+// no lock: writers still lock their shard, and nodes, index tables and values freed by the cache
+// wait for an epoch grace period (epoch_fx.h) before going back to the allocator.
+typedef struct fcache_sharded fcache_sharded;
+
+fcache_sharded* fcache_sharded_init(size_fx n_shards, enum EVICTION_POLICY evic_pol, data_aux_funcs_t funcs,
+                                    size_fx maxmemory, init_option* options);
+
+void fcache_sharded_free(fcache_sharded* cache, free_fx* cb_free);
+
+void fcache_sharded_set_free(fcache_sharded* cache, void* key, const void* value, set_option* options, free_fx* cb_free);
+
+stack_fx* fcache_sharded_set(fcache_sharded* cache, void* key, const void* value, set_option* options);
+
+bool_t fcache_sharded_key_exists(fcache_sharded* cache, void* key);
+
+void* fcache_sharded_get_copy(fcache_sharded* cache, void* key);
+
+// runs reader on the value while the shard lock (or the read epoch) is held... pointer is not valid after it returns
+typedef void (*fcache_reader)(const void* value, void* aux_data);
+
+bool_t fcache_sharded_read(fcache_sharded* cache, void* key, fcache_reader reader, void* aux_data);
+
+// fcache_acquire under the shard lock, also with concurrent_reads... release with the key acquired,
+// from any thread, before fcache_sharded_free
+fcache_handle* fcache_sharded_acquire(fcache_sharded* cache, void* key);
+
+void fcache_sharded_release(fcache_sharded* cache, void* key, fcache_handle* handle, free_fx* cb_free);
+
+void* fcache_sharded_remove(fcache_sharded* cache, void* key);
+
+// Get or load with one load per key in flight: the first caller missing runs loader without the
+// shard lock and stores its value (like fcache_sharded_set_free, the key must live as long as the
+// entry), the callers missing meanwhile wait for that result instead of loading too.
+// With init_option.refresh_ahead a hit close to its expiry reloads the key (stale while revalidate):
+// the caller hitting first runs the loader, the others keep getting the current value.
+// loader gets a zeroed options for the ttl and returns the value to store, 0 when it failed...
+// cb_free gets the values the store evicts. Returns a copy_func copy, 0 when the load failed.
+typedef void* (*fcache_loader)(void* key, void* ctx, set_option* options);
+
+void* fcache_sharded_get_or_load(fcache_sharded* cache, void* key, fcache_loader loader, void* ctx, free_fx* cb_free);
+
+// Async form: done gets the value (fcache_reader contract, 0 when the load failed) right away on a hit
+// or when this caller loads, else later from the thread running the load... returns 1 when done already ran.
+bool_t fcache_sharded_get_or_load_async(fcache_sharded* cache, void* key, fcache_loader loader, void* ctx,
+                                        free_fx* cb_free, fcache_reader done, void* aux_data);
+
+// Batch versions: keys are grouped by shard and every shard lock is taken once
+// per FCACHE_SHARDED_BATCH keys... same contracts as fcache_mget / fcache_mset / fcache_mdel.
+// fcache_sharded_mget copies the values (copy_func), the shard lock is released on return.
+#define FCACHE_SHARDED_BATCH 256
+
+size_fx fcache_sharded_mget_copy(fcache_sharded* cache, void** keys, size_fx n, void** values);
+
+stack_fx* fcache_sharded_mset(fcache_sharded* cache, void** keys, const void** values, size_fx n, set_option* options);
+
+stack_fx* fcache_sharded_mdel(fcache_sharded* cache, void** keys, size_fx n);
+
+// Values handed back by set, remove, mset and mdel may still be read by lock free readers:
+// free them through here (immediate free without concurrent_reads).
+void fcache_sharded_retire(fcache_sharded* cache, void* value, free_fx* cb_free);
+
+// totals over the shards, per_shard (OPTIONAL, n_shards entries) gets each shard counters
+void fcache_sharded_stats(fcache_sharded* cache, fcache_stats_t* total, fcache_stats_t* per_shard);
+
+// deferred_maintenance: fcache_tick on every shard (budget_us each) under the shard lock,
+// returns 1 when every shard caught up
+bool_t fcache_sharded_tick(fcache_sharded* cache, size_fx budget_us, free_fx* cb_free);
+
+// background thread running fcache_sharded_tick every interval_ms (right away while behind)
+int fcache_sharded_start_maintenance(fcache_sharded* cache, size_fx interval_ms, size_fx budget_us, free_fx cb_free);
+
+void fcache_sharded_stop_maintenance(fcache_sharded* cache);
+
+// One snapshot file per shard, "<path>.<shard>-<n_shards>"... fcache_sharded_load needs the same
+// shard count (keys must hash to the same shard) and loads every shard on its own thread.
+int fcache_sharded_snapshot(fcache_sharded* cache, const char* path);
+
+int fcache_sharded_load(fcache_sharded* cache, const char* path, free_fx* cb_free);
+
+size_fx fcache_sharded_used_memory(fcache_sharded* cache);
+
+size_fx fcache_sharded_n_shards(fcache_sharded* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
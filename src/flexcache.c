@@ -1,235 +1,2321 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "flexcache.h"
 #include "flexnode.h"
 #include "allocator.h"
 #include "fcache_config.h"
 #include "wrap_dllist.h" //wrapper for intrusive double linked list
 #include "wrap_map.h" //wrapper for intrusive RBtrees
+#include "evict_pool.h"
+#include "lfu_fx.h"
+#include "timer_wheel.h"
+#include "stats_fx.h"
+#include "cm_sketch.h"
+#include "fvalue_fx.h"
+#include "l2_fx.h"
+#include "repl_fx.h"
 
 
 //fazer duas lists.... uma volatile e outra allkeys
 //allkeys eh FIFO,...touch faz nada
 struct flexcache{
     dllist_fx       evic_list;
-    dllist_touch*   touch;
+    dllist_touch    touch; //0 for the sampled policies, reads do not reorder evic_list
     map_fx          kv_map;
     fcache_config   config;
+    twheel_fx       ttl_wheel; //volatile nodes by expiry time
+
+    enum EVICTION_POLICY policy;
+    evict_pool_fx   pool;
+    size_fx         evict_samples;
+    size_fx         rand_state;
+    lfu_config      lfu;
+    size_fx         inline_max;
+    size_fx         overhead_memory; //part of the used memory that is not value bytes
+    size_fx         xfetch_delta_ms; //0 without early expiry on reads
+    size_fx         search_threads; //fcache_find_* workers, <= 1 searches in the calling thread
+
+    reclaim_fx      reclaim; //0: nodes and values are freed as soon as they leave the cache
+    void*           reclaim_aux;
+
+    stats_fx        stats;
+
+    bool_t          deferred; //sets only admit, fcache_tick expires, evicts and frees
+    dllist_fx       pending; //out of the cache, waiting for fcache_tick to free them
+
+    dllist_fx       window; //WTINYLFU admission window, LRU order
+    size_fx         window_memory;
+    size_fx         window_pct;
+    cm_sketch_fx    sketch; //WTINYLFU access frequencies, by key hash
+
+    flexnode*       protected_head; //SLRU: evic_list is [probation | protected], 0 when protected is empty
+    size_fx         protected_memory;
+    size_fx         protected_pct;
+
+    l2_fx*          l2; //OPTIONAL disk tier, memory evictions are demoted to it
+    free_fx*        l2_free; //values evicted by a promotion
+    repl_fx*        repl; //OPTIONAL mutation log for replicas
 
+    void*           snap_map; //loaded snapshot, keys too big to be inline point into it
+    size_fx         snap_len;
 };
 
-void fcache_init(flexcache* cache, enum EVICTION_POLICY evic_pol, data_aux_funcs_t funcs, size_fx maxmemory){
-    
+//records fcache_repl_apply hands to one fcache_mset / fcache_mdel
+#define FCACHE_REPL_BATCH       64
+
+//WTINYLFU defaults: sketch sized for this many keys, window share of maxmemory in percent
+#define FCACHE_TINYLFU_KEYS     4096
+#define FCACHE_TINYLFU_WINDOW   1
+//SLRU default protected share of maxmemory in percent
+#define FCACHE_SLRU_PROTECTED   80
+
+static flexnode* fcache_remove_internal(flexcache *cache, void* key);
+
+static dllist_touch fcache_touch_policy(enum EVICTION_POLICY evic_pol){
+
+    switch(evic_pol){
+        case LRU:       return dllist_touch_LRU;
+        case LFU:       return 0;
+        case TTL:       return dllist_touch_TTL;
+        case RANDOM:    return dllist_touch_RANDOM;
+        case APPROX_LRU: return 0;
+        case WTINYLFU:  return 0;
+        case SLRU:      return 0;
+        case FIFO:
+        default:        return dllist_touch_FIFO;
+    }
+}
+
+// bytes allocations of size really take, as the allocator reports its rounding
+static FX_INLINE size_fx fcache_usable(flexcache *cache, size_fx size){
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    return allocator->usable ? (*allocator->usable)(size) : size;
+}
+
+// Charged besides the value bytes, fixed for the node life: the node allocation (hooks, metadata,
+// inline key), its index slot and the allocator rounding of the node and of an out of line value.
+// Keys that are not inline stay with the caller and are not charged.
+static size_fx fcache_entry_overhead(flexcache *cache, flexnode* node, size_fx key_size, const void* value, size_fx data_size){
+
+    size_fx node_bytes = fnode_alloc_size(key_size, value, data_size, cache->inline_max);
+    size_fx overhead = fcache_usable(cache, node_bytes) + map_entry_overhead(&cache->kv_map);
+
+    if(fnode_data_inline(node))
+        overhead -= data_size;
+    else if(value)
+        overhead += fcache_usable(cache, data_size) - data_size;
+
+    return overhead;
+}
+
+// what the entry costs against maxmemory, used by the accounting and by every evictor
+static FX_INLINE size_fx fcache_entry_cost(flexnode* node){
+    return fnode_get_size(node) + fnode_get_overhead(node);
+}
+
+static FX_INLINE bool_t fcache_is_sampled(flexcache *cache){
+    return cache->policy == APPROX_LRU || cache->policy == LFU;
+}
+
+static FX_INLINE dllist_fx* fcache_node_list(flexcache *cache, flexnode* node){
+    return fnode_in_window(node) ? &cache->window : &cache->evic_list;
+}
+
+//WTINYLFU: every access counts, misses too, so a key asked for often gets admitted once set
+static FX_INLINE void fcache_record_access(flexcache *cache, const void* key){
+    cm_sketch_increment(&cache->sketch, (*cache->config.funcs.hash)(key));
+}
+
+static FX_INLINE unsigned int fcache_estimate(flexcache *cache, flexnode* node){
+    return cm_sketch_estimate(&cache->sketch, (*cache->config.funcs.hash)(fnode_get_key(node)));
+}
+
+static void fcache_container_free(flexnode* node){
+
+    void* container = (void*)fnode_get_data(node);
+    if(fnode_get_type(node) == LIST)
+        flist_free(container);
+    else
+        fmap_free(container);
+}
+
+flexcache* fcache_new(const allocator_fx* allocator){
+    return (*allocator->alloc)(sizeof(flexcache));
+}
+
+int fcache_init(flexcache* cache, enum EVICTION_POLICY evic_pol, data_aux_funcs_t funcs, size_fx maxmemory, init_option* options){
+
+    enum INDEX_TYPE index = options ? options->index : INDEX_RBTREE;
+    size_fx samples = options ? options->evict_samples : 0;
+    size_fx log_factor = options ? options->lfu_log_factor : 0;
+    size_fx decay_time = options ? options->lfu_decay_time : 0;
+    cache->inline_max = options ? options->inline_max : 0;
+    cache->search_threads = options ? options->search_threads : 0;
+    cache->xfetch_delta_ms = options ? options->xfetch_delta_ms : 0;
+    cache->reclaim = 0;
+    cache->reclaim_aux = 0;
+    stats_init(&cache->stats);
+    cache->deferred = options ? options->deferred_maintenance : 0;
+    dllist_init(&cache->pending);
+    cache->snap_map = 0;
+    cache->snap_len = 0;
+    dllist_init(&cache->window);
+    cache->window_memory = 0;
+    cache->window_pct = options && options->tinylfu_window ? options->tinylfu_window : FCACHE_TINYLFU_WINDOW;
+    cache->protected_head = 0;
+    cache->protected_memory = 0;
+    cache->protected_pct = options && options->slru_protected ? options->slru_protected : FCACHE_SLRU_PROTECTED;
+
+    cache->config.funcs = funcs;
+    cache->config.maxmemory = maxmemory;
+    cache->config.volatilememory = 0;
+    cache->config.nonvolatilememory = 0;
+    cache->overhead_memory = 0;
+
+    dllist_init(&cache->evic_list);
+    cache->touch = fcache_touch_policy(evic_pol);
+
+    cache->policy = evic_pol;
+    cache->evict_samples = samples ? samples : EVICT_POOL_DEFAULT_SAMPLES;
+    cache->rand_state = (size_fx)cache ^ 0x9E3779B97F4A7C15UL;
+    evict_pool_init(&cache->pool);
+
+    time_fx now;
+    (*funcs.now)(&now);
+    fnode_time_base(now);
+    twheel_init(&cache->ttl_wheel, time_fx_to_ms(now));
+    cache->lfu.log_factor = log_factor ? log_factor : LFU_DEFAULT_LOG_FACTOR;
+    cache->lfu.decay_time = decay_time ? decay_time : LFU_DEFAULT_DECAY_TIME;
+
+    //released by the failure path below
+    cache->l2 = 0;
+    cache->l2_free = 0;
+    cache->repl = 0;
+    cache->sketch.table = 0;
+
+    if(options && options->l2_dir){
+        //keys are copied into the node on promotion, values are flat len_func bytes
+        if(!funcs.key_len || !funcs.copy_func || !options->l2_free || cache->inline_max == 0)
+            goto fail;
+        cache->l2 = l2_open(options->l2_dir, options->l2_max_bytes, funcs.allocator);
+        if(!cache->l2)
+            goto fail;
+        cache->l2_free = options->l2_free;
+    }
+
+    if(options && options->repl_log_bytes){
+        //records carry the key and value bytes
+        if(!funcs.key_len)
+            goto fail;
+        cache->repl = repl_new(options->repl_log_bytes, funcs.allocator);
+        if(!cache->repl)
+            goto fail;
+    }
+
+    if(evic_pol == WTINYLFU){
+        size_fx keys = options && options->tinylfu_keys ? options->tinylfu_keys : FCACHE_TINYLFU_KEYS;
+        if(!funcs.hash || !cm_sketch_init(&cache->sketch, keys, funcs.allocator))
+            goto fail;
+    }
+
+    //map keeps a pointer to the funcs... cache must not move after init
+    if(!map_init(&cache->kv_map, index, &cache->config.funcs, options ? options->expected_keys : 0))
+        goto fail;
+    return 1;
+
+fail:
+    cm_sketch_destroy(&cache->sketch);
+    if(cache->repl)
+        repl_free(cache->repl);
+    if(cache->l2)
+        l2_close(cache->l2);
+    cache->repl = 0;
+    cache->l2 = 0;
+    return 0;
+}
+
+void fcache_free(flexcache* cache, free_fx* cb_free){
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    dllist_concat(&cache->evic_list, &cache->window);
+    dllist_concat(&cache->evic_list, &cache->pending);
+
+    flexnode* iter = dllist_iter(&cache->evic_list);
+    while(iter != 0){
+        flexnode* next = dllist_next(iter);
+
+        bool_t container = fnode_get_type(iter) != SINGLE;
+        if(container)
+            fcache_container_free(iter);
+
+        void* data = fnode_destroy(iter, allocator);
+        if(data && !container && cb_free)
+            (*cb_free)(data);
+
+        iter = next;
+    }
+
+    map_destroy(&cache->kv_map);
+    cm_sketch_destroy(&cache->sketch);
+    if(cache->l2)
+        l2_close(cache->l2);
+    if(cache->repl)
+        repl_free(cache->repl);
+    if(cache->snap_map)
+        munmap(cache->snap_map, cache->snap_len);
+    (*allocator->free)(cache);
+}
+
+size_fx fcache_used_memory(flexcache* cache){
+    return cache->config.volatilememory + cache->config.nonvolatilememory;
+}
+
+void fcache_set_maxmemory(flexcache* cache, size_fx maxmemory){
+    cache->config.maxmemory = maxmemory;
+}
+
+void fcache_stats(flexcache* cache, fcache_stats_t* stats){
+    stats_collect(&cache->stats, stats);
+    stats->used_memory = fcache_used_memory(cache);
+    stats->overhead_memory = cache->overhead_memory;
+}
+
+void fcache_stats_reset(flexcache* cache){
+    stats_init(&cache->stats);
+}
+
+void fcache_set_reclaim(flexcache* cache, reclaim_fx reclaim, void* aux_data){
+
+    cache->reclaim = reclaim;
+    cache->reclaim_aux = aux_data;
+    map_set_reclaim(&cache->kv_map, reclaim, aux_data);
+}
+
+// node out of the cache: freed now, or handed to reclaim while lock free readers may hold it...
+// LIST and MAP values belong to the node like inline ones, nothing is reported
+static void* fcache_dispose_node(flexcache *cache, flexnode* node){
+
+    //an acquired node only leaves the cache, the last fcache_release frees it
+    if(!fnode_detach(node))
+        return 0;
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    bool_t container = fnode_get_type(node) != SINGLE;
+    if(container)
+        fcache_container_free(node);
+
+    if(!cache->reclaim){
+        void* data = fnode_destroy(node, allocator);
+        return container ? 0 : data;
+    }
+
+    void* data = container || fnode_data_inline(node) ? 0 : (void*)fnode_get_data(node);
+    cache->reclaim(cache->reclaim_aux, node, allocator->free);
+    return data;
+}
+
+static FX_INLINE void fcache_dispose_value(flexcache *cache, void* data, free_fx* cb_free){
+
+    if(cache->reclaim)
+        cache->reclaim(cache->reclaim_aux, data, cb_free);
+    else
+        (*cb_free)(data);
 }
 
-static void fcache_clear_removed_list_call_cb(dllist_fx* removed_list, free_fx* cb_free){
+// Nodes in removed_list are already out of the map, the lists and the memory accounting.
+// Inline values die with their node, only the values the user handed over are reported.
+static void fcache_clear_removed_list_call_cb(flexcache *cache, dllist_fx* removed_list, free_fx* cb_free){
     
-    flexnode* iter = dllist_iter(list);
+    flexnode* iter = dllist_iter(removed_list);
 
     while(iter!= 0){
-        //- REMOVE-LOS DO MAP
-        // ATUALIZAR MEMORY SIZE DO CACHE
-        // E FREE OS NODES
-        //CALL CB ON DATA
+        flexnode* next = dllist_next(iter);
 
-        iter = dllist_next(iter);
+        void* data = fcache_dispose_node(cache, iter);
+        if(data && cb_free)
+            fcache_dispose_value(cache, data, cb_free);
+
+        iter = next;
     }
-    dllist_free(removed_list);
+    dllist_init(removed_list);
 
 }
 
-static void fcache_clear_removed_list_to_stack(dllist_fx* removed_list, stack_fx* vec_removed){
+static void fcache_clear_removed_list_to_stack(flexcache *cache, dllist_fx* removed_list, stack_fx* vec_removed){
     
-    flexnode* iter = dllist_iter(list);
+    flexnode* iter = dllist_iter(removed_list);
 
     while(iter!= 0){
-        //- REMOVE-LOS DO MAP
-        // ATUALIZAR MEMORY SIZE DO CACHE
-        // E FREE OS NODES
-        //ADDICIONAR AO STCK_REMOVED
+        flexnode* next = dllist_next(iter);
+
+        void* data = fcache_dispose_node(cache, iter);
+        if(data)
+            stack_push(vec_removed, data);
 
-        iter = dllist_next(iter);
+        iter = next;
     }
-    dllist_free(removed_list);
+    dllist_init(removed_list);
 
 }
 
-static FX_INLINE size_fx fcache_volatile_memory(flexcache *cache){
-    return cache->config.volatile_memory;
+// value handed back to the user (remove): inline data is copied out since the node goes away
+static void* fcache_release_node(flexcache *cache, flexnode* node){
+
+    if(fnode_get_type(node) != SINGLE){
+        fcache_dispose_node(cache, node);
+        return 0;
+    }
+
+    //handles still read the value: the user gets a copy, the last fcache_release frees the original
+    void* data = (void*)fnode_get_data(node);
+    if(fnode_data_inline(node) || fnode_pinned(node))
+        data = (*cache->config.funcs.copy_func)(data);
+
+    fcache_dispose_node(cache, node);
+    return data;
 }
 
-static FX_INLINE size_fx fcache_volatile_frequency(flexcache *cache){
-    return cache->config.volatile_memory;
+static FX_INLINE size_fx fcache_available_volatile_memory(flexcache *cache){
+
+    size_fx used = fcache_used_memory(cache);
+    size_fx max = cache->config.maxmemory;
+
+    return used < max ? max - used : 0;
 }
 
-static FX_INLINE time_fx fcache_last_check(flexcache *cache){
-    return cache->config.volatile_memory;
+// mutation log record of a SINGLE node, value bytes only for REPL_SET... LIST and MAP keys are not replicated
+static void fcache_repl_log(flexcache *cache, unsigned char op, flexnode* node){
+
+    if(!cache->repl || fnode_get_type(node) != SINGLE)
+        return;
+
+    const void* key = fnode_get_key(node);
+    size_fx key_len = (*cache->config.funcs.key_len)((void*)key);
+    const void* value = op == REPL_SET ? fnode_get_data(node) : 0;
+    size_fx value_len = op == REPL_SET ? fnode_get_size(node) : 0;
+    unsigned long long expires = fnode_is_volatile(node) ? fnode_expire_ms(node) : 0;
+
+    if(!repl_append(cache->repl, op, key, key_len, value, value_len, expires))
+        stats_add(&cache->stats, STAT_REPL_DROPPED, 1);
 }
 
-static FX_INLINE bool_t fcache_is_check_time(time_fx now){
+typedef struct fcache_expire_ctx{
+    flexcache*      cache;
+    dllist_fx*      removed_list;
+} fcache_expire_ctx;
+
+static void fcache_expire_node(flexcache *cache, flexnode* node, dllist_fx* removed_list){
 
-        size_fx freq = fcache_volatile_frequency(cache);
-        time_fx lst_check = fcache_last_check(cache);
-        time_fx due_time;
+    stats_add(&cache->stats, STAT_EVICTED_TTL, 1);
+    stats_add(&cache->stats, STAT_BYTES_EVICTED, fcache_entry_cost(node));
+    fcache_repl_log(cache, REPL_EXPIRE, node);
 
-        time_fx_add_seconds(lst_check, freq, &due_time);
+    node = fcache_remove_internal(cache, (void*)fnode_get_key(node));
+    if(node)
+        dllist_insert(removed_list, node);
+}
+
+static void fcache_expire_cb(twheel_node* hook, void* aux_data){
 
-        return time_fx_is_later(now, due_time);
+    fcache_expire_ctx* ctx = aux_data;
+    fcache_expire_node(ctx->cache, fnode_from_ttl_hook(hook), ctx->removed_list);
 }
 
-static void fcache_check_evict(flexcache *cache, const flexnode* node, dllist_fx* removed_list){
+static FX_INLINE bool_t fcache_node_expired(flexcache *cache, flexnode* node){
 
-    eviction_list_t* list = &cache->evic_list;
+    if(!fnode_is_volatile(node))
+        return 0;
 
     time_fx now;
-    cache.funcs.now(&now);
+    (*cache->config.funcs.now)(&now);
+    return fnode_expire_ms(node) <= time_fx_to_ms(now);
+}
+
+// map_get for reads and sets: a node past its ttl the wheel did not reach yet expires on the spot,
+// into removed_list or (0) the pending list, whose values the next set or fcache_tick reports
+static flexnode* fcache_live_node(flexcache *cache, void* key, dllist_fx* removed_list){
+
+    flexnode* node = map_get(&cache->kv_map, key);
+    if(!node || !fcache_node_expired(cache, node))
+        return node;
+
+    fcache_expire_node(cache, node, removed_list ? removed_list : &cache->pending);
+    return 0;
+}
+
+// expire what is due since the last call... O(expired), no list scan
+static void fcache_expire_due(flexcache *cache, time_fx now, dllist_fx* removed_list){
+
+    fcache_expire_ctx ctx = {cache, removed_list};
+    twheel_advance(&cache->ttl_wheel, time_fx_to_ms(now), fcache_expire_cb, &ctx);
+}
+
+// key length for the L2 tier, 0 when the key can not go there: only keys stored inline come back
+// (the promoted node owns its key copy)
+static FX_INLINE size_fx fcache_l2_key_len(flexcache *cache, const void* key){
+
+    size_fx key_len = (*cache->config.funcs.key_len)((void*)key);
+    return key_len <= cache->inline_max ? key_len : 0;
+}
+
+// memory victim: a copy goes down to the L2 tier when there is one, the value is still reported
+// as evicted... a key lives in one tier at a time
+static void fcache_demote(flexcache *cache, flexnode* node){
+
+    if(!cache->l2 || fnode_get_type(node) != SINGLE)
+        return;
+
+    const void* key = fnode_get_key(node);
+    size_fx key_len = fcache_l2_key_len(cache, key);
+    if(key_len == 0)
+        return;
+
+    unsigned long long expires = fnode_is_volatile(node) ? fnode_expire_ms(node) : 0;
+    if(l2_put(cache->l2, key, key_len, fnode_get_data(node), fnode_get_size(node), expires))
+        stats_add(&cache->stats, STAT_L2_DEMOTED, 1);
+}
+
+// higher is a better victim: idle ms for APPROX_LRU, least decayed frequency for LFU
+static FX_INLINE size_fx fcache_sample_score(flexcache *cache, flexnode* node, time_fx now){
+
+    if(cache->policy == LFU)
+        return 255 - lfu_decayed(fnode_get_metadata(node), lfu_minutes(now), &cache->lfu);
+
+    long idle = time_fx_diff_ms(now, fnode_get_lst_used(node));
+    return idle > 0 ? (size_fx)idle : 0;
+}
+
+// next key to sample: a random one with INDEX_HASH... the tree has no O(1) random pick, there
+// the evic_list head is taken and moved to the back (the list order means nothing to the sampled
+// policies), the samples go round every key in turn
+static flexnode* fcache_next_sample(flexcache *cache){
+
+    if(cache->kv_map.type == INDEX_HASH)
+        return map_random(&cache->kv_map, rand_fx(&cache->rand_state));
+
+    flexnode* node = dllist_iter(&cache->evic_list);
+    if(node){
+        dllist_remove(&cache->evic_list, node);
+        dllist_insert(&cache->evic_list, node);
+    }
+    return node;
+}
+
+// Sampled eviction: frees at least need bytes, the pool gets evict_samples
+// keys before each pick and gives back its best candidate.
+static void fcache_evict_sampled(flexcache *cache, size_fx need, time_fx now, dllist_fx* removed_list){
+
+    map_fx* map = &cache->kv_map;
+    size_fx freed = 0;
+    size_fx evicted = 0;
 
-    if(fcache_is_check_time(now)){
-        dllist_fx* new_removed = dllist_full_scan_clean(list, now);
-        dllist_concat(removed_list, new_removed);
+    while(freed < need && map_size(map) > 0){
+
+        for(size_fx i = 0; i < cache->evict_samples; i++){
+            flexnode* sample = fcache_next_sample(cache);
+            evict_pool_offer(&cache->pool, sample, fcache_sample_score(cache, sample, now));
+        }
+
+        flexnode* victim = evict_pool_pop(&cache->pool);
+        if(!victim)
+            break;
+
+        freed += fcache_entry_cost(victim);
+        evicted++;
+        fcache_demote(cache, victim);
+        fcache_repl_log(cache, REPL_DEL, victim);
+        victim = fcache_remove_internal(cache, (void*)fnode_get_key(victim));
+        if(!victim) //not in the index, it would come back as the next victim
+            break;
+        dllist_insert(removed_list, victim);
     }
 
-    size_fx len = fnode_get_size(node);
-    size_fx available = fcache_available_volatile_memory(cache);
-    if(len > available){
-        dllist_fx* new_removed = dllist_scan_clean_until(list, len - available);
-        dllist_concat(removed_list, new_removed);
+    stats_add(&cache->stats, STAT_EVICTED_MEMORY, evicted);
+    stats_add(&cache->stats, STAT_BYTES_EVICTED, freed);
+}
+
+// list policies: victims come from the eviction list head
+static void fcache_evict_list(flexcache *cache, size_fx need, dllist_fx* removed_list){
+
+    size_fx evicted = 0;
+    size_fx freed = 0;
+
+    flexnode* victim = dllist_iter(&cache->evic_list);
+    while(victim && freed < need){
+        evicted++;
+        freed += fcache_entry_cost(victim);
+        fcache_demote(cache, victim);
+        fcache_repl_log(cache, REPL_DEL, victim);
+        victim = fcache_remove_internal(cache, (void*)fnode_get_key(victim));
+        if(!victim) //not in the index, it would come back as the next victim
+            break;
+        dllist_insert(removed_list, victim);
+        victim = dllist_iter(&cache->evic_list);
     }
+
+    stats_add(&cache->stats, STAT_EVICTED_MEMORY, evicted);
+    stats_add(&cache->stats, STAT_BYTES_EVICTED, freed);
 }
 
-static dllist_fx* set_internal(flexcache *cache, void* key, const void* value, set_option* options){
-    
-    map_fx* map = &cache->kv_map;  
-    eviction_list_t* list = &cache->evic_list;
-    allocator_fx* allocator = cache->config.funcs.allocator;
-    len_func* length = cache->config.funcs.len_func;
-    //CALCULAR O TTL
-    //O NODE TEM QUE TER O END TIME APENAS
-    // size_fx EX = options->EX;
+static void fcache_window_promote(flexcache *cache, flexnode* node){
 
-    size_fx data_size = (*length)(value);
-    size_fx vol_memory = fcache_volatile_memory(cache);
+    dllist_remove(&cache->window, node);
+    cache->window_memory -= fcache_entry_cost(node);
+    fnode_set_window(node, 0);
+    dllist_insert(&cache->evic_list, node);
+}
 
-    dllist_fx removed_list;
-    flexnode* existing_node = map_get(map, key);
-    if(!existing_node){
-        if(options->XX)
-            return 0;
-        if(data_size > vol_memory)
-            return 0;
-    } else {
-        if(options->NX)
-            return 0;
-        
-        size_fx old_size = fnode_get_size(existing_node);
-        if(data_size > old_size + vol_memory)
-            return 0;
+// new key into the window, what overflows it goes on to the main list... no duel while
+// the cache has room, fcache_evict_tinylfu is where the admission filter bites
+static void fcache_window_admit(flexcache *cache, flexnode* node, const void* key){
 
-        if(options->KEEPTTL)
-            size_fx TTL = fnode_get_ttl(existing_node);
-            //SETAR OPTIONS EXAT e PXAT
+    cm_sketch_ensure(&cache->sketch, map_size(&cache->kv_map));
+    fcache_record_access(cache, key);
 
-        
-        flexnode* old_node = fcache_remove_internal(cache, key);
-        if(old_node)
-            dllist_insert(&removed_list, old_node);
+    fnode_set_window(node, 1);
+    dllist_insert(&cache->window, node);
+    cache->window_memory += fcache_entry_cost(node);
+
+    size_fx window_max = cache->config.maxmemory / 100 * cache->window_pct;
+    flexnode* head = dllist_iter(&cache->window);
+    while(cache->window_memory > window_max && head != node){
+        fcache_window_promote(cache, head);
+        head = dllist_iter(&cache->window);
     }
+}
 
-    flexnode *node;
-    fnode_init(node, key, value, data_size, options);
-    fcache_check_evict(cache, node, &removed_list); // worst O(n)
+// WTINYLFU: the window LRU (candidate) and the main LRU (victim) duel on their estimated
+// frequency... the candidate only stays, moving to the main list, when strictly more frequent,
+// so a scan of one hit keys churns the window and never pushes the hot keys out
+static void fcache_evict_tinylfu(flexcache *cache, size_fx need, dllist_fx* removed_list){
 
-    map_set(map, key, node); //O(log(n))
-    dllist_insert(list, node); //O(1)
+    size_fx freed = 0;
+    size_fx evicted = 0;
 
-    //update cache items and memory usage
-    if(fnode_is_volatile(node)){
-        cache->config.volatilememory += data_size;
-    } else{
-        cache->config.nonvolatilememory += data_size;
+    while(freed < need){
+        flexnode* candidate = dllist_iter(&cache->window);
+        flexnode* victim = dllist_iter(&cache->evic_list);
+        if(!candidate && !victim)
+            break;
+
+        if(candidate && victim && fcache_estimate(cache, candidate) > fcache_estimate(cache, victim))
+            fcache_window_promote(cache, candidate);
+        else if(candidate)
+            victim = candidate;
+
+        freed += fcache_entry_cost(victim);
+        evicted++;
+        fcache_demote(cache, victim);
+        fcache_repl_log(cache, REPL_DEL, victim);
+        victim = fcache_remove_internal(cache, (void*)fnode_get_key(victim));
+        if(!victim) //not in the index, it would come back as the next victim
+            break;
+        dllist_insert(removed_list, victim);
     }
 
-    return &removed_list;
+    stats_add(&cache->stats, STAT_EVICTED_MEMORY, evicted);
+    stats_add(&cache->stats, STAT_BYTES_EVICTED, freed);
 }
 
-FX_INLINE stack_fx* fcache_set(flexcache *cache, void* key, const void* value, set_option* options){
-    
-    allocator_fx* allocator = cache->config.funcs.allocator;
+// SLRU segments are split by protected_head only: new keys go in right before it, a promoted key
+// goes to the back and the protected LRU is demoted by moving the split, never the node
+static void fcache_slru_insert(flexcache *cache, flexnode* node){
 
-    dllist_fx* removed_list = fcache_set_internal(cache, key, value, options);
-    stack_fx* removed = 0;
-    stack_init(removed, allocator.alloc);
-    fcache_clear_removed_list_to_stack(removed_list, removed);
+    if(cache->protected_head)
+        dllist_insert_before(&cache->evic_list, node, cache->protected_head);
+    else
+        dllist_insert(&cache->evic_list, node);
+}
 
-    return removed;
+//node leaving its place in evic_list
+static void fcache_slru_unlink(flexcache *cache, flexnode* node){
+
+    if(node == cache->protected_head)
+        cache->protected_head = dllist_next(node);
+
+    if(fnode_is_protected(node)){
+        cache->protected_memory -= fcache_entry_cost(node);
+        fnode_set_protected(node, 0);
+    }
 }
 
-void fcache_set_free(flexcache *cache, void* key, const void* value, set_option* options, free_fx* cb_free){
+//read hit (the set was the first access): to the protected MRU end
+static void fcache_slru_touch(flexcache *cache, flexnode* node){
 
-    dllist_fx* removed_list = fcache_set_internal(cache, key, value, options);
-    fcache_clear_removed_list_call_cb(removed_list, cb_free);
+    dllist_fx* list = &cache->evic_list;
 
+    fcache_slru_unlink(cache, node);
+    dllist_remove(list, node);
+    dllist_insert(list, node);
+
+    fnode_set_protected(node, 1);
+    cache->protected_memory += fcache_entry_cost(node);
+    if(!cache->protected_head)
+        cache->protected_head = node;
+
+    size_fx protected_max = cache->config.maxmemory / 100 * cache->protected_pct;
+    while(cache->protected_memory > protected_max && cache->protected_head != node){
+        flexnode* demoted = cache->protected_head;
+        cache->protected_head = dllist_next(demoted);
+        cache->protected_memory -= fcache_entry_cost(demoted);
+        fnode_set_protected(demoted, 0);
+    }
 }
 
-const void* fcache_get_ptr(flexcache *cache, void* key){
+//probation LRU first, protected once probation is empty... both are the evic_list head
+static void fcache_evict_slru(flexcache *cache, size_fx need, dllist_fx* removed_list){
 
-    map_fx* map = &cache->kv_map;  
-    eviction_list_t* list = &cache->evic_list;
+    size_fx freed = 0;
+    size_fx evicted = 0;
 
-    flexnode* node = map_get(map, key);
-    if(!node){
-        return node;
+    flexnode* victim = dllist_iter(&cache->evic_list);
+    while(victim && freed < need){
+        freed += fcache_entry_cost(victim);
+        evicted++;
+        fcache_demote(cache, victim);
+        fcache_repl_log(cache, REPL_DEL, victim);
+        victim = fcache_remove_internal(cache, (void*)fnode_get_key(victim));
+        if(!victim) //not in the index, it would come back as the next victim
+            break;
+        dllist_insert(removed_list, victim);
+        victim = dllist_iter(&cache->evic_list);
     }
 
-    dllist_touch* touch = cache->touch;
-    touch(list, node);
+    stats_add(&cache->stats, STAT_EVICTED_MEMORY, evicted);
+    stats_add(&cache->stats, STAT_BYTES_EVICTED, freed);
+}
 
-    const void* data = fnode_get_data(node);
-    return data;
+static FX_INLINE void fcache_evict(flexcache *cache, size_fx need, time_fx now, dllist_fx* removed_list){
+
+    if(cache->policy == WTINYLFU)
+        fcache_evict_tinylfu(cache, need, removed_list);
+    else if(cache->policy == SLRU)
+        fcache_evict_slru(cache, need, removed_list);
+    else if(fcache_is_sampled(cache))
+        fcache_evict_sampled(cache, need, now, removed_list);
+    else
+        fcache_evict_list(cache, need, removed_list);
 }
 
-FX_INLINE void* fcache_get_copy(flexcache *cache, void* key){
+static FX_INLINE size_fx fcache_over_memory(flexcache *cache){
 
-    void* data = fcache_get_ptr(cache, key);
-    const copy_func* copy = cache->config.funcs.copy_func;
-    return (*copy)(data);
+    size_fx used = fcache_used_memory(cache);
+    return used > cache->config.maxmemory ? used - cache->config.maxmemory : 0;
 }
 
-static flexnode* fcache_remove_internal(flexcache *cache, void* key){
+static void fcache_check_evict(flexcache *cache, flexnode* node, dllist_fx* removed_list){
+
+    size_fx start_ns = stats_now_ns();
+
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+
+    fcache_expire_due(cache, now, removed_list);
+
+    size_fx len = fcache_entry_cost(node);
+    size_fx available = fcache_available_volatile_memory(cache);
+    //a lowered maxmemory is caught up at once, not one victim per set
+    if(len > available)
+        fcache_evict(cache, len - available + fcache_over_memory(cache), now, removed_list);
+
+    stats_add(&cache->stats, STAT_EVICT_NS, stats_now_ns() - start_ns);
+}
+
+//evictions per step, the tick budget is checked between steps
+#define FCACHE_TICK_EVICT_STEP  (64 * 1024)
+//nodes freed between two budget checks
+#define FCACHE_TICK_FREE_BATCH  32
+//index slots moved between two budget checks
+#define FCACHE_TICK_MIGRATE_SLOTS 1024
+
+bool_t fcache_tick(flexcache *cache, size_fx budget_us, free_fx* cb_free){
+
+    size_fx start_ns = stats_now_ns();
+    size_fx deadline = start_ns + budget_us * 1000;
+    dllist_fx* pending = &cache->pending;
+
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+
+    fcache_expire_due(cache, now, pending);
+
+    size_fx over = fcache_over_memory(cache);
+    while(over > 0 && stats_now_ns() < deadline){
+        size_fx before = map_size(&cache->kv_map);
+
+        fcache_evict(cache, over < FCACHE_TICK_EVICT_STEP ? over : FCACHE_TICK_EVICT_STEP, now, pending);
+        if(map_size(&cache->kv_map) == before)
+            break;
+
+        over = fcache_over_memory(cache);
+    }
+    stats_add(&cache->stats, STAT_EVICT_NS, stats_now_ns() - start_ns);
+
+    if(cache->l2)
+        l2_compact(cache->l2, 1);
+
+    //an index resize also moves forward here, on top of the steps taken by sets and removes
+    bool_t resizing = map_migrate(&cache->kv_map, FCACHE_TICK_MIGRATE_SLOTS);
+    while(resizing && stats_now_ns() < deadline)
+        resizing = map_migrate(&cache->kv_map, FCACHE_TICK_MIGRATE_SLOTS);
+
+    size_fx freed = 0;
+    flexnode* iter = dllist_iter(pending);
+    while(iter != 0){
+        if(freed && freed % FCACHE_TICK_FREE_BATCH == 0 && stats_now_ns() >= deadline)
+            break;
+
+        flexnode* next = dllist_next(iter);
+        dllist_remove(pending, iter);
+
+        void* data = fcache_dispose_node(cache, iter);
+        if(data && cb_free)
+            fcache_dispose_value(cache, data, cb_free);
+
+        freed++;
+        iter = next;
+    }
+
+    return over == 0 && list_empty(pending);
+}
+
+// JITTER: EX / PX plus a random share of up to JITTER percent
+static void fcache_jitter_ttl(flexcache *cache, set_option* options){
+
+    if(options->JITTER <= 0)
+        return;
+
+    if(options->EX > 0)
+        options->EX += (long)(rand_fx(&cache->rand_state) % ((size_fx)options->EX * options->JITTER / 100 + 1));
+    if(options->PX > 0)
+        options->PX += (long)(rand_fx(&cache->rand_state) % ((size_fx)options->PX * options->JITTER / 100 + 1));
+}
+
+// set_internal for a value of data_size bytes... LIST and MAP values are the container
+static bool_t store_internal(flexcache *cache, void* key, const void* value, size_fx data_size, node_type type,
+                                set_option* options, dllist_fx* removed_list){
     
-    if(!map_contains(cache, key)){
+    map_fx* map = &cache->kv_map;  
+    dllist_fx* list = &cache->evic_list;
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    //CALCULAR O TTL
+    //O NODE TEM QUE TER O END TIME APENAS
+    // size_fx EX = options->EX;
+
+    STATS_TIMER_START(start_ns);
+
+    //can never fit, even alone
+    if(data_size > cache->config.maxmemory)
         return 0;
+
+    set_option effective = *options;
+    fcache_jitter_ttl(cache, &effective);
+
+    flexnode* existing_node = fcache_live_node(cache, key, removed_list);
+    if(!existing_node){
+        if(options->XX){
+            stats_add(&cache->stats, STAT_XX_REJECTS, 1);
+            return 0;
+        }
+        //a new version, an older one in L2 must not come back
+        if(cache->l2 && fcache_l2_key_len(cache, key))
+            l2_remove(cache->l2, key, fcache_l2_key_len(cache, key));
+    } else {
+        if(options->NX){
+            stats_add(&cache->stats, STAT_NX_REJECTS, 1);
+            return 0;
+        }
+
+        //what is left of the current ttl, in place of the one asked for
+        if(options->KEEPTTL){
+            long total;
+            long left = fcache_ttl_ms(cache, key, &total);
+            effective.EX = 0;
+            effective.EXAT = 0;
+            effective.PXAT = 0;
+            effective.PX = left > 0 ? left : 0;
+        }
+
+        flexnode* old_node = fcache_remove_internal(cache, key);
+        if(old_node)
+            dllist_insert(removed_list, old_node);
     }
 
-    eviction_list_t* list = &cache->evic_list;
-    allocator_fx *allocator = allocator;
-    const len_func* length = cache->config.funcs.len_func;
+    const len_func* key_length = cache->config.funcs.key_len;
+    size_fx key_size = key_length ? (*key_length)(key) : 0;
 
-    flexnode* node = map_remove(&cache->kv_map, key);
-    if(!node){
-        return node;
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+
+    flexnode *node = fnode_new(allocator, key, key_size, type == SINGLE ? value : 0, data_size, cache->inline_max,
+                                &effective, now);
+    if(!node)
+        return 0;
+    if(type != SINGLE)
+        fnode_set_container(node, type, (void*)value);
+    fnode_set_overhead(node, fcache_entry_overhead(cache, node, key_size, type == SINGLE ? value : 0, data_size));
+    twheel_node_init(fnode_ttl_hook(node));
+    if(cache->policy == LFU){
+        lfu_reset(fnode_get_metadata(node), now);
     }
-    dllist_remove(list, node);
+    if(!cache->deferred)
+        fcache_check_evict(cache, node, removed_list); // worst O(n)
 
-    void* data = fnode_get_data(node);
-    size_fx len = (*length)(data);
+    //index full and its growth failed: nothing is linked yet, the node goes and the set fails
+    if(!map_set(map, key, node)){ //O(log(n))
+        fnode_destroy(node, allocator);
+        return 0;
+    }
+    if(cache->policy == WTINYLFU)
+        fcache_window_admit(cache, node, key);
+    else if(cache->policy == SLRU)
+        fcache_slru_insert(cache, node);
+    else
+        dllist_insert(list, node); //O(1)
+    if(fnode_is_volatile(node))
+        twheel_add(&cache->ttl_wheel, fnode_ttl_hook(node), fnode_expire_ms(node)); //O(1)
+    fcache_repl_log(cache, REPL_SET, node);
 
+    //update cache items and memory usage
+    size_fx cost = fcache_entry_cost(node);
+    cache->overhead_memory += fnode_get_overhead(node);
     if(fnode_is_volatile(node)){
-        cache->config.volatilememory -= len;
+        cache->config.volatilememory += cost;
     } else{
-        cache->config.nonvolatilememory -= len;
+        cache->config.nonvolatilememory += cost;
     }
+    stats_add(&cache->stats, STAT_SETS, 1);
+    STATS_TIMER_SET(&cache->stats, start_ns);
 
-    return node;
+    return 1;
 }
 
-void* fcache_remove(flexcache *cache, void* key){
-    
-    allocator_fx *allocator = allocator;
+// removed_list (caller owned, initialized) gets the replaced and evicted nodes, even when
+// the set itself fails... returns 1 when the key was stored
+static bool_t set_internal(flexcache *cache, void* key, const void* value, set_option* options, dllist_fx* removed_list){
 
-    flexnode* node = fcache_remove_internal(cache, key);
-    void* data = fnode_get_data(node);
+    size_fx data_size = (*cache->config.funcs.len_func)((void*)value);
+    return store_internal(cache, key, value, data_size, SINGLE, options, removed_list);
+}
 
-    // fnode_destroy(node, allocator);
-    allocator->free_fx(node);
+// 1 when the nodes a set removed must be reported now... deferred caches park them for fcache_tick
+static FX_INLINE bool_t fcache_has_removed(flexcache *cache, dllist_fx* removed_list){
 
-    return data;
-}   
\ No newline at end of file
+    //values of the nodes reads expired go out with this set
+    if(!cache->deferred)
+        dllist_concat(removed_list, &cache->pending);
+
+    if(list_empty(removed_list))
+        return 0;
+
+    if(cache->deferred){
+        dllist_concat(&cache->pending, removed_list);
+        return 0;
+    }
+
+    return 1;
+}
+
+FX_INLINE stack_fx* fcache_set(flexcache *cache, void* key, const void* value, set_option* options){
+    
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    set_internal(cache, key, value, options, &removed_list);
+    if(!fcache_has_removed(cache, &removed_list))
+        return 0;
+
+    stack_fx* removed = stack_new(allocator);
+    fcache_clear_removed_list_to_stack(cache, &removed_list, removed);
+
+    return removed;
+}
+
+void fcache_set_free(flexcache *cache, void* key, const void* value, set_option* options, free_fx* cb_free){
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    set_internal(cache, key, value, options, &removed_list);
+    if(fcache_has_removed(cache, &removed_list))
+        fcache_clear_removed_list_call_cb(cache, &removed_list, cb_free);
+
+}
+
+void fcache_set_cb(flexcache *cache, void* key, const void* value, set_option* options, fcache_evict_cb cb, void* aux_data){
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    set_internal(cache, key, value, options, &removed_list);
+    if(!fcache_has_removed(cache, &removed_list))
+        return;
+
+    flexnode* iter = dllist_iter(&removed_list);
+    while(iter != 0){
+        flexnode* next = dllist_next(iter);
+
+        void* data = fcache_dispose_node(cache, iter);
+        if(data)
+            cb(data, aux_data);
+
+        iter = next;
+    }
+}
+
+size_fx fcache_set_buf(flexcache *cache, void* key, const void* value, set_option* options,
+                        void** evicted, size_fx capacity, free_fx* cb_free){
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    set_internal(cache, key, value, options, &removed_list);
+    if(!fcache_has_removed(cache, &removed_list))
+        return 0;
+
+    size_fx count = 0;
+    flexnode* iter = dllist_iter(&removed_list);
+    while(iter != 0){
+        flexnode* next = dllist_next(iter);
+
+        void* data = fcache_dispose_node(cache, iter);
+        if(data && count < capacity)
+            evicted[count++] = data;
+        else if(data && cb_free)
+            fcache_dispose_value(cache, data, cb_free);
+
+        iter = next;
+    }
+
+    return count;
+}
+
+// read hit... list policies move the node, sampled ones only stamp it
+// (now is read once per batch: *has_now tells if it is already set)
+static FX_INLINE void fcache_touch(flexcache *cache, flexnode* node, time_fx* now, bool_t* has_now){
+
+    if(cache->policy == WTINYLFU){
+        fcache_record_access(cache, fnode_get_key(node));
+        dllist_touch_LRU(fcache_node_list(cache, node), node);
+        return;
+    }
+
+    if(cache->policy == SLRU){
+        fcache_slru_touch(cache, node);
+        return;
+    }
+
+    dllist_touch touch = cache->touch;
+    if(touch){
+        touch(&cache->evic_list, node);
+        return;
+    }
+
+    if(!has_now || !*has_now){
+        (*cache->config.funcs.now)(now);
+        if(has_now)
+            *has_now = 1;
+    }
+
+    fnode_touch(node, *now);
+    if(cache->policy == LFU)
+        lfu_touch(fnode_get_metadata(node), *now, rand_fx(&cache->rand_state), &cache->lfu);
+}
+
+// XFetch: expired early for this read with probability exp(-left / delta), left from the node
+// epoch and ttl... the entry stays for the other readers, the caller reloads and sets it
+static bool_t fcache_xfetch_early(flexcache *cache, flexnode* node){
+
+    if(!fnode_is_volatile(node))
+        return 0;
+
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+    unsigned long long now_ms = time_fx_to_ms(now);
+    twheel_time expires = fnode_expire_ms(node);
+    if(expires <= now_ms)
+        return 1;
+
+    double u = (double)(rand_fx(&cache->rand_state) >> 11) / 9007199254740992.0; //[0, 1)
+    return u < exp(-(double)(expires - now_ms) / (double)cache->xfetch_delta_ms);
+}
+
+// L1 miss: the L2 record goes back through the set path (evictions go to l2_free) and leaves L2...
+// the disk read runs outside the L2 lock
+static flexnode* fcache_promote(flexcache *cache, void* key){
+
+    size_fx key_len = fcache_l2_key_len(cache, key);
+    if(key_len == 0)
+        return 0;
+
+    size_fx len;
+    unsigned long long expires;
+    void* bytes = l2_get(cache->l2, key, key_len, &len, &expires);
+    if(!bytes)
+        return 0;
+    l2_remove(cache->l2, key, key_len);
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    set_option options = {0};
+    if(expires){
+        time_fx now;
+        (*cache->config.funcs.now)(&now);
+        unsigned long long now_ms = time_fx_to_ms(now);
+        if(expires <= now_ms){
+            (*allocator->free)(bytes);
+            return 0;
+        }
+        options.PX = (long)(expires - now_ms);
+    }
+
+    //inline values are copied by the node, the others need a value of their own
+    bool_t inline_value = len <= cache->inline_max;
+    void* data = inline_value ? bytes : (*cache->config.funcs.copy_func)(bytes);
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    bool_t stored = data && set_internal(cache, key, data, &options, &removed_list);
+    if(fcache_has_removed(cache, &removed_list))
+        fcache_clear_removed_list_call_cb(cache, &removed_list, cache->l2_free);
+
+    if(!stored && data && !inline_value)
+        (*cache->l2_free)(data);
+    (*allocator->free)(bytes);
+    if(!stored)
+        return 0;
+
+    stats_add(&cache->stats, STAT_L2_HITS, 1);
+    return map_get(&cache->kv_map, key);
+}
+
+// read hit path of fcache_get_ptr and fcache_acquire: L2 promotion, XFetch, touch and stats
+static flexnode* fcache_lookup(flexcache *cache, void* key){
+
+    STATS_TIMER_START(start_ns);
+
+    flexnode* node = fcache_live_node(cache, key, 0);
+    if(!node && cache->l2)
+        node = fcache_promote(cache, key);
+    if(!node){
+        if(cache->policy == WTINYLFU)
+            fcache_record_access(cache, key);
+        stats_add(&cache->stats, STAT_MISSES, 1);
+        STATS_TIMER_GET(&cache->stats, start_ns);
+        return node;
+    }
+
+    //a LIST or MAP key has no plain value to hand out
+    if(fnode_get_type(node) != SINGLE || (cache->xfetch_delta_ms && fcache_xfetch_early(cache, node))){
+        stats_add(&cache->stats, STAT_MISSES, 1);
+        STATS_TIMER_GET(&cache->stats, start_ns);
+        return 0;
+    }
+
+    time_fx now;
+    fcache_touch(cache, node, &now, 0);
+    stats_add(&cache->stats, STAT_HITS, 1);
+    STATS_TIMER_GET(&cache->stats, start_ns);
+
+    return node;
+}
+
+const void* fcache_get_ptr(flexcache *cache, void* key){
+
+    flexnode* node = fcache_lookup(cache, key);
+    return node ? fnode_get_data(node) : 0;
+}
+
+const void* fcache_peek(flexcache *cache, void* key){
+
+    flexnode* node = fcache_live_node(cache, key, 0);
+    return node && fnode_get_type(node) == SINGLE ? fnode_get_data(node) : 0;
+}
+
+fcache_handle* fcache_acquire(flexcache *cache, void* key){
+
+    flexnode* node = fcache_lookup(cache, key);
+    if(!node || fnode_get_type(node) != SINGLE || !fnode_pin(node))
+        return 0;
+    return (fcache_handle*)node;
+}
+
+const void* fcache_handle_value(fcache_handle* handle){
+    return fnode_get_data((flexnode*)handle);
+}
+
+void fcache_release(flexcache *cache, fcache_handle* handle, free_fx* cb_free){
+
+    flexnode* node = (flexnode*)handle;
+    if(!fnode_unpin(node))
+        return;
+
+    void* data = fcache_dispose_node(cache, node);
+    if(data && cb_free)
+        fcache_dispose_value(cache, data, cb_free);
+}
+
+bool_t fcache_key_exists(flexcache *cache, void* key){
+    return fcache_live_node(cache, key, 0) != 0;
+}
+
+// No lock and no list move: APPROX_LRU gets lst_used stamped (one relaxed atomic store, the
+// writer samples it meanwhile), LFU counters and list orders only move on locked reads.
+// The node stays readable until the reclaim grace period, not until the next write.
+const void* fcache_get_ptr_concurrent(flexcache *cache, void* key, bool_t* expired){
+
+    if(expired)
+        *expired = 0;
+
+    flexnode* node = map_get_concurrent(&cache->kv_map, key);
+    if(!node || fnode_get_type(node) != SINGLE || fcache_node_expired(cache, node)){
+        if(node && expired)
+            *expired = fnode_get_type(node) == SINGLE;
+        stats_add(&cache->stats, STAT_MISSES, 1);
+        return 0;
+    }
+    stats_add(&cache->stats, STAT_HITS, 1);
+
+    if(cache->policy == APPROX_LRU){
+        time_fx now;
+        (*cache->config.funcs.now)(&now);
+        fnode_stamp(node, now);
+    }
+
+    return fnode_get_data(node);
+}
+
+FX_INLINE void* fcache_get_copy(flexcache *cache, void* key){
+
+    void* data = (void*)fcache_get_ptr(cache, key);
+    const copy_func* copy = cache->config.funcs.copy_func;
+    return data ? (*copy)(data) : 0;
+}
+
+long fcache_ttl_ms(flexcache *cache, void* key, long* total_ms){
+
+    flexnode* node = fcache_live_node(cache, key, 0);
+    if(!node)
+        return -2;
+    if(!fnode_is_volatile(node))
+        return -1;
+
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+    unsigned long long now_ms = time_fx_to_ms(now);
+    twheel_time expires = fnode_expire_ms(node);
+
+    if(total_ms)
+        *total_ms = fnode_get_ttl(node);
+    return expires > now_ms ? (long)(expires - now_ms) : 0;
+}
+
+static flexnode* fcache_remove_internal(flexcache *cache, void* key){
+    
+    if(!map_contains(&cache->kv_map, key)){
+        return 0;
+    }
+
+    flexnode* node = map_remove(&cache->kv_map, key);
+    if(!node){
+        return node;
+    }
+    if(fnode_in_window(node))
+        cache->window_memory -= fcache_entry_cost(node);
+    if(cache->policy == SLRU)
+        fcache_slru_unlink(cache, node);
+    dllist_remove(fcache_node_list(cache, node), node);
+    evict_pool_forget(&cache->pool, node);
+    twheel_remove(&cache->ttl_wheel, fnode_ttl_hook(node));
+
+    size_fx len = fcache_entry_cost(node);
+    cache->overhead_memory -= fnode_get_overhead(node);
+
+    if(fnode_is_volatile(node)){
+        cache->config.volatilememory -= len;
+    } else{
+        cache->config.nonvolatilememory -= len;
+    }
+
+    return node;
+}
+
+void* fcache_remove(flexcache *cache, void* key){
+    
+    flexnode* node = fcache_remove_internal(cache, key);
+    if(!node){
+        //not in memory, maybe on disk... nothing to hand back from there
+        if(cache->l2 && fcache_l2_key_len(cache, key))
+            l2_remove(cache->l2, key, fcache_l2_key_len(cache, key));
+        return 0;
+    }
+
+    fcache_repl_log(cache, REPL_DEL, node);
+    return fcache_release_node(cache, node);
+}   
+
+size_fx fcache_mget(flexcache *cache, void** keys, size_fx n, const void** values){
+
+    //nodes go through the values array... same size, no extra buffer
+    flexnode** nodes = (flexnode**)values;
+    map_get_many(&cache->kv_map, keys, n, nodes);
+
+    time_fx now;
+    bool_t has_now = 0;
+    size_fx found = 0;
+
+    for(size_fx i = 0; i < n; i++){
+        flexnode* node = nodes[i];
+        if(node && fcache_node_expired(cache, node)){
+            fcache_expire_node(cache, node, &cache->pending);
+            values[i] = 0;
+            node = 0;
+        }
+        if(node && fnode_get_type(node) != SINGLE){
+            values[i] = 0;
+            node = 0;
+        }
+        if(!node){
+            if(cache->policy == WTINYLFU)
+                fcache_record_access(cache, keys[i]);
+            continue;
+        }
+
+        fcache_touch(cache, node, &now, &has_now);
+        values[i] = fnode_get_data(node);
+        found++;
+    }
+
+    stats_add(&cache->stats, STAT_HITS, found);
+    stats_add(&cache->stats, STAT_MISSES, n - found);
+    return found;
+}
+
+// stored (OPTIONAL) gets which values the cache took
+static stack_fx* fcache_mset_internal(flexcache *cache, void** keys, const void** values, size_fx n,
+                                        set_option* options, bool_t* stored){
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    stack_fx* removed = 0;
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    for(size_fx i = 0; i < n; i++){
+        bool_t ok = set_internal(cache, keys[i], values[i], options, &removed_list);
+        if(stored)
+            stored[i] = ok;
+        if(!fcache_has_removed(cache, &removed_list))
+            continue;
+
+        if(!removed)
+            removed = stack_new(allocator);
+        fcache_clear_removed_list_to_stack(cache, &removed_list, removed);
+    }
+
+    return removed;
+}
+
+stack_fx* fcache_mset(flexcache *cache, void** keys, const void** values, size_fx n, set_option* options){
+    return fcache_mset_internal(cache, keys, values, n, options, 0);
+}
+
+stack_fx* fcache_mdel(flexcache *cache, void** keys, size_fx n){
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    stack_fx* removed = 0;
+
+    for(size_fx i = 0; i < n; i++){
+        flexnode* node = fcache_remove_internal(cache, keys[i]);
+        if(!node){
+            if(cache->l2 && fcache_l2_key_len(cache, keys[i]))
+                l2_remove(cache->l2, keys[i], fcache_l2_key_len(cache, keys[i]));
+            continue;
+        }
+
+        fcache_repl_log(cache, REPL_DEL, node);
+        if(!removed)
+            removed = stack_new(allocator);
+        stack_push(removed, fcache_release_node(cache, node));
+    }
+
+    return removed;
+}
+
+size_fx fcache_repl_drain(flexcache *cache, void* buf, size_fx capacity){
+    return cache->repl ? repl_drain(cache->repl, buf, capacity) : 0;
+}
+
+// consecutive records of one kind (and one expiry for sets) replayed together
+typedef struct fcache_repl_batch{
+    unsigned char       op; //REPL_SET, or REPL_DEL for deletes and expiries
+    unsigned long long  expires;
+    size_fx             n;
+    void*               keys[FCACHE_REPL_BATCH];
+    const void*         values[FCACHE_REPL_BATCH];
+    size_fx             lens[FCACHE_REPL_BATCH];
+} fcache_repl_batch;
+
+static void fcache_repl_free_values(stack_fx* values, free_fx* cb_free){
+
+    if(!values)
+        return;
+    while(stack_size(values) > 0){
+        void* data = stack_pop(values);
+        if(data && cb_free)
+            (*cb_free)(data);
+    }
+    stack_free(values);
+}
+
+static size_fx fcache_repl_flush(flexcache *cache, fcache_repl_batch* batch, free_fx* cb_free){
+
+    size_fx n = batch->n;
+    batch->n = 0;
+    if(n == 0)
+        return 0;
+
+    if(batch->op != REPL_SET){
+        fcache_repl_free_values(fcache_mdel(cache, batch->keys, n), cb_free);
+        return n;
+    }
+
+    set_option options = {0};
+    if(batch->expires){
+        time_fx now;
+        (*cache->config.funcs.now)(&now);
+        unsigned long long now_ms = time_fx_to_ms(now);
+        //gone on the primary too, its expiry records follow
+        if(batch->expires <= now_ms)
+            return 0;
+        options.PX = (long)(batch->expires - now_ms);
+    }
+
+    //inline values are copied by the node, the others need a value of their own
+    size_fx count = 0;
+    for(size_fx i = 0; i < n; i++){
+        const void* value = batch->values[i];
+        if(batch->lens[i] > cache->inline_max)
+            value = (*cache->config.funcs.copy_func)((void*)value);
+        if(!value)
+            continue;
+        batch->keys[count] = batch->keys[i];
+        batch->values[count] = value;
+        batch->lens[count] = batch->lens[i];
+        count++;
+    }
+
+    bool_t stored[FCACHE_REPL_BATCH];
+    stack_fx* evicted = fcache_mset_internal(cache, batch->keys, batch->values, count, &options, stored);
+
+    size_fx applied = 0;
+    for(size_fx i = 0; i < count; i++){
+        if(stored[i])
+            applied++;
+        else if(batch->lens[i] > cache->inline_max && cb_free)
+            (*cb_free)((void*)batch->values[i]);
+    }
+    fcache_repl_free_values(evicted, cb_free);
+    return applied;
+}
+
+size_fx fcache_repl_apply(flexcache *cache, const void* buf, size_fx len, free_fx* cb_free){
+
+    fcache_repl_batch batch;
+    batch.op = 0;
+    batch.expires = 0;
+    batch.n = 0;
+
+    size_fx applied = 0;
+    size_fx offset = 0;
+    repl_record record;
+    while(repl_next(buf, len, &offset, &record)){
+        if(record.op != REPL_SET && record.op != REPL_DEL && record.op != REPL_EXPIRE)
+            continue;
+
+        //the node copies the key, a longer one would keep pointing into buf
+        unsigned char op = record.op == REPL_SET ? REPL_SET : REPL_DEL;
+        if(op == REPL_SET && (record.key_len > cache->inline_max || record.value_len > cache->config.maxmemory))
+            continue;
+
+        unsigned long long expires = op == REPL_SET ? record.expires : 0;
+        if(batch.n && (batch.op != op || batch.expires != expires || batch.n == FCACHE_REPL_BATCH))
+            applied += fcache_repl_flush(cache, &batch, cb_free);
+
+        batch.op = op;
+        batch.expires = expires;
+        batch.keys[batch.n] = (void*)record.key;
+        batch.values[batch.n] = record.value;
+        batch.lens[batch.n] = record.value_len;
+        batch.n++;
+    }
+
+    return applied + fcache_repl_flush(cache, &batch, cb_free);
+}
+
+size_fx fcache_range(flexcache *cache, const void* lo, const void* hi, fcache_scan_cb cb, void* aux_data){
+
+    map_fx* map = &cache->kv_map;
+    const cmp_func* compare = cache->config.funcs.compare;
+    bool_t ordered = map_ordered(map);
+    size_fx count = 0;
+
+    map_cursor cursor;
+    for(flexnode* node = map_seek(map, &cursor, lo); node; node = map_cursor_next(map, &cursor)){
+        const void* key = fnode_get_key(node);
+
+        if(hi && (*compare)(key, hi) >= 0){
+            if(ordered)
+                break;
+            continue;
+        }
+        if(!ordered && lo && (*compare)(key, lo) < 0)
+            continue;
+
+        if(fnode_get_type(node) != SINGLE)
+            continue;
+
+        count++;
+        if(!cb(key, fnode_get_data(node), aux_data))
+            break;
+    }
+
+    return count;
+}
+
+// the prefix sorts before every key it starts, so the walk begins at its lower bound and ends
+// at the first key without it
+size_fx fcache_prefix(flexcache *cache, const void* prefix, size_fx prefix_len, fcache_scan_cb cb, void* aux_data){
+
+    map_fx* map = &cache->kv_map;
+    const len_func* key_length = cache->config.funcs.key_len;
+    if(!key_length)
+        return 0;
+
+    bool_t ordered = map_ordered(map);
+    size_fx count = 0;
+
+    map_cursor cursor;
+    for(flexnode* node = map_seek(map, &cursor, prefix); node; node = map_cursor_next(map, &cursor)){
+        void* key = (void*)fnode_get_key(node);
+
+        if((*key_length)(key) < prefix_len || memcmp(key, prefix, prefix_len) != 0){
+            if(ordered)
+                break;
+            continue;
+        }
+
+        if(fnode_get_type(node) != SINGLE)
+            continue;
+
+        count++;
+        if(!cb(key, fnode_get_data(node), aux_data))
+            break;
+    }
+
+    return count;
+}
+
+// Predicate search: the index is cut in FCACHE_FIND_CHUNKS chunks per worker so a slow range does not
+// hold the others, workers take the next chunk from a shared counter and push matches in a bounded
+// queue the caller drains. Without workers fcache_find_next walks the single chunk itself.
+#define FCACHE_FIND_CHUNKS  4
+#define FCACHE_FIND_QUEUE   256
+
+typedef struct fcache_find_chunk{
+    map_cursor      cursor;
+    flexnode*       first;
+    flexnode*       end; //first node of the next chunk, 0 for the last one
+} fcache_find_chunk;
+
+struct fcache_find_iter{
+    flexcache*          cache;
+    pred*               match;
+    void*               aux_data;
+
+    fcache_find_chunk*  chunks;
+    size_fx             n_chunks;
+    _Atomic size_fx     next_chunk;
+    _Atomic int         stop;
+
+    pthread_t*          workers;
+    size_fx             n_workers;
+    size_fx             running;
+
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+    flexnode*           queue[FCACHE_FIND_QUEUE];
+    size_fx             head;
+    size_fx             count;
+};
+
+static FX_INLINE bool_t fcache_find_test(fcache_find_iter* iter, flexnode* node){
+    return fnode_get_type(node) == SINGLE && iter->match(fnode_get_key(node), fnode_get_data(node), iter->aux_data);
+}
+
+//0 when the search was stopped
+static bool_t fcache_find_emit(fcache_find_iter* iter, flexnode* node){
+
+    pthread_mutex_lock(&iter->lock);
+    while(iter->count == FCACHE_FIND_QUEUE && !atomic_load(&iter->stop))
+        pthread_cond_wait(&iter->not_full, &iter->lock);
+
+    bool_t ok = !atomic_load(&iter->stop);
+    if(ok){
+        iter->queue[(iter->head + iter->count) % FCACHE_FIND_QUEUE] = node;
+        iter->count++;
+        pthread_cond_signal(&iter->not_empty);
+    }
+    pthread_mutex_unlock(&iter->lock);
+
+    return ok;
+}
+
+static void* fcache_find_worker(void* arg){
+
+    fcache_find_iter* iter = arg;
+    map_fx* map = &iter->cache->kv_map;
+
+    for(;;){
+        size_fx index = atomic_fetch_add(&iter->next_chunk, 1);
+        if(index >= iter->n_chunks)
+            break;
+
+        fcache_find_chunk* chunk = iter->chunks + index;
+        for(flexnode* node = chunk->first; node && node != chunk->end; node = map_cursor_next(map, &chunk->cursor)){
+            if(atomic_load_explicit(&iter->stop, memory_order_relaxed))
+                goto done;
+            if(fcache_find_test(iter, node) && !fcache_find_emit(iter, node))
+                goto done;
+        }
+    }
+
+done:
+    pthread_mutex_lock(&iter->lock);
+    iter->running--;
+    pthread_cond_broadcast(&iter->not_empty);
+    pthread_mutex_unlock(&iter->lock);
+
+    return 0;
+}
+
+static void fcache_find_destroy(fcache_find_iter* iter){
+
+    const allocator_fx* allocator = iter->cache->config.funcs.allocator;
+
+    pthread_mutex_destroy(&iter->lock);
+    pthread_cond_destroy(&iter->not_empty);
+    pthread_cond_destroy(&iter->not_full);
+    (*allocator->free)(iter->workers);
+    (*allocator->free)(iter->chunks);
+    (*allocator->free)(iter);
+}
+
+fcache_find_iter* fcache_find_all(flexcache *cache, pred* match, void* aux_data){
+
+    const allocator_fx* allocator = cache->config.funcs.allocator;
+    size_fx workers = cache->search_threads > 1 ? cache->search_threads : 0;
+    size_fx parts = workers ? workers * FCACHE_FIND_CHUNKS : 1;
+
+    fcache_find_iter* iter = (*allocator->alloc)(sizeof(fcache_find_iter));
+    if(!iter)
+        return 0;
+
+    iter->cache = cache;
+    iter->match = match;
+    iter->aux_data = aux_data;
+    iter->workers = 0;
+    iter->n_workers = 0;
+    iter->running = 0;
+    iter->head = 0;
+    iter->count = 0;
+    atomic_init(&iter->next_chunk, 0);
+    atomic_init(&iter->stop, 0);
+    pthread_mutex_init(&iter->lock, 0);
+    pthread_cond_init(&iter->not_empty, 0);
+    pthread_cond_init(&iter->not_full, 0);
+
+    iter->chunks = (*allocator->alloc)(parts * sizeof(fcache_find_chunk));
+    map_cursor* cursors = (*allocator->alloc)(parts * sizeof(map_cursor));
+    flexnode** firsts = (*allocator->alloc)(parts * sizeof(flexnode*));
+    if(workers)
+        iter->workers = (*allocator->alloc)(workers * sizeof(pthread_t));
+
+    if(!iter->chunks || !cursors || !firsts || (workers && !iter->workers)){
+        (*allocator->free)(cursors);
+        (*allocator->free)(firsts);
+        fcache_find_destroy(iter);
+        return 0;
+    }
+
+    iter->n_chunks = map_split(&cache->kv_map, parts, cursors, firsts);
+    for(size_fx i = 0; i < iter->n_chunks; i++){
+        iter->chunks[i].cursor = cursors[i];
+        iter->chunks[i].first = firsts[i];
+        iter->chunks[i].end = i + 1 < iter->n_chunks ? firsts[i + 1] : 0;
+    }
+    (*allocator->free)(cursors);
+    (*allocator->free)(firsts);
+
+    if(iter->n_chunks < 2)
+        return iter; //nothing to share, searched by fcache_find_next
+
+    if(workers > iter->n_chunks)
+        workers = iter->n_chunks;
+
+    pthread_mutex_lock(&iter->lock);
+    for(; iter->n_workers < workers; iter->n_workers++){
+        if(pthread_create(iter->workers + iter->n_workers, 0, fcache_find_worker, iter) != 0)
+            break;
+        iter->running++;
+    }
+    pthread_mutex_unlock(&iter->lock);
+
+    //no thread at all: the caller walks the chunks
+    return iter;
+}
+
+static flexnode* fcache_find_walk(fcache_find_iter* iter){
+
+    map_fx* map = &iter->cache->kv_map;
+
+    while(atomic_load(&iter->next_chunk) < iter->n_chunks){
+        fcache_find_chunk* chunk = iter->chunks + atomic_load(&iter->next_chunk);
+
+        for(flexnode* node = chunk->first; node && node != chunk->end; ){
+            flexnode* next = map_cursor_next(map, &chunk->cursor);
+            chunk->first = next;
+            if(fcache_find_test(iter, node))
+                return node;
+            node = next;
+        }
+
+        atomic_fetch_add(&iter->next_chunk, 1);
+    }
+
+    return 0;
+}
+
+const void* fcache_find_next(fcache_find_iter* iter, const void** key){
+
+    flexnode* node = 0;
+
+    if(iter->n_workers == 0){
+        node = fcache_find_walk(iter);
+    } else{
+        pthread_mutex_lock(&iter->lock);
+        while(iter->count == 0 && iter->running > 0)
+            pthread_cond_wait(&iter->not_empty, &iter->lock);
+
+        if(iter->count > 0){
+            node = iter->queue[iter->head];
+            iter->head = (iter->head + 1) % FCACHE_FIND_QUEUE;
+            iter->count--;
+            pthread_cond_signal(&iter->not_full);
+        }
+        pthread_mutex_unlock(&iter->lock);
+    }
+
+    if(!node)
+        return 0;
+
+    if(key)
+        *key = fnode_get_key(node);
+    return fnode_get_data(node);
+}
+
+void fcache_find_end(fcache_find_iter* iter){
+
+    pthread_mutex_lock(&iter->lock);
+    atomic_store(&iter->stop, 1);
+    pthread_cond_broadcast(&iter->not_full);
+    pthread_mutex_unlock(&iter->lock);
+
+    for(size_fx i = 0; i < iter->n_workers; i++)
+        pthread_join(iter->workers[i], 0);
+
+    fcache_find_destroy(iter);
+}
+
+const void* fcache_find_any(flexcache *cache, pred* match, void* aux_data){
+
+    fcache_find_iter* iter = fcache_find_all(cache, match, aux_data);
+    if(!iter)
+        return 0;
+
+    const void* value = fcache_find_next(iter, 0);
+    fcache_find_end(iter);
+
+    return value;
+}
+
+// LIST and MAP values, changed in place: no copy of the whole value and no new node, the node
+// size and the memory accounting follow each change.
+
+// node of key holding type, or a new empty one when create is set (options as for fcache_set,
+// NX and XX ignored)... 0 when key holds another type
+static flexnode* fcache_container(flexcache *cache, void* key, node_type type, bool_t create,
+                                    set_option* options, dllist_fx* removed_list){
+
+    flexnode* node = fcache_live_node(cache, key, removed_list);
+    if(node)
+        return fnode_get_type(node) == type ? node : 0;
+    if(!create)
+        return 0;
+
+    const data_aux_funcs_t* funcs = &cache->config.funcs;
+    if(type == MAP && (!funcs->hash || !funcs->key_len))
+        return 0;
+
+    void* container = type == LIST ? (void*)flist_new(funcs->allocator)
+                                    : (void*)fmap_new(funcs->hash, funcs->compare, funcs->allocator);
+    if(!container)
+        return 0;
+
+    set_option create_options = {0};
+    if(options)
+        create_options = *options;
+    create_options.NX = 0;
+    create_options.XX = 0;
+
+    if(!store_internal(cache, key, container, 0, type, &create_options, removed_list)){
+        if(type == LIST)
+            flist_free(container);
+        else
+            fmap_free(container);
+        return 0;
+    }
+
+    return map_get(&cache->kv_map, key);
+}
+
+static FX_INLINE void fcache_report_removed(flexcache *cache, dllist_fx* removed_list, free_fx* cb_free){
+
+    if(fcache_has_removed(cache, removed_list))
+        fcache_clear_removed_list_call_cb(cache, removed_list, cb_free);
+}
+
+// container changed size: node size and accounting, then what a growth pushed over maxmemory
+// is evicted (fcache_tick does it on deferred caches)
+static void fcache_container_resize(flexcache *cache, flexnode* node, size_fx size, free_fx* cb_free){
+
+    size_fx old_size = fnode_get_size(node);
+    fnode_set_size(node, size);
+
+    size_t* used = fnode_is_volatile(node) ? &cache->config.volatilememory : &cache->config.nonvolatilememory;
+    *used = *used - old_size + size;
+    if(fnode_in_window(node))
+        cache->window_memory = cache->window_memory - old_size + size;
+    if(fnode_is_protected(node))
+        cache->protected_memory = cache->protected_memory - old_size + size;
+
+    size_fx over = fcache_over_memory(cache);
+    if(size <= old_size || cache->deferred || over == 0)
+        return;
+
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+    fcache_evict(cache, over, now, &removed_list);
+    fcache_report_removed(cache, &removed_list, cb_free);
+}
+
+//the last element went away: so does the key
+static void fcache_container_drop(flexcache *cache, flexnode* node){
+
+    node = fcache_remove_internal(cache, (void*)fnode_get_key(node));
+    if(node)
+        fcache_dispose_node(cache, node);
+}
+
+size_fx fcache_lpush(flexcache *cache, void* key, const void* value, bool_t front, set_option* options, free_fx* cb_free){
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    flexnode* node = fcache_container(cache, key, LIST, 1, options, &removed_list);
+    fcache_report_removed(cache, &removed_list, cb_free);
+    if(!node)
+        return 0;
+
+    flist_fx* list = (flist_fx*)fnode_get_data(node);
+    if(!flist_push(list, value, (*cache->config.funcs.len_func)((void*)value), front)){
+        if(flist_len(list) == 0)
+            fcache_container_drop(cache, node);
+        return 0;
+    }
+
+    time_fx now;
+    fcache_touch(cache, node, &now, 0);
+
+    size_fx len = flist_len(list);
+    fcache_container_resize(cache, node, flist_bytes(list), cb_free);
+    return len;
+}
+
+void* fcache_lpop(flexcache *cache, void* key, bool_t front){
+
+    flexnode* node = fcache_container(cache, key, LIST, 0, 0, 0);
+    if(!node)
+        return 0;
+
+    flist_fx* list = (flist_fx*)fnode_get_data(node);
+    fvalue_bytes* bytes = flist_pop(list, front);
+    if(!bytes)
+        return 0;
+
+    void* value = (*cache->config.funcs.copy_func)(bytes->data);
+    (*cache->config.funcs.allocator->free)(bytes);
+
+    if(flist_len(list) == 0){
+        fcache_container_drop(cache, node);
+        return value;
+    }
+
+    time_fx now;
+    fcache_touch(cache, node, &now, 0);
+    fcache_container_resize(cache, node, flist_bytes(list), 0);
+
+    return value;
+}
+
+size_fx fcache_llen(flexcache *cache, void* key){
+
+    flexnode* node = fcache_container(cache, key, LIST, 0, 0, 0);
+    return node ? flist_len((flist_fx*)fnode_get_data(node)) : 0;
+}
+
+size_fx fcache_lrange(flexcache *cache, void* key, long start, long stop, const void** values, size_fx capacity){
+
+    flexnode* node = fcache_container(cache, key, LIST, 0, 0, 0);
+    if(!node)
+        return 0;
+
+    const flist_fx* list = (flist_fx*)fnode_get_data(node);
+    long len = (long)flist_len(list);
+
+    if(start < 0)
+        start = len + start < 0 ? 0 : len + start;
+    if(stop < 0)
+        stop = len + stop;
+    if(stop >= len)
+        stop = len - 1;
+
+    size_fx count = 0;
+    for(long i = start; i <= stop && count < capacity; i++)
+        values[count++] = flist_at(list, (size_fx)i)->data;
+
+    time_fx now;
+    fcache_touch(cache, node, &now, 0);
+    return count;
+}
+
+bool_t fcache_hset(flexcache *cache, void* key, const void* field, const void* value, set_option* options, free_fx* cb_free){
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    flexnode* node = fcache_container(cache, key, MAP, 1, options, &removed_list);
+    fcache_report_removed(cache, &removed_list, cb_free);
+    if(!node)
+        return 0;
+
+    const data_aux_funcs_t* funcs = &cache->config.funcs;
+    fmap_fx* map = (fmap_fx*)fnode_get_data(node);
+    if(!fmap_set(map, field, (*funcs->key_len)((void*)field), value, (*funcs->len_func)((void*)value))){
+        if(fmap_len(map) == 0)
+            fcache_container_drop(cache, node);
+        return 0;
+    }
+
+    time_fx now;
+    fcache_touch(cache, node, &now, 0);
+    fcache_container_resize(cache, node, fmap_bytes(map), cb_free);
+    return 1;
+}
+
+const void* fcache_hget(flexcache *cache, void* key, const void* field){
+
+    flexnode* node = fcache_container(cache, key, MAP, 0, 0, 0);
+    if(!node)
+        return 0;
+
+    const fvalue_bytes* bytes = fmap_get((fmap_fx*)fnode_get_data(node), field);
+    if(!bytes)
+        return 0;
+
+    time_fx now;
+    fcache_touch(cache, node, &now, 0);
+    return bytes->data;
+}
+
+bool_t fcache_hdel(flexcache *cache, void* key, const void* field){
+
+    flexnode* node = fcache_container(cache, key, MAP, 0, 0, 0);
+    if(!node)
+        return 0;
+
+    fmap_fx* map = (fmap_fx*)fnode_get_data(node);
+    if(!fmap_del(map, field))
+        return 0;
+
+    if(fmap_len(map) == 0)
+        fcache_container_drop(cache, node);
+    else
+        fcache_container_resize(cache, node, fmap_bytes(map), 0);
+
+    return 1;
+}
+
+size_fx fcache_hlen(flexcache *cache, void* key){
+
+    flexnode* node = fcache_container(cache, key, MAP, 0, 0, 0);
+    return node ? fmap_len((fmap_fx*)fnode_get_data(node)) : 0;
+}
+
+// Snapshot file: header, then one record per node in eviction list order (the next victim first,
+// the WTINYLFU window after the main list), each record followed by the key and value bytes and
+// padded to 8 bytes. A LIST value is its elements front to back, a MAP value its field, value pairs,
+// each item its length (8 bytes) then its bytes padded to 8.
+// Native endianness, the file is read through mmap and is only meant for a restart on the same kind of host.
+#define FCACHE_SNAP_MAGIC   "FXSNAP\0"
+#define FCACHE_SNAP_VERSION 3
+
+#define FCACHE_SNAP_ALIGN(size) (((size) + 7) & ~(size_fx)7)
+#define FCACHE_SNAP_ITEM(size)  (sizeof(unsigned long long) + FCACHE_SNAP_ALIGN(size))
+
+typedef struct fcache_snap_header{
+    char                magic[8];
+    unsigned int        version;
+    unsigned int        record_size;
+    unsigned long long  count;
+} fcache_snap_header;
+
+typedef struct fcache_snap_record{
+    unsigned long long  key_len;
+    unsigned long long  value_len;
+    long long           epoch_sec;
+    long long           epoch_nsec;
+    long long           lst_used_sec;
+    long long           lst_used_nsec;
+    long long           exp_ms; //ttl from epoch, -1 for non volatile
+    long long           times_used;
+    unsigned int        freq;
+    unsigned int        freq_ldt;
+    unsigned int        type; //node_type
+    unsigned int        flags; //FCACHE_SNAP_PROTECTED
+} fcache_snap_record;
+
+//SLRU protected segment, the other records are probationary
+#define FCACHE_SNAP_PROTECTED 1u
+
+static int fcache_snap_write(FILE* file, const void* data, size_fx len){
+
+    static const char zeros[8] = {0};
+
+    if(len && fwrite(data, 1, len, file) != len)
+        return 0;
+
+    size_fx pad = FCACHE_SNAP_ALIGN(len) - len;
+    return pad == 0 || fwrite(zeros, 1, pad, file) == pad;
+}
+
+static int fcache_snap_write_item(FILE* file, const void* data, size_fx len){
+
+    unsigned long long item_len = len;
+    return fwrite(&item_len, sizeof(item_len), 1, file) == 1 && fcache_snap_write(file, data, len);
+}
+
+//value bytes of a LIST or MAP record
+static size_fx fcache_snap_container_len(flexnode* node){
+
+    size_fx len = 0;
+
+    if(fnode_get_type(node) == LIST){
+        const flist_fx* list = (const flist_fx*)fnode_get_data(node);
+        for(size_fx i = 0; i < flist_len(list); i++)
+            len += FCACHE_SNAP_ITEM(flist_at(list, i)->len);
+        return len;
+    }
+
+    const fmap_fx* map = (const fmap_fx*)fnode_get_data(node);
+    size_fx cursor = 0;
+    size_fx field_len;
+    const fvalue_bytes* value;
+    while(fmap_next(map, &cursor, &field_len, &value))
+        len += FCACHE_SNAP_ITEM(field_len) + FCACHE_SNAP_ITEM(value->len);
+    return len;
+}
+
+static int fcache_snap_write_container(FILE* file, flexnode* node){
+
+    if(fnode_get_type(node) == LIST){
+        const flist_fx* list = (const flist_fx*)fnode_get_data(node);
+        for(size_fx i = 0; i < flist_len(list); i++){
+            const fvalue_bytes* item = flist_at(list, i);
+            if(!fcache_snap_write_item(file, item->data, item->len))
+                return 0;
+        }
+        return 1;
+    }
+
+    const fmap_fx* map = (const fmap_fx*)fnode_get_data(node);
+    size_fx cursor = 0;
+    size_fx field_len;
+    const fvalue_bytes* value;
+    for(const void* field; (field = fmap_next(map, &cursor, &field_len, &value)) != 0;){
+        if(!fcache_snap_write_item(file, field, field_len) || !fcache_snap_write_item(file, value->data, value->len))
+            return 0;
+    }
+    return 1;
+}
+
+static int fcache_snap_write_list(flexcache* cache, FILE* file, dllist_fx* list, unsigned long long* count){
+
+    const len_func* key_length = cache->config.funcs.key_len;
+    const len_func* length = cache->config.funcs.len_func;
+
+    for(flexnode* iter = dllist_iter(list); iter; iter = dllist_next(iter)){
+        metadata_t* meta = fnode_get_metadata(iter);
+        node_type type = fnode_get_type(iter);
+        void* key = (void*)fnode_get_key(iter);
+        void* data = (void*)fnode_get_data(iter);
+        time_fx epoch = fnode_get_epoch(iter);
+        time_fx lst_used = fnode_get_lst_used(iter);
+
+        fcache_snap_record record = {
+            (*key_length)(key), type == SINGLE ? (*length)(data) : fcache_snap_container_len(iter),
+            epoch.tv_sec, epoch.tv_nsec,
+            lst_used.tv_sec, lst_used.tv_nsec,
+            fnode_get_ttl(iter), meta->times_used,
+            meta->freq, meta->freq_ldt,
+            type, fnode_is_protected(iter) ? FCACHE_SNAP_PROTECTED : 0
+        };
+
+        if(fwrite(&record, sizeof(record), 1, file) != 1 || !fcache_snap_write(file, key, record.key_len))
+            return 0;
+        if(type == SINGLE ? !fcache_snap_write(file, data, record.value_len) : !fcache_snap_write_container(file, iter))
+            return 0;
+        (*count)++;
+    }
+
+    return 1;
+}
+
+int fcache_snapshot(flexcache* cache, const char* path){
+
+    if(!cache->config.funcs.key_len)
+        return 0;
+
+    //written aside and renamed, a crash never leaves a half snapshot under path
+    char tmp_path[4096];
+    if(snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+        return 0;
+
+    FILE* file = fopen(tmp_path, "wb");
+    if(!file)
+        return 0;
+
+    fcache_snap_header header = {FCACHE_SNAP_MAGIC, FCACHE_SNAP_VERSION, sizeof(fcache_snap_record), 0};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    ok = ok && fcache_snap_write_list(cache, file, &cache->evic_list, &header.count)
+            && fcache_snap_write_list(cache, file, &cache->window, &header.count);
+
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+
+    if(ok && rename(tmp_path, path) == 0)
+        return 1;
+
+    remove(tmp_path);
+    return 0;
+}
+
+// saved metadata over the fresh node, the ttl wheel slot follows the saved expiry... protected
+// records come after the probationary ones and go back to the protected MRU end in that order
+static bool_t fcache_restore_meta(flexcache* cache, const fcache_snap_record* record, flexnode* node){
+
+    if(cache->policy == SLRU && (record->flags & FCACHE_SNAP_PROTECTED))
+        fcache_slru_touch(cache, node);
+
+    time_fx epoch = {record->epoch_sec, record->epoch_nsec};
+    time_fx lst_used = {record->lst_used_sec, record->lst_used_nsec};
+    fnode_restore(node, epoch, lst_used, record->times_used, record->freq, record->freq_ldt);
+
+    if(fnode_is_volatile(node)){
+        twheel_remove(&cache->ttl_wheel, fnode_ttl_hook(node));
+        twheel_add(&cache->ttl_wheel, fnode_ttl_hook(node), fnode_expire_ms(node));
+    }
+
+    return 1;
+}
+
+//next item of a LIST / MAP record value, 0 past its end or on a bad length
+static char* fcache_restore_item(char** items, const char* end){
+
+    if((size_fx)(end - *items) < sizeof(unsigned long long))
+        return 0;
+
+    unsigned long long len = *(const unsigned long long*)*items;
+    if(len == 0 || len > (size_fx)(end - *items) || (size_fx)(end - *items) < FCACHE_SNAP_ITEM(len))
+        return 0;
+
+    char* item = *items + sizeof(unsigned long long);
+    *items += FCACHE_SNAP_ITEM(len);
+    return item;
+}
+
+//the items pushed back one by one, the first one creates the key with options... stops on the
+//first bad or refused item
+static void fcache_restore_container(flexcache* cache, const fcache_snap_record* record, void* key, char* value,
+                                        set_option* options, free_fx* cb_free){
+
+    const char* end = value + record->value_len;
+    char* items = value;
+
+    while(items < end){
+        char* item = fcache_restore_item(&items, end);
+        if(!item)
+            return;
+
+        if(record->type == LIST){
+            if(!fcache_lpush(cache, key, item, 0, options, cb_free))
+                return;
+            continue;
+        }
+
+        char* field_value = fcache_restore_item(&items, end);
+        if(!field_value || !fcache_hset(cache, key, item, field_value, options, cb_free))
+            return;
+    }
+}
+
+// One record back into the cache through the normal set path (eviction included), then the
+// saved metadata over the fresh one... the expiry is recomputed from the saved epoch.
+static bool_t fcache_restore_record(flexcache* cache, const fcache_snap_record* record, void* key, void* value,
+                                    free_fx* cb_free){
+
+    set_option options = {0};
+    options.PX = record->exp_ms > 0 ? record->exp_ms : 0;
+
+    //what got in stays even when a later item failed, 0 only when the key is not there (bad record,
+    //or evicted by its own growth): the key may point into the snapshot
+    if(record->type != SINGLE){
+        if(record->type <= MAP)
+            fcache_restore_container(cache, record, key, value, &options, cb_free);
+        flexnode* node = map_get(&cache->kv_map, key);
+        return node && fnode_get_type(node) == record->type && fcache_restore_meta(cache, record, node);
+    }
+
+    //inline values are copied by the node, the others need a value of their own
+    bool_t inline_value = record->value_len <= cache->inline_max;
+    void* data = inline_value ? value : (*cache->config.funcs.copy_func)(value);
+    if(!data)
+        return 0;
+
+    dllist_fx removed_list;
+    dllist_init(&removed_list);
+
+    bool_t stored = set_internal(cache, key, data, &options, &removed_list);
+    if(fcache_has_removed(cache, &removed_list))
+        fcache_clear_removed_list_call_cb(cache, &removed_list, cb_free);
+
+    if(!stored){
+        if(!inline_value && cb_free)
+            (*cb_free)(data);
+        return 0;
+    }
+
+    return fcache_restore_meta(cache, record, map_get(&cache->kv_map, key));
+}
+
+int fcache_load(flexcache* cache, const char* path, free_fx* cb_free){
+
+    if(cache->snap_map || !cache->config.funcs.key_len)
+        return 0;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_fx)st.st_size < sizeof(fcache_snap_header)){
+        close(fd);
+        return 0;
+    }
+
+    size_fx map_len = (size_fx)st.st_size;
+    char* map = mmap(0, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return 0;
+
+    const fcache_snap_header* header = (const fcache_snap_header*)map;
+    if(memcmp(header->magic, FCACHE_SNAP_MAGIC, sizeof(header->magic)) != 0
+        || header->version != FCACHE_SNAP_VERSION || header->record_size != sizeof(fcache_snap_record)){
+        munmap(map, map_len);
+        return 0;
+    }
+
+    madvise(map, map_len, MADV_SEQUENTIAL);
+
+    time_fx now;
+    (*cache->config.funcs.now)(&now);
+    unsigned long long now_ms = time_fx_to_ms(now);
+
+    bool_t keys_mapped = 0;
+    size_fx offset = sizeof(fcache_snap_header);
+    int ok = 1;
+
+    for(unsigned long long i = 0; i < header->count; i++){
+        if(map_len - offset < sizeof(fcache_snap_record)){
+            ok = 0;
+            break;
+        }
+
+        const fcache_snap_record* record = (const fcache_snap_record*)(map + offset);
+        size_fx key_bytes = FCACHE_SNAP_ALIGN(record->key_len);
+        size_fx value_bytes = FCACHE_SNAP_ALIGN(record->value_len);
+        if(record->key_len == 0 || map_len - offset - sizeof(fcache_snap_record) < key_bytes + value_bytes){
+            ok = 0;
+            break;
+        }
+
+        char* key = map + offset + sizeof(fcache_snap_record);
+        char* value = key + key_bytes;
+        offset += sizeof(fcache_snap_record) + key_bytes + value_bytes;
+
+        //expired while the cache was down
+        time_fx epoch = {record->epoch_sec, record->epoch_nsec};
+        if(record->exp_ms >= 0 && time_fx_to_ms(epoch) + (unsigned long long)record->exp_ms <= now_ms)
+            continue;
+
+        if(fcache_restore_record(cache, record, key, value, cb_free) && record->key_len > cache->inline_max)
+            keys_mapped = 1;
+    }
+
+    //the mapping lives as long as the cache when keys point into it
+    if(keys_mapped){
+        cache->snap_map = map;
+        cache->snap_len = map_len;
+    } else{
+        munmap(map, map_len);
+    }
+
+    return ok;
+}
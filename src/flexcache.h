@@ -12,10 +12,20 @@ typedef struct flexcache flexcache;
 
 enum EVICTION_POLICY{
     LRU,
-    LFU,
+    LFU, // logarithmic counter with decay, victims are sampled from the key index (INDEX_HASH) or the key list
     FIFO,
     TTL, 
-    RANDOM
+    RANDOM,
+    APPROX_LRU, // reads only update lst_used, victims are sampled from the key index (INDEX_HASH) or the key list
+    WTINYLFU, // new keys enter a small LRU window, leaving it they must beat the main LRU victim on
+              // a Count-Min frequency estimate (cm_sketch.h) to stay... requires funcs.hash
+    SLRU // segmented LRU: new keys are probationary, a hit moves them to the protected segment,
+         // victims come from probation first
+};
+
+enum INDEX_TYPE{
+    INDEX_RBTREE, // ordered keys, O(log n) lookups
+    INDEX_HASH    // open addressing hash table, O(1) lookups, requires funcs.hash
 };
 
 typedef struct set_option {
@@ -30,24 +40,229 @@ typedef struct set_option {
     bool_t        NX; // NX -- Only set the key if it does not already exist.
     bool_t        XX; // XX -- Only set the key if it already exists.
 
+    long          JITTER; //percent -- EX / PX get a random extra of up to this percent, keys set together expire apart.
+
 
 } set_option;
 
-void fcache_init(flexcache* cache, enum EVICTION_POLICY evic_pol, data_aux_funcs_t funcs, size_t maxmemory);
+typedef struct init_option {
+
+    enum INDEX_TYPE index; // key index backend, INDEX_RBTREE if options is NULL
+    size_fx         expected_keys; // INDEX_HASH pre-sizing, the index does not resize before this many keys
+    size_fx         evict_samples; // keys sampled per eviction by APPROX_LRU and LFU, 0 for the default (5)
+    size_fx         lfu_log_factor; // LFU counter growth, higher is slower, 0 for the default (10)
+    size_fx         lfu_decay_time; // LFU minutes per counter decrement without access, 0 for the default (1)
+    size_fx         inline_max; // keys (funcs.key_len) and values up to this size are copied into the node, 0 disables
+    bool_t          concurrent_reads; // fcache_sharded only: lock free reads with epoch reclamation, requires INDEX_HASH
+    bool_t          deferred_maintenance; // sets only admit (O(1)), expiry, eviction and frees run in fcache_tick
+    size_fx         tinylfu_keys; // WTINYLFU sketch sizing, 0 for the default (4096)... grows with the key count
+    size_fx         tinylfu_window; // WTINYLFU window share of maxmemory in percent, 0 for the default (1)
+    size_fx         slru_protected; // SLRU protected segment share of maxmemory in percent, 0 for the default (80)
+    size_fx         xfetch_delta_ms; // probabilistic early expiry on reads (XFetch): a hit on a key with ttl_left ms to live
+                                     // is reported as a miss with probability exp(-ttl_left / delta), so one caller
+                                     // reloads ahead of the others... about the reload time, 0 disables
+    size_fx         refresh_ahead; // fcache_sharded_get_or_load: a hit with less than this percent of its ttl left
+                                   // reloads the key while the other callers keep the current value, 0 disables
+    size_fx         search_threads; // fcache_find_any / fcache_find_all workers, 0 or 1 searches in the calling thread
+    const char*     l2_dir; // OPTIONAL disk tier (l2_fx.h) in this existing directory: entries evicted for memory
+                            // with keys up to inline_max are demoted to it, an L1 miss promotes them back...
+                            // requires funcs.key_len, flat values (len_func bytes, copy_func) and l2_free
+    size_fx         l2_max_bytes; // L2 segment files bound, 0 for the default (1 GiB)
+    free_fx*        l2_free; // values a promotion evicts from memory
+    size_fx         repl_log_bytes; // OPTIONAL mutation log (repl_fx.h) of this many bytes for replicas, drained with
+                                    // fcache_repl_drain... requires funcs.key_len and flat values, 0 disables
+
+} init_option;
+
+// Event counters since fcache_init (or fcache_stats_reset)... kept in per thread stripes,
+// so counting never bounces a shared line, fcache_stats sums them (relaxed, no lock needed).
+// Build with FCACHE_STATS_HISTOGRAM for get / set latency histograms.
+#define FCACHE_STATS_HIST 48
+
+typedef struct fcache_stats_t {
+
+    size_fx       hits;
+    size_fx       misses;
+    size_fx       sets; // stored keys
+    size_fx       nx_rejects; // NX set on an existing key
+    size_fx       xx_rejects; // XX set on a missing key
+    size_fx       evicted_memory; // keys evicted to make room
+    size_fx       evicted_ttl; // keys expired
+    size_fx       bytes_evicted; // entry cost (see used_memory) of both
+    size_fx       evict_ns; // time spent expiring and evicting on the set path
+    size_fx       l2_hits; // misses served by the L2 tier
+    size_fx       l2_demoted; // memory evictions written to the L2 tier
+    size_fx       repl_dropped; // mutation log records lost to a full ring, replicas must resync
+    size_fx       used_memory; // now, not a counter: value bytes plus node, index and allocator slack per entry
+    size_fx       overhead_memory; // now: the part of used_memory that is not value bytes
+#ifdef FCACHE_STATS_HISTOGRAM
+    size_fx       get_ns[FCACHE_STATS_HIST]; // bucket i: [2^i, 2^(i+1)) ns
+    size_fx       set_ns[FCACHE_STATS_HIST];
+#endif
+
+} fcache_stats_t;
+
+flexcache* fcache_new(const allocator_fx* allocator);
+
+int fcache_init(flexcache* cache, enum EVICTION_POLICY evic_pol, data_aux_funcs_t funcs, size_t maxmemory, init_option* options);
+
+void fcache_free(flexcache* cache, free_fx* cb_free);
+
+//cost of the stored entries, what maxmemory bounds (fcache_stats_t.used_memory)
+size_fx fcache_used_memory(flexcache* cache);
 
-void fcache_set_free(flexcache *cache, void* key, const void* value, set_option* options, free* cb_free);
+void fcache_set_maxmemory(flexcache* cache, size_fx maxmemory);
 
+// Maintenance for deferred_maintenance caches: expires what is due, evicts down to maxmemory
+// and frees removed nodes (cb_free on their values) until budget_us runs out.
+// Memory may run over maxmemory between two ticks, and the values set / set_free / mset replace
+// are freed here with cb_free instead of being returned. Returns 1 when nothing is left to do.
+bool_t fcache_tick(flexcache* cache, size_fx budget_us, free_fx* cb_free);
+
+// Warm restart. A snapshot holds keys, values and their metadata (epoch, ttl, times_used,
+// lst_used, LFU counter, SLRU segment) in eviction order, so fcache_load gives back the same victims.
+// Keys and values must be flat (funcs.key_len / len_func bytes at the pointer), funcs.key_len is required.
+// fcache_load maps the file and goes through the set path: expired entries are skipped, values get
+// copy_func copies (inline ones are copied into the node), LIST and MAP keys are pushed back element by
+// element (fcache_lpush / fcache_hset), keys over inline_max keep pointing into
+// the mapping until fcache_free. Values evicted while loading go to cb_free. One load per cache.
+// Values a deferred cache still holds for fcache_tick have left it already, they are not saved.
+int fcache_snapshot(flexcache* cache, const char* path);
+
+int fcache_load(flexcache* cache, const char* path, free_fx* cb_free);
+
+void fcache_stats(flexcache* cache, fcache_stats_t* stats);
+
+void fcache_stats_reset(flexcache* cache);
+
+// Lock free readers (fcache_sharded): nodes, replaced index tables and values freed through
+// fcache_set_free leave the cache through reclaim, which must wait until no reader holds them.
+// Values returned to the caller (fcache_set, fcache_remove...) are the caller's to defer.
+void fcache_set_reclaim(flexcache* cache, reclaim_fx reclaim, void* aux_data);
+
+void fcache_set_free(flexcache *cache, void* key, const void* value, set_option* options, free_fx* cb_free);
+
+//evicted and replaced values... 0 when nothing was removed, no allocation in that case
 stack_fx* fcache_set(flexcache *cache, void* key, const void* value, set_option* options);
 
+// Allocation free variants: every removed value goes to cb, or into evicted (up to capacity,
+// the count is returned)... values past capacity are freed with cb_free.
+typedef void (*fcache_evict_cb)(void* value, void* aux_data);
+
+void fcache_set_cb(flexcache *cache, void* key, const void* value, set_option* options, fcache_evict_cb cb, void* aux_data);
+
+size_fx fcache_set_buf(flexcache *cache, void* key, const void* value, set_option* options,
+                        void** evicted, size_fx capacity, free_fx* cb_free);
+
 bool_t fcache_key_exists(flexcache *cache, void* key);
 
+//ms key has left to live, -1 without a ttl, -2 when missing... total_ms (OPTIONAL) gets the whole ttl
+long fcache_ttl_ms(flexcache *cache, void* key, long* total_ms);
+
 const void* fcache_get_ptr(flexcache *cache, void* key);
 
+//value without a read: no touch, no stats, no L2 promotion and no XFetch... SINGLE values only
+const void* fcache_peek(flexcache *cache, void* key);
+
 void* fcache_get_copy(flexcache *cache, void* key);
 
-void* fcache_find_any(flexcache *cache, pred* pred, void* aux_data);
+// Zero copy reads: the value of a handle stays valid until fcache_release, even when the key is
+// evicted, expired, replaced or removed meanwhile. The node leaves the index and the memory
+// accounting at once, its memory and value go with the last handle (the value to that cb_free,
+// remove hands back a copy while handles are held). SINGLE values only, 0 on a miss.
+// Release on the thread owning the cache (the shard lock for fcache_sharded), all before fcache_free.
+typedef struct fcache_handle fcache_handle;
+
+fcache_handle* fcache_acquire(flexcache *cache, void* key);
+
+const void* fcache_handle_value(fcache_handle* handle);
+
+void fcache_release(flexcache *cache, fcache_handle* handle, free_fx* cb_free);
+
+// lookup racing the single writer, requires INDEX_HASH (always a miss with INDEX_RBTREE)...
+// only APPROX_LRU records the hit, LFU counters and list orders are left to locked reads.
+// A key past its ttl is a miss with expired (OPTIONAL) set: the writer unlinks it (fcache_key_exists).
+const void* fcache_get_ptr_concurrent(flexcache *cache, void* key, bool_t* expired);
+
+void* fcache_remove(flexcache *cache, void* key);
+
+// Batch versions, keys[i] / values[i] for i < n.
+// Lookups hash every key first and prefetch the index memory before probing.
+// fcache_mget returns how many keys were found, values[i] is 0 for a miss.
+size_fx fcache_mget(flexcache *cache, void** keys, size_fx n, const void** values);
+
+// all evictions of the batch in one stack, 0 when nothing was removed
+stack_fx* fcache_mset(flexcache *cache, void** keys, const void** values, size_fx n, set_option* options);
+
+// removed values, 0 when no key was found
+stack_fx* fcache_mdel(flexcache *cache, void** keys, size_fx n);
+
+// Replication: with init_option.repl_log_bytes every stored key, remove, memory eviction (as a
+// delete) and expiry is logged, fcache_repl_drain copies whole records (up to capacity bytes, 0
+// when there are none) for the application to send... drain may run on another thread.
+// A replica passes each drained batch to fcache_repl_apply: runs of sets go through the fcache_mset
+// path and deletes through fcache_mdel, their values and evictions to cb_free. The replica copies
+// values (copy_func, inline ones into the node), sets of keys over inline_max are skipped.
+// Returns the records applied. LIST and MAP keys are not logged.
+size_fx fcache_repl_drain(flexcache *cache, void* buf, size_fx capacity);
+
+size_fx fcache_repl_apply(flexcache *cache, const void* buf, size_fx len, free_fx* cb_free);
+
+// Ordered scans, the callback gets each key and value and returns 0 to stop... it must not change
+// the cache. Keys in [lo, hi) (a 0 bound is open) or starting with the prefix_len bytes of prefix
+// (prefix is passed to compare as a key, requires funcs.key_len). INDEX_RBTREE seeks into the tree, O(log n + k) in key order,
+// INDEX_HASH has no order and scans every key. Returns the keys handed to cb.
+typedef bool_t (*fcache_scan_cb)(const void* key, const void* value, void* aux_data);
+
+size_fx fcache_range(flexcache *cache, const void* lo, const void* hi, fcache_scan_cb cb, void* aux_data);
+
+size_fx fcache_prefix(flexcache *cache, const void* prefix, size_fx prefix_len, fcache_scan_cb cb, void* aux_data);
+
+// LIST and MAP values, updated in place. Elements, fields and values are copied into the node
+// (len_func bytes, fields key_len bytes) and die with it: evicting or removing these keys reports
+// nothing, fcache_remove returns 0. A key is created with options on its first push / field set and
+// goes away with its last element. Calls on a key holding another type fail (0). Pointers handed
+// back by lrange / hget live until the next write to that key. Plain value reads (get, mget,
+// acquire) miss these keys, scans and searches skip them.
+// cb_free gets the values evicted when the growth passes maxmemory. MAP requires funcs.hash.
+
+//returns the list length, 0 on failure
+size_fx fcache_lpush(flexcache *cache, void* key, const void* value, bool_t front, set_option* options, free_fx* cb_free);
+
+//copy_func copy of the front / back element, 0 when empty
+void* fcache_lpop(flexcache *cache, void* key, bool_t front);
+
+size_fx fcache_llen(flexcache *cache, void* key);
+
+//elements start to stop (inclusive, negative ones count from the back) into values
+size_fx fcache_lrange(flexcache *cache, void* key, long start, long stop, const void** values, size_fx capacity);
+
+bool_t fcache_hset(flexcache *cache, void* key, const void* field, const void* value, set_option* options, free_fx* cb_free);
+
+const void* fcache_hget(flexcache *cache, void* key, const void* field);
+
+bool_t fcache_hdel(flexcache *cache, void* key, const void* field);
+
+size_fx fcache_hlen(flexcache *cache, void* key);
+
+// Predicate search over every key. With search_threads > 1 the index is cut in chunks (slot ranges
+// with INDEX_HASH, key ranges with INDEX_RBTREE) shared by that many workers, pred must then be
+// thread safe and matches come in no particular order. The cache must not change until the search ends.
+typedef bool_t pred(const void* key, const void* value, void* aux_data);
+
+typedef struct fcache_find_iter fcache_find_iter;
+
+//value of a match (the workers stop on the first one), 0 when none
+const void* fcache_find_any(flexcache *cache, pred* match, void* aux_data);
+
+//streaming search: matches are handed out by fcache_find_next while the workers go on, 0 on failure
+fcache_find_iter* fcache_find_all(flexcache *cache, pred* match, void* aux_data);
+
+//next matching value (its key in key when not 0), 0 once the search is over
+const void* fcache_find_next(fcache_find_iter* iter, const void** key);
 
-stack_fx* fcache_find_all(flexcache *cache, void* key, pred* pred, void* aux_data);
+//stops the workers and frees the iterator, also before the last match
+void fcache_find_end(fcache_find_iter* iter);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,333 @@
+#ifndef __FLEXCACHE_DEFINE_H__
+#define __FLEXCACHE_DEFINE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include "commons.h"
+#include "simd_fx.h"
+
+// Header only LRU cache specialized on its key and value types at compile time.
+//
+//    FLEXCACHE_DEFINE(u64cache, unsigned long long, my_value, flexcache_hash_scalar, flexcache_eq_scalar)
+//
+// defines the type u64cache and static inline functions u64cache_new, _free, _get, _contains,
+// _set, _remove and _size. Keys and values are stored by value in one preallocated entry array
+// and HASH(key) / EQ(a, b) are expanded in place, so a lookup makes no indirect call: the index is
+// the same group probing as hashmap_fx over 32 bit entry numbers, the LRU list links entry numbers.
+// Every entry has the same size, maxmemory / sizeof(NAME_entry) gives the entry count.
+// HASH takes a key by value and returns size_fx, EQ takes two key lvalues and is nonzero if equal.
+// Fixed size string keys: wrap the buffer in a struct and use flexcache_hash_bytes / flexcache_eq_bytes.
+// Not thread safe, like flexcache.
+
+#define FXDEF_GROUP_WIDTH   SIMD_GROUP_WIDTH
+#define FXDEF_CTRL_EMPTY    ((signed char)-128)
+#define FXDEF_CTRL_DELETED  ((signed char)-2)
+#define FXDEF_NIL           0xFFFFFFFFu
+
+#define FXDEF_MAX_LOAD(cap) ((cap) - (cap) / 8)
+
+static FX_INLINE size_fx flexcache_define_mix(size_fx h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+}
+
+//FNV-1a, keys are mixed again by the cache
+static FX_INLINE size_fx flexcache_define_fnv(const void* data, size_fx len){
+
+    const unsigned char* bytes = data;
+    size_fx h = 0xcbf29ce484222325UL;
+    for(size_fx i = 0; i < len; i++){
+        h ^= bytes[i];
+        h *= 0x100000001b3UL;
+    }
+    return h;
+}
+
+#define flexcache_hash_scalar(key)  ((size_fx)(key))
+#define flexcache_eq_scalar(a, b)   ((a) == (b))
+#define flexcache_hash_bytes(key)   flexcache_define_fnv(&(key), sizeof(key))
+#define flexcache_eq_bytes(a, b)    (memcmp(&(a), &(b), sizeof(a)) == 0)
+
+#define FLEXCACHE_DEFINE(NAME, KEY_T, VAL_T, HASH, EQ)                                              \
+                                                                                                    \
+typedef struct NAME##_entry{                                                                        \
+    KEY_T           key;                                                                            \
+    VAL_T           value;                                                                          \
+    unsigned int    prev;                                                                           \
+    unsigned int    next; /*free list link while unused*/                                           \
+} NAME##_entry;                                                                                     \
+                                                                                                    \
+/*one allocation: header, entries, index, control bytes*/                                          \
+typedef struct NAME{                                                                                \
+    NAME##_entry*           entries;                                                                \
+    unsigned int*           index; /*entry number of each full slot*/                               \
+    signed char*            ctrl;                                                                   \
+    size_fx                 capacity; /*index slots, power of two*/                                 \
+    size_fx                 growth_left;                                                            \
+    size_fx                 max_entries;                                                            \
+    size_fx                 size;                                                                   \
+    unsigned int            head; /*least recently used, next victim*/                              \
+    unsigned int            tail;                                                                   \
+    unsigned int            free_head;                                                              \
+    const allocator_fx*     allocator;                                                              \
+} NAME;                                                                                             \
+                                                                                                    \
+static FX_INLINE NAME* NAME##_new(const allocator_fx* allocator, size_fx maxmemory){                \
+                                                                                                    \
+    size_fx max_entries = maxmemory / sizeof(NAME##_entry);                                         \
+    if(max_entries >= FXDEF_NIL)                                                                    \
+        max_entries = FXDEF_NIL - 1;                                                                \
+                                                                                                    \
+    size_fx capacity = FXDEF_GROUP_WIDTH;                                                           \
+    while(FXDEF_MAX_LOAD(capacity) < max_entries)                                                   \
+        capacity <<= 1;                                                                             \
+                                                                                                    \
+    NAME* cache = (*allocator->alloc)(sizeof(NAME) + max_entries * sizeof(NAME##_entry)             \
+                                        + capacity * (sizeof(unsigned int) + 1));                   \
+    if(!cache)                                                                                      \
+        return 0;                                                                                   \
+                                                                                                    \
+    cache->entries = (NAME##_entry*)(cache + 1);                                                    \
+    cache->index = (unsigned int*)(cache->entries + max_entries);                                   \
+    cache->ctrl = (signed char*)(cache->index + capacity);                                          \
+    cache->capacity = capacity;                                                                     \
+    cache->growth_left = FXDEF_MAX_LOAD(capacity);                                                  \
+    cache->max_entries = max_entries;                                                               \
+    cache->size = 0;                                                                                \
+    cache->head = FXDEF_NIL;                                                                        \
+    cache->tail = FXDEF_NIL;                                                                        \
+    cache->allocator = allocator;                                                                   \
+                                                                                                    \
+    for(size_fx i = 0; i < capacity; i++)                                                           \
+        cache->ctrl[i] = FXDEF_CTRL_EMPTY;                                                          \
+                                                                                                    \
+    cache->free_head = max_entries ? 0 : FXDEF_NIL;                                                 \
+    for(size_fx i = 0; i < max_entries; i++)                                                        \
+        cache->entries[i].next = i + 1 < max_entries ? (unsigned int)(i + 1) : FXDEF_NIL;           \
+                                                                                                    \
+    return cache;                                                                                   \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE void NAME##_free(NAME* cache){                                                     \
+    (*cache->allocator->free)(cache);                                                               \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE size_fx NAME##_size(const NAME* cache){                                            \
+    return cache->size;                                                                             \
+}                                                                                                   \
+                                                                                                    \
+/*slot holding key, or capacity*/                                                                  \
+static FX_INLINE size_fx NAME##_find(const NAME* cache, KEY_T key, size_fx h){                      \
+                                                                                                    \
+    size_fx groups_mask = cache->capacity / FXDEF_GROUP_WIDTH - 1;                                  \
+    size_fx group = (h >> 7) & groups_mask;                                                         \
+    signed char h2 = (signed char)(h & 0x7F);                                                       \
+                                                                                                    \
+    for(size_fx probe = 1; probe <= groups_mask + 1; probe++){                                      \
+                                                                                                    \
+        size_fx base = group * FXDEF_GROUP_WIDTH;                                                   \
+        simd_mask match = simd_group_match(cache->ctrl + base, h2);                                 \
+                                                                                                    \
+        while(match){                                                                               \
+            size_fx slot = base + simd_mask_next(&match);                                           \
+            if(EQ(key, cache->entries[cache->index[slot]].key))                                     \
+                return slot;                                                                        \
+        }                                                                                           \
+                                                                                                    \
+        if(simd_group_match_empty(cache->ctrl + base))                                              \
+            break;                                                                                  \
+                                                                                                    \
+        group = (group + probe) & groups_mask;                                                      \
+    }                                                                                               \
+                                                                                                    \
+    return cache->capacity;                                                                         \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE size_fx NAME##_find_free(const NAME* cache, size_fx h){                            \
+                                                                                                    \
+    size_fx groups_mask = cache->capacity / FXDEF_GROUP_WIDTH - 1;                                  \
+    size_fx group = (h >> 7) & groups_mask;                                                         \
+                                                                                                    \
+    for(size_fx probe = 1; probe <= groups_mask + 1; probe++){                                      \
+                                                                                                    \
+        simd_mask free_slots = simd_group_match_free(cache->ctrl + group * FXDEF_GROUP_WIDTH);      \
+        if(free_slots)                                                                              \
+            return group * FXDEF_GROUP_WIDTH + simd_mask_next(&free_slots);                         \
+                                                                                                    \
+        group = (group + probe) & groups_mask;                                                      \
+    }                                                                                               \
+                                                                                                    \
+    return cache->capacity;                                                                         \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE void NAME##_put_slot(NAME* cache, size_fx slot, size_fx h, unsigned int entry){    \
+                                                                                                    \
+    if(cache->ctrl[slot] == FXDEF_CTRL_EMPTY)                                                       \
+        cache->growth_left--;                                                                       \
+    cache->ctrl[slot] = (signed char)(h & 0x7F);                                                    \
+    cache->index[slot] = entry;                                                                     \
+}                                                                                                   \
+                                                                                                    \
+/*the entry count is bounded, so the index never grows: a rebuild only drops the tombstones*/      \
+static FX_INLINE void NAME##_rebuild(NAME* cache){                                                  \
+                                                                                                    \
+    for(size_fx i = 0; i < cache->capacity; i++)                                                    \
+        cache->ctrl[i] = FXDEF_CTRL_EMPTY;                                                          \
+    cache->growth_left = FXDEF_MAX_LOAD(cache->capacity);                                           \
+                                                                                                    \
+    for(unsigned int e = cache->head; e != FXDEF_NIL; e = cache->entries[e].next){                  \
+        size_fx h = flexcache_define_mix(HASH(cache->entries[e].key));                              \
+        NAME##_put_slot(cache, NAME##_find_free(cache, h), h, e);                                   \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE void NAME##_clear_slot(NAME* cache, size_fx slot){                                 \
+                                                                                                    \
+    size_fx base = slot & ~(size_fx)(FXDEF_GROUP_WIDTH - 1);                                        \
+    if(simd_group_match_empty(cache->ctrl + base)){                                                 \
+        cache->ctrl[slot] = FXDEF_CTRL_EMPTY;                                                       \
+        cache->growth_left++;                                                                       \
+    } else{                                                                                         \
+        cache->ctrl[slot] = FXDEF_CTRL_DELETED;                                                     \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE void NAME##_unlink(NAME* cache, unsigned int e){                                   \
+                                                                                                    \
+    NAME##_entry* entry = &cache->entries[e];                                                       \
+    if(entry->prev != FXDEF_NIL)                                                                    \
+        cache->entries[entry->prev].next = entry->next;                                             \
+    else                                                                                            \
+        cache->head = entry->next;                                                                  \
+    if(entry->next != FXDEF_NIL)                                                                    \
+        cache->entries[entry->next].prev = entry->prev;                                             \
+    else                                                                                            \
+        cache->tail = entry->prev;                                                                  \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE void NAME##_push_back(NAME* cache, unsigned int e){                                \
+                                                                                                    \
+    NAME##_entry* entry = &cache->entries[e];                                                       \
+    entry->prev = cache->tail;                                                                      \
+    entry->next = FXDEF_NIL;                                                                        \
+    if(cache->tail != FXDEF_NIL)                                                                    \
+        cache->entries[cache->tail].next = e;                                                       \
+    else                                                                                            \
+        cache->head = e;                                                                            \
+    cache->tail = e;                                                                                \
+}                                                                                                   \
+                                                                                                    \
+/*value of key or 0, a hit makes it the most recently used*/                                       \
+static FX_INLINE VAL_T* NAME##_get(NAME* cache, KEY_T key){                                         \
+                                                                                                    \
+    size_fx slot = NAME##_find(cache, key, flexcache_define_mix(HASH(key)));                        \
+    if(slot == cache->capacity)                                                                     \
+        return 0;                                                                                   \
+                                                                                                    \
+    unsigned int e = cache->index[slot];                                                            \
+    if(e != cache->tail){                                                                           \
+        NAME##_unlink(cache, e);                                                                    \
+        NAME##_push_back(cache, e);                                                                 \
+    }                                                                                               \
+    return &cache->entries[e].value;                                                                \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE bool_t NAME##_contains(const NAME* cache, KEY_T key){                              \
+    return NAME##_find(cache, key, flexcache_define_mix(HASH(key))) != cache->capacity;             \
+}                                                                                                   \
+                                                                                                    \
+/*stores key, returns 1 when a pair left the cache (the replaced value of key or the LRU victim), */\
+/*then written to evicted_key / evicted_value when not 0... a cache of 0 entries stores nothing*/  \
+static FX_INLINE size_fx NAME##_set(NAME* cache, KEY_T key, VAL_T value,                            \
+                                    KEY_T* evicted_key, VAL_T* evicted_value){                      \
+                                                                                                    \
+    size_fx h = flexcache_define_mix(HASH(key));                                                    \
+    size_fx slot = NAME##_find(cache, key, h);                                                      \
+                                                                                                    \
+    if(slot != cache->capacity){                                                                    \
+        unsigned int e = cache->index[slot];                                                        \
+        NAME##_entry* entry = &cache->entries[e];                                                   \
+        if(evicted_key)                                                                             \
+            *evicted_key = entry->key;                                                              \
+        if(evicted_value)                                                                           \
+            *evicted_value = entry->value;                                                          \
+        entry->value = value;                                                                       \
+        if(e != cache->tail){                                                                       \
+            NAME##_unlink(cache, e);                                                                \
+            NAME##_push_back(cache, e);                                                             \
+        }                                                                                           \
+        return 1;                                                                                   \
+    }                                                                                               \
+                                                                                                    \
+    if(cache->max_entries == 0)                                                                     \
+        return 0;                                                                                   \
+                                                                                                    \
+    size_fx evicted = 0;                                                                            \
+    if(cache->size == cache->max_entries){                                                          \
+        unsigned int e = cache->head;                                                               \
+        NAME##_entry* victim = &cache->entries[e];                                                  \
+        if(evicted_key)                                                                             \
+            *evicted_key = victim->key;                                                             \
+        if(evicted_value)                                                                           \
+            *evicted_value = victim->value;                                                         \
+                                                                                                    \
+        NAME##_clear_slot(cache, NAME##_find(cache, victim->key,                                    \
+                                             flexcache_define_mix(HASH(victim->key))));             \
+        NAME##_unlink(cache, e);                                                                    \
+        victim->next = cache->free_head;                                                            \
+        cache->free_head = e;                                                                       \
+        cache->size--;                                                                              \
+        evicted = 1;                                                                                \
+    }                                                                                               \
+                                                                                                    \
+    unsigned int e = cache->free_head;                                                              \
+    NAME##_entry* entry = &cache->entries[e];                                                       \
+    cache->free_head = entry->next;                                                                 \
+    entry->key = key;                                                                               \
+    entry->value = value;                                                                           \
+                                                                                                    \
+    slot = NAME##_find_free(cache, h);                                                              \
+    if(cache->ctrl[slot] == FXDEF_CTRL_EMPTY && cache->growth_left == 0){                           \
+        NAME##_rebuild(cache);                                                                      \
+        slot = NAME##_find_free(cache, h);                                                          \
+    }                                                                                               \
+                                                                                                    \
+    NAME##_put_slot(cache, slot, h, e);                                                             \
+    NAME##_push_back(cache, e);                                                                     \
+    cache->size++;                                                                                  \
+                                                                                                    \
+    return evicted;                                                                                 \
+}                                                                                                   \
+                                                                                                    \
+static FX_INLINE bool_t NAME##_remove(NAME* cache, KEY_T key, VAL_T* value){                        \
+                                                                                                    \
+    size_fx slot = NAME##_find(cache, key, flexcache_define_mix(HASH(key)));                        \
+    if(slot == cache->capacity)                                                                     \
+        return 0;                                                                                   \
+                                                                                                    \
+    unsigned int e = cache->index[slot];                                                            \
+    if(value)                                                                                       \
+        *value = cache->entries[e].value;                                                           \
+                                                                                                    \
+    NAME##_clear_slot(cache, slot);                                                                 \
+    NAME##_unlink(cache, e);                                                                        \
+    cache->entries[e].next = cache->free_head;                                                      \
+    cache->free_head = e;                                                                           \
+    cache->size--;                                                                                  \
+                                                                                                    \
+    return 1;                                                                                       \
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,7 +5,365 @@
 struct flexnode{
     map_hook_t      map_hook;
     list_hook_t     list_hook;
+    ttl_hook_t      ttl_hook; //only linked for volatile nodes
     metadata_t      meta;
-    void*           data;
-    void*           key;
-};
\ No newline at end of file
+    unsigned char   flags; //flags, pins and overhead share the 8 bytes after meta
+    unsigned short  pins; //fcache_acquire handles
+    unsigned int    overhead; //see fnode_get_overhead
+    void*           data; //points into inline_buf when FNODE_DATA_INLINE
+    void*           key;  //points into inline_buf when FNODE_KEY_INLINE
+    char            inline_buf[] __attribute__((aligned(8)));
+};
+
+#define FNODE_KEY_INLINE  0x1
+#define FNODE_DATA_INLINE 0x2
+#define FNODE_IN_WINDOW   0x4
+#define FNODE_PROTECTED   0x8
+#define FNODE_DETACHED    0x10
+
+#define FNODE_MAX_PINS 0xFFFF
+
+#define FNODE_ALIGN(size) (((size) + 7) & ~(size_fx)7)
+
+size_fx fnode_sizeof(void){
+    return sizeof(flexnode);
+}
+
+size_fx fnode_alloc_size(size_fx key_len, const void* value, size_fx len, size_fx inline_max){
+
+    size_fx key_bytes = key_len > 0 && key_len <= inline_max ? FNODE_ALIGN(key_len) : 0;
+    size_fx data_bytes = value && len <= inline_max ? len : 0;
+
+    return sizeof(flexnode) + key_bytes + data_bytes;
+}
+
+flexnode* fnode_new(const allocator_fx* allocator, void* key, size_fx key_len, const void* value, size_fx len,
+                    size_fx inline_max, set_option* options, time_fx now){
+
+    if(len > FNODE_MAX_SIZE)
+        return 0;
+
+    bool_t key_inline = key_len > 0 && key_len <= inline_max;
+    bool_t data_inline = value && len <= inline_max;
+
+    size_fx key_bytes = key_inline ? FNODE_ALIGN(key_len) : 0;
+
+    flexnode* node = (*allocator->alloc)(fnode_alloc_size(key_len, value, len, inline_max));
+    if(!node)
+        return 0;
+
+    fnode_init(node, key, value, len, *options, now);
+    node->flags = 0;
+    node->pins = 0;
+    node->overhead = 0;
+
+    if(key_inline){
+        memcopy_fx(key, node->inline_buf, key_len);
+        node->key = node->inline_buf;
+        node->flags |= FNODE_KEY_INLINE;
+    }
+
+    if(data_inline){
+        memcopy_fx((void*)value, node->inline_buf + key_bytes, len);
+        node->data = node->inline_buf + key_bytes;
+        node->flags |= FNODE_DATA_INLINE;
+    }
+
+    return node;
+}
+
+#ifdef FCACHE_COMPACT_NODE
+
+static long fnode_base_sec = 0;
+
+void fnode_time_base(time_fx now){
+
+    long expected = 0;
+    long base = now.tv_sec > 1 ? now.tv_sec - 1 : 1;
+    __atomic_compare_exchange_n(&fnode_base_sec, &expected, base, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static FX_INLINE unsigned int fnode_time_pack(time_fx t){
+
+    long rel = t.tv_sec - __atomic_load_n(&fnode_base_sec, __ATOMIC_RELAXED);
+    if(rel <= 0)
+        return 0;
+    return rel > 0xFFFFFFFFL ? 0xFFFFFFFFu : (unsigned int)rel;
+}
+
+static FX_INLINE time_fx fnode_time_unpack(unsigned int rel){
+
+    time_fx t;
+    t.tv_sec = __atomic_load_n(&fnode_base_sec, __ATOMIC_RELAXED) + (long)rel;
+    t.tv_nsec = 0;
+    return t;
+}
+
+time_fx fnode_get_epoch(flexnode* node){
+    return fnode_time_unpack(node->meta.epoch);
+}
+
+time_fx fnode_get_lst_used(flexnode* node){
+    return fnode_time_unpack(__atomic_load_n(&node->meta.lst_used, __ATOMIC_RELAXED));
+}
+
+void fnode_stamp(flexnode* node, time_fx now){
+    __atomic_store_n(&node->meta.lst_used, fnode_time_pack(now), __ATOMIC_RELAXED);
+}
+
+void fnode_touch(flexnode* node, time_fx now){
+
+    fnode_stamp(node, now);
+    if(node->meta.times_used != 0xFFFFFFFFu)
+        node->meta.times_used++;
+}
+
+void fnode_restore(flexnode* node, time_fx epoch, time_fx lst_used, long times_used,
+                    unsigned char freq, unsigned short freq_ldt){
+
+    //epoch is const for the cache, only a restore may write it
+    *(unsigned int*)&node->meta.epoch = fnode_time_pack(epoch);
+    fnode_stamp(node, lst_used);
+    node->meta.times_used = times_used > 0xFFFFFFFFL ? 0xFFFFFFFFu : (unsigned int)times_used;
+    node->meta.freq = freq;
+    node->meta.freq_ldt = freq_ldt;
+}
+
+#else
+
+void fnode_time_base(time_fx now){
+    (void)now;
+}
+
+time_fx fnode_get_epoch(flexnode* node){
+    return node->meta.epoch;
+}
+
+time_fx fnode_get_lst_used(flexnode* node){
+
+    unsigned long long ms = __atomic_load_n(&node->meta.lst_used, __ATOMIC_RELAXED);
+    time_fx lst_used = {(long)(ms / 1000), (long)(ms % 1000) * 1000000L};
+    return lst_used;
+}
+
+//readers racing the writer stamp too: a single relaxed store, never a torn sec / nsec pair
+void fnode_stamp(flexnode* node, time_fx now){
+    __atomic_store_n(&node->meta.lst_used, time_fx_to_ms(now), __ATOMIC_RELAXED);
+}
+
+void fnode_touch(flexnode* node, time_fx now){
+    fnode_stamp(node, now);
+    node->meta.times_used++;
+}
+
+void fnode_restore(flexnode* node, time_fx epoch, time_fx lst_used, long times_used,
+                    unsigned char freq, unsigned short freq_ldt){
+
+    //epoch is const for the cache, only a restore may write it
+    memcopy_fx(&epoch, (void*)&node->meta.epoch, sizeof(time_fx));
+    fnode_stamp(node, lst_used);
+    node->meta.times_used = times_used;
+    node->meta.freq = freq;
+    node->meta.freq_ldt = freq_ldt;
+}
+
+#endif
+
+static long fnode_ttl_ms(const set_option* options, time_fx now){
+
+    long long now_ms = (long long)time_fx_to_ms(now);
+    long long ttl = -1;
+
+    if(options->PX > 0)
+        ttl = options->PX;
+    else if(options->EX > 0)
+        ttl = (long long)options->EX * 1000;
+    else if(options->PXAT > 0)
+        ttl = options->PXAT - now_ms;
+    else if(options->EXAT > 0)
+        ttl = (long long)options->EXAT * 1000 - now_ms;
+
+    if(ttl == -1)
+        return -1;
+    return ttl > 0 ? (long)ttl : 0;
+}
+
+void fnode_init(flexnode* node, void* key, const void* value, size_t len, set_option options, time_fx now){
+
+    long ttl = fnode_ttl_ms(&options, now);
+    metadata_t* meta = &node->meta;
+
+    //size, epoch and type are const for the cache, only init writes them
+#ifdef FCACHE_COMPACT_NODE
+    *(unsigned int*)&meta->size = (unsigned int)len;
+    *(unsigned int*)&meta->epoch = fnode_time_pack(now);
+    *(unsigned char*)&meta->type = (unsigned char)SINGLE;
+    meta->exp_seconds = ttl < 0 ? -1 : (int)((ttl + 999) / 1000);
+#else
+    *(size_t*)&meta->size = len;
+    memcopy_fx(&now, (void*)&meta->epoch, sizeof(time_fx));
+    *(node_type*)&meta->type = SINGLE;
+    meta->exp_ms = ttl;
+#endif
+    fnode_stamp(node, now);
+    meta->times_used = 0;
+    meta->freq = 0;
+    meta->freq_ldt = 0;
+
+    node->key = key;
+    node->data = (void*)value;
+}
+
+metadata_t* fnode_get_metadata(flexnode* node){
+    return &node->meta;
+}
+
+size_t fnode_get_size(flexnode* node){
+    return node->meta.size;
+}
+
+const void* fnode_get_data(flexnode* node){
+    return node->data;
+}
+
+long fnode_get_ttl(flexnode* node){
+
+#ifdef FCACHE_COMPACT_NODE
+    return node->meta.exp_seconds < 0 ? -1 : (long)node->meta.exp_seconds * 1000;
+#else
+    return node->meta.exp_ms;
+#endif
+}
+
+bool_t fnode_is_volatile(flexnode* node){
+    return fnode_get_ttl(node) >= 0;
+}
+
+void* fnode_destroy(flexnode* node, const allocator_fx* allocator){
+
+    void* data = fnode_data_inline(node) ? 0 : node->data;
+    (*allocator->free)(node);
+
+    return data;
+}
+
+bool_t fnode_data_inline(flexnode* node){
+    return (node->flags & FNODE_DATA_INLINE) != 0;
+}
+
+size_fx fnode_get_overhead(flexnode* node){
+    return node->overhead;
+}
+
+void fnode_set_overhead(flexnode* node, size_fx overhead){
+    node->overhead = (unsigned int)overhead;
+}
+
+bool_t fnode_in_window(flexnode* node){
+    return (node->flags & FNODE_IN_WINDOW) != 0;
+}
+
+void fnode_set_window(flexnode* node, bool_t in_window){
+
+    if(in_window)
+        node->flags |= FNODE_IN_WINDOW;
+    else
+        node->flags &= ~FNODE_IN_WINDOW;
+}
+
+bool_t fnode_is_protected(flexnode* node){
+    return (node->flags & FNODE_PROTECTED) != 0;
+}
+
+void fnode_set_protected(flexnode* node, bool_t protected_segment){
+
+    if(protected_segment)
+        node->flags |= FNODE_PROTECTED;
+    else
+        node->flags &= ~FNODE_PROTECTED;
+}
+
+bool_t fnode_pin(flexnode* node){
+
+    if(node->pins == FNODE_MAX_PINS)
+        return 0;
+    node->pins++;
+    return 1;
+}
+
+bool_t fnode_unpin(flexnode* node){
+
+    //a release too many must not wrap pins and keep the node forever
+    if(node->pins == 0)
+        return 0;
+
+    node->pins--;
+    return node->pins == 0 && (node->flags & FNODE_DETACHED) != 0;
+}
+
+bool_t fnode_pinned(flexnode* node){
+    return node->pins != 0;
+}
+
+bool_t fnode_detach(flexnode* node){
+
+    node->flags |= FNODE_DETACHED;
+    return node->pins == 0;
+}
+
+node_type fnode_get_type(flexnode* node){
+    return (node_type)node->meta.type;
+}
+
+void fnode_set_container(flexnode* node, node_type type, void* container){
+
+    //type is const for the cache, only the container setup writes it
+#ifdef FCACHE_COMPACT_NODE
+    *(unsigned char*)&node->meta.type = (unsigned char)type;
+#else
+    *(node_type*)&node->meta.type = type;
+#endif
+    node->data = container;
+}
+
+void fnode_set_size(flexnode* node, size_fx size){
+
+#ifdef FCACHE_COMPACT_NODE
+    *(unsigned int*)&node->meta.size = (unsigned int)size;
+#else
+    *(size_t*)&node->meta.size = size;
+#endif
+}
+
+const void* fnode_get_key(flexnode* node){
+    return node->key;
+}
+
+
+twheel_time fnode_expire_ms(flexnode* node){
+    return time_fx_to_ms(fnode_get_epoch(node)) + (twheel_time)fnode_get_ttl(node);
+}
+
+ttl_hook_t* fnode_ttl_hook(flexnode* node){
+    return &node->ttl_hook;
+}
+
+flexnode* fnode_from_ttl_hook(ttl_hook_t* hook){
+    return list_entry(hook, flexnode, ttl_hook);
+}
+
+list_hook_t* fnode_list_hook(flexnode* node){
+    return &node->list_hook;
+}
+
+flexnode* fnode_from_list_hook(list_hook_t* hook){
+    return list_entry(hook, flexnode, list_hook);
+}
+
+map_hook_t* fnode_map_hook(flexnode* node){
+    return &node->map_hook;
+}
+
+flexnode* fnode_from_map_hook(map_hook_t* hook){
+    return rbtree_entry(hook, flexnode, map_hook);
+}
@@ -7,6 +7,7 @@ extern "C" {
 
 #include "commons.h"
 #include "flexcache.h"
+#include "intr_hooks.h"
 
 typedef enum node_type node_type;
 
@@ -18,33 +19,146 @@ enum node_type {
     MAP
 };
 
+#ifdef FCACHE_COMPACT_NODE
+
+// Compact layout, metadata_t takes 24 bytes instead of the full 56 (the node word after it,
+// flags, pins and overhead, is the same in both): sizes up to FNODE_MAX_SIZE, epoch and lst_used in
+// seconds since fnode_time_base (valid for 136 years, the LRU clock gets 1 s resolution),
+// times_used saturates, ttls round up to whole seconds. Read the times through fnode_get_epoch /
+// fnode_get_lst_used and fnode_get_ttl.
+#define FNODE_MAX_SIZE 0xFFFFFFFFUL
+
+struct metadata_t{
+    const unsigned int       size;
+    const unsigned int       epoch; //seconds since fnode_time_base
+    unsigned int             lst_used; //seconds since fnode_time_base
+    int                      exp_seconds; //ttl from epoch, non volatile is -1
+    unsigned int             times_used;
+    unsigned short           freq_ldt; //LFU last decrement time, minutes
+    unsigned char            freq; //LFU logarithmic counter (lfu_fx.h)
+    const unsigned char      type; //enum node_type
+};
+
+#else
+
+#define FNODE_MAX_SIZE ((size_fx)-1)
+
 struct metadata_t{
     const size_t             size;
     const time_fx             epoch; //timestamp
-    time_fx                   lst_used;
-    long                     exp_seconds; //non volatile is -1 ----ISSO EH IMPORTANTE
+    unsigned long long       lst_used; //ms timestamp, one word so lock free readers stamp it atomically
+    long                     exp_ms; //ttl from epoch, non volatile is -1
     long                     times_used;
+    unsigned char            freq; //LFU logarithmic counter (lfu_fx.h)
+    unsigned short           freq_ldt; //LFU last decrement time, minutes
     const enum node_type     type;
 };
 
+#endif
+
 typedef struct flexnode flexnode;
 
-void fnode_init(flexnode* node, void* key, const void* value, size_t len, set_option options);
+size_fx fnode_sizeof(void);
+
+// epoch is now, the ttl comes from the first of PX, EX, PXAT, EXAT set (an absolute time already
+// past gives a ttl of 0)... no ttl at all, the node is not volatile
+void fnode_init(flexnode* node, void* key, const void* value, size_t len, set_option options, time_fx now);
+
+// Allocates and inits a node. Keys of key_len bytes (0 if unknown) and values of len bytes
+// up to inline_max are copied into the node allocation itself, so a hit reads one
+// allocation... the caller keeps ownership of the key and value it passed in that case.
+flexnode* fnode_new(const allocator_fx* allocator, void* key, size_fx key_len, const void* value, size_fx len,
+                    size_fx inline_max, set_option* options, time_fx now);
+
+//bytes fnode_new allocates for the node itself
+size_fx fnode_alloc_size(size_fx key_len, const void* value, size_fx len, size_fx inline_max);
+
+//frees the node, returns the data... 0 when it was stored inline (owned by the node)
+void* fnode_destroy(flexnode* node, const allocator_fx* allocator);
+
+bool_t fnode_data_inline(flexnode* node);
+
+//WTINYLFU: the node sits in the admission window, not in the main list
+bool_t fnode_in_window(flexnode* node);
+
+void fnode_set_window(flexnode* node, bool_t in_window);
+
+//SLRU: the node is in the protected segment of evic_list
+bool_t fnode_is_protected(flexnode* node);
+
+void fnode_set_protected(flexnode* node, bool_t protected_segment);
+
+// fcache_acquire pins: a pinned node leaving the cache is detached instead of freed, the last
+// unpin frees it. fnode_pin fails once FNODE_MAX_PINS handles hold the node.
+bool_t fnode_pin(flexnode* node);
+
+//1 when that was the last pin of a detached node... a node without pins is left alone (0)
+bool_t fnode_unpin(flexnode* node);
 
-void* fnode_destroy(flexnode* node, allocator_t* allocator);
+bool_t fnode_pinned(flexnode* node);
+
+//1 when no pin holds the node, it can be freed now
+bool_t fnode_detach(flexnode* node);
 
 metadata_t* fnode_get_metadata(flexnode* node);
 
 size_t fnode_get_size(flexnode* node);
 
+//bytes the cache charges for the node besides its size (node allocation, index, allocator slack)
+size_fx fnode_get_overhead(flexnode* node);
+
+void fnode_set_overhead(flexnode* node, size_fx overhead);
+
 const void* fnode_get_data(flexnode* node);
 
+//ttl in ms from the epoch, -1 for non volatile nodes
 long fnode_get_ttl(flexnode* node);
 
 node_type fnode_get_type(flexnode* node);
 
+//LIST / MAP node: data is the container (fvalue_fx.h), created with a 0 value so it is never inline
+void fnode_set_container(flexnode* node, node_type type, void* container);
+
+//in place update of a container node
+void fnode_set_size(flexnode* node, size_fx size);
+
+time_fx fnode_get_lst_used(flexnode* node);
+
+time_fx fnode_get_epoch(flexnode* node);
+
+//FCACHE_COMPACT_NODE: timestamps are stored against the first base set in the process (fcache_init),
+//every cache must use the same clock... a no op for the full layout
+void fnode_time_base(time_fx now);
+
+//read hit: updates lst_used and times_used only, the node is not moved
+void fnode_touch(flexnode* node, time_fx now);
+
+//lock free read hit: lst_used only, relaxed atomics since the writer may sample it meanwhile
+void fnode_stamp(flexnode* node, time_fx now);
+
 bool_t fnode_is_volatile(flexnode* node);
 
+//warm restart: puts back the metadata saved in a snapshot (fcache_load)
+void fnode_restore(flexnode* node, time_fx epoch, time_fx lst_used, long times_used,
+                    unsigned char freq, unsigned short freq_ldt);
+
+const void* fnode_get_key(flexnode* node);
+
+//absolute expiry time (ms) of a volatile node
+twheel_time fnode_expire_ms(flexnode* node);
+
+ttl_hook_t* fnode_ttl_hook(flexnode* node);
+
+flexnode* fnode_from_ttl_hook(ttl_hook_t* hook);
+
+list_hook_t* fnode_list_hook(flexnode* node);
+
+flexnode* fnode_from_list_hook(list_hook_t* hook);
+
+map_hook_t* fnode_map_hook(flexnode* node);
+
+flexnode* fnode_from_map_hook(map_hook_t* hook);
+
 #ifdef __cplusplus
 }
 #endif
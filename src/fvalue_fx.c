@@ -0,0 +1,251 @@
+#include "fvalue_fx.h"
+
+#define FLIST_MIN_CAPACITY 8
+
+//per element overhead: list ring slot, map index slot and control byte
+#define FLIST_ELEM_OVERHEAD (sizeof(fvalue_bytes) + sizeof(void*))
+#define FMAP_ELEM_OVERHEAD  (sizeof(fmap_field) + sizeof(fvalue_bytes) + sizeof(void*) + 1)
+
+struct flist_fx{
+    fvalue_bytes**          items; //ring, capacity is a power of two
+    size_fx                 head;
+    size_fx                 count;
+    size_fx                 capacity;
+    size_fx                 bytes;
+    const allocator_fx*     allocator;
+};
+
+typedef struct fmap_field{
+    fvalue_bytes*   value;
+    size_fx         field_len;
+    char            field[] __attribute__((aligned(8)));
+} fmap_field;
+
+struct fmap_fx{
+    hmap_fx                 index;
+    size_fx                 bytes;
+    const allocator_fx*     allocator;
+};
+
+static fvalue_bytes* fvalue_copy(const allocator_fx* allocator, const void* value, size_fx len){
+
+    fvalue_bytes* bytes = (*allocator->alloc)(sizeof(fvalue_bytes) + len);
+    if(!bytes)
+        return 0;
+
+    bytes->len = len;
+    memcopy_fx((void*)value, bytes->data, len);
+    return bytes;
+}
+
+flist_fx* flist_new(const allocator_fx* allocator){
+
+    flist_fx* list = (*allocator->alloc)(sizeof(flist_fx));
+    if(!list)
+        return 0;
+
+    list->items = 0;
+    list->head = 0;
+    list->count = 0;
+    list->capacity = 0;
+    list->bytes = 0;
+    list->allocator = allocator;
+
+    return list;
+}
+
+void flist_free(flist_fx* list){
+
+    const allocator_fx* allocator = list->allocator;
+
+    for(size_fx i = 0; i < list->count; i++)
+        (*allocator->free)(list->items[(list->head + i) & (list->capacity - 1)]);
+
+    if(list->items)
+        (*allocator->free)(list->items);
+    (*allocator->free)(list);
+}
+
+static int flist_grow(flist_fx* list){
+
+    size_fx capacity = list->capacity ? list->capacity << 1 : FLIST_MIN_CAPACITY;
+    fvalue_bytes** items = (*list->allocator->alloc)(capacity * sizeof(fvalue_bytes*));
+    if(!items)
+        return 0;
+
+    for(size_fx i = 0; i < list->count; i++)
+        items[i] = list->items[(list->head + i) & (list->capacity - 1)];
+
+    if(list->items)
+        (*list->allocator->free)(list->items);
+
+    list->items = items;
+    list->head = 0;
+    list->capacity = capacity;
+    return 1;
+}
+
+int flist_push(flist_fx* list, const void* value, size_fx len, bool_t front){
+
+    if(list->count == list->capacity && !flist_grow(list))
+        return 0;
+
+    fvalue_bytes* bytes = fvalue_copy(list->allocator, value, len);
+    if(!bytes)
+        return 0;
+
+    size_fx mask = list->capacity - 1;
+    if(front){
+        list->head = (list->head - 1) & mask;
+        list->items[list->head] = bytes;
+    } else{
+        list->items[(list->head + list->count) & mask] = bytes;
+    }
+
+    list->count++;
+    list->bytes += len + FLIST_ELEM_OVERHEAD;
+    return 1;
+}
+
+fvalue_bytes* flist_pop(flist_fx* list, bool_t front){
+
+    if(list->count == 0)
+        return 0;
+
+    size_fx mask = list->capacity - 1;
+    fvalue_bytes* bytes;
+    if(front){
+        bytes = list->items[list->head];
+        list->head = (list->head + 1) & mask;
+    } else{
+        bytes = list->items[(list->head + list->count - 1) & mask];
+    }
+
+    list->count--;
+    list->bytes -= bytes->len + FLIST_ELEM_OVERHEAD;
+    return bytes;
+}
+
+const fvalue_bytes* flist_at(const flist_fx* list, size_fx index){
+
+    if(index >= list->count)
+        return 0;
+    return list->items[(list->head + index) & (list->capacity - 1)];
+}
+
+size_fx flist_len(const flist_fx* list){
+    return list->count;
+}
+
+size_fx flist_bytes(const flist_fx* list){
+    return list->bytes;
+}
+
+static const void* fmap_key_of(const void* entry){
+    return ((const fmap_field*)entry)->field;
+}
+
+fmap_fx* fmap_new(const hash_func* hash, const cmp_func* compare, const allocator_fx* allocator){
+
+    fmap_fx* map = (*allocator->alloc)(sizeof(fmap_fx));
+    if(!map)
+        return 0;
+
+    if(!hmap_init(&map->index, 0, hash, compare, fmap_key_of, allocator)){
+        (*allocator->free)(map);
+        return 0;
+    }
+
+    map->bytes = 0;
+    map->allocator = allocator;
+    return map;
+}
+
+static void fmap_field_free(fmap_fx* map, fmap_field* entry){
+
+    map->bytes -= entry->field_len + entry->value->len + FMAP_ELEM_OVERHEAD;
+    (*map->allocator->free)(entry->value);
+    (*map->allocator->free)(entry);
+}
+
+void fmap_free(fmap_fx* map){
+
+    size_fx cursor = 0;
+    fmap_field* entry;
+    while((entry = hmap_next(&map->index, &cursor)) != 0)
+        fmap_field_free(map, entry);
+
+    hmap_destroy(&map->index);
+    (*map->allocator->free)(map);
+}
+
+int fmap_set(fmap_fx* map, const void* field, size_fx field_len, const void* value, size_fx len){
+
+    fvalue_bytes* bytes = fvalue_copy(map->allocator, value, len);
+    if(!bytes)
+        return 0;
+
+    fmap_field* entry = hmap_get(&map->index, field);
+    if(entry){
+        map->bytes = map->bytes - entry->value->len + len;
+        (*map->allocator->free)(entry->value);
+        entry->value = bytes;
+        return 1;
+    }
+
+    entry = (*map->allocator->alloc)(sizeof(fmap_field) + field_len);
+    if(!entry){
+        (*map->allocator->free)(bytes);
+        return 0;
+    }
+
+    entry->value = bytes;
+    entry->field_len = field_len;
+    memcopy_fx((void*)field, entry->field, field_len);
+
+    int ok;
+    hmap_set(&map->index, entry->field, entry, &ok);
+    if(!ok){
+        (*map->allocator->free)(bytes);
+        (*map->allocator->free)(entry);
+        return 0;
+    }
+
+    map->bytes += field_len + len + FMAP_ELEM_OVERHEAD;
+    return 1;
+}
+
+const fvalue_bytes* fmap_get(const fmap_fx* map, const void* field){
+
+    const fmap_field* entry = hmap_get(&map->index, field);
+    return entry ? entry->value : 0;
+}
+
+bool_t fmap_del(fmap_fx* map, const void* field){
+
+    fmap_field* entry = hmap_remove(&map->index, field);
+    if(!entry)
+        return 0;
+
+    fmap_field_free(map, entry);
+    return 1;
+}
+
+const void* fmap_next(const fmap_fx* map, size_fx* cursor, size_fx* field_len, const fvalue_bytes** value){
+
+    const fmap_field* entry = hmap_next(&map->index, cursor);
+    if(!entry)
+        return 0;
+
+    *field_len = entry->field_len;
+    *value = entry->value;
+    return entry->field;
+}
+
+size_fx fmap_len(const fmap_fx* map){
+    return map->index.size;
+}
+
+size_fx fmap_bytes(const fmap_fx* map){
+    return map->bytes;
+}
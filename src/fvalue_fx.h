@@ -0,0 +1,65 @@
+#ifndef __FVALUE_FX_H__
+#define __FVALUE_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+#include "hashmap_fx.h"
+
+// LIST and MAP node values. Elements, fields and values are byte copies owned by the container
+// (one allocation each), so a push or a field set changes the value in place and a node leaving
+// the cache frees everything with it. *_bytes is the size accounted to the node: the copies plus
+// the container overhead per element.
+
+typedef struct fvalue_bytes{
+    size_fx         len;
+    char            data[] __attribute__((aligned(8)));
+} fvalue_bytes;
+
+typedef struct flist_fx flist_fx;
+
+typedef struct fmap_fx fmap_fx;
+
+flist_fx* flist_new(const allocator_fx* allocator);
+
+void flist_free(flist_fx* list);
+
+int flist_push(flist_fx* list, const void* value, size_fx len, bool_t front);
+
+//element out of the list, the caller frees it with the list allocator... 0 when empty
+fvalue_bytes* flist_pop(flist_fx* list, bool_t front);
+
+//0 based from the front, 0 out of range
+const fvalue_bytes* flist_at(const flist_fx* list, size_fx index);
+
+size_fx flist_len(const flist_fx* list);
+
+size_fx flist_bytes(const flist_fx* list);
+
+//fields are hashed and compared with the key funcs, on their copy
+fmap_fx* fmap_new(const hash_func* hash, const cmp_func* compare, const allocator_fx* allocator);
+
+void fmap_free(fmap_fx* map);
+
+//inserts or replaces the value of field
+int fmap_set(fmap_fx* map, const void* field, size_fx field_len, const void* value, size_fx len);
+
+const fvalue_bytes* fmap_get(const fmap_fx* map, const void* field);
+
+bool_t fmap_del(fmap_fx* map, const void* field);
+
+//walk over the fields, cursor starts at 0: the next field (its length in field_len, its value in
+//value), 0 at the end. The map must not change during the walk
+const void* fmap_next(const fmap_fx* map, size_fx* cursor, size_fx* field_len, const fvalue_bytes** value);
+
+size_fx fmap_len(const fmap_fx* map);
+
+size_fx fmap_bytes(const fmap_fx* map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
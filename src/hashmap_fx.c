@@ -0,0 +1,445 @@
+#include "hashmap_fx.h"
+#include "simd_fx.h"
+
+#define HMAP_MIN_CAPACITY HMAP_GROUP_WIDTH
+
+//max load of 7/8 before growing
+#define HMAP_MAX_LOAD(cap) ((cap) - (cap) / 8)
+
+//user hashes may be weak (identity on integers)... mix before splitting in h1/h2
+static FX_INLINE size_fx hmap_mix(size_fx h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+}
+
+static FX_INLINE size_fx hmap_hash(const hmap_fx* map, const void* key){
+    return hmap_mix((*map->hash)(key));
+}
+
+static FX_INLINE size_fx hmap_h1(size_fx hash){
+    return hash >> 7;
+}
+
+static FX_INLINE signed char hmap_h2(size_fx hash){
+    return (signed char)(hash & 0x7F);
+}
+
+static FX_INLINE bool_t hmap_is_full(signed char ctrl){
+    return ctrl >= 0;
+}
+
+static FX_INLINE size_fx hmap_round_capacity(size_fx capacity){
+
+    size_fx cap = HMAP_MIN_CAPACITY;
+    while(HMAP_MAX_LOAD(cap) < capacity)
+        cap <<= 1;
+
+    return cap;
+}
+
+// Concurrent readers only ever see a table after the release store publishing it,
+// and a slot after the release store of its control byte.
+static FX_INLINE signed char hmap_load_ctrl(const signed char* ctrl){
+    return __atomic_load_n(ctrl, __ATOMIC_ACQUIRE);
+}
+
+static FX_INLINE void hmap_store_ctrl(signed char* ctrl, signed char value){
+    __atomic_store_n(ctrl, value, __ATOMIC_RELEASE);
+}
+
+static FX_INLINE void* hmap_load_slot(void* const* slot){
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+static FX_INLINE void hmap_store_slot(void** slot, void* entry){
+    __atomic_store_n(slot, entry, __ATOMIC_RELEASE);
+}
+
+static hmap_table* hmap_table_alloc(const allocator_fx* allocator, size_fx capacity){
+
+    hmap_table* table = (*allocator->alloc)(sizeof(hmap_table) + capacity * (sizeof(void*) + 1));
+    if(!table)
+        return 0;
+
+    table->capacity = capacity;
+    table->growth_left = HMAP_MAX_LOAD(capacity);
+    table->slots = (void**)(table + 1);
+    table->ctrl = (signed char*)(table->slots + capacity);
+
+    for(size_fx i = 0; i < capacity; i++){
+        table->ctrl[i] = HMAP_CTRL_EMPTY;
+        table->slots[i] = 0;
+    }
+
+    return table;
+}
+
+static void hmap_table_retire(hmap_fx* map, hmap_table* table){
+
+    if(map->reclaim)
+        map->reclaim(map->reclaim_aux, table, map->allocator->free);
+    else
+        (*map->allocator->free)(table);
+}
+
+int hmap_init(hmap_fx* map, size_fx capacity, const hash_func* hash, const cmp_func* compare,
+                hmap_key_of key_of, const allocator_fx* allocator){
+
+    map->size = 0;
+    map->hash = hash;
+    map->compare = compare;
+    map->key_of = key_of;
+    map->allocator = allocator;
+    map->reclaim = 0;
+    map->reclaim_aux = 0;
+    map->old = 0;
+    map->migrated = 0;
+
+    map->table = hmap_table_alloc(allocator, hmap_round_capacity(capacity));
+    return map->table != 0;
+}
+
+void hmap_destroy(hmap_fx* map){
+
+    if(map->table)
+        (*map->allocator->free)(map->table);
+    if(map->old)
+        (*map->allocator->free)(map->old);
+    map->table = 0;
+    map->old = 0;
+    map->size = 0;
+}
+
+void hmap_set_reclaim(hmap_fx* map, reclaim_fx reclaim, void* aux_data){
+    map->reclaim = reclaim;
+    map->reclaim_aux = aux_data;
+}
+
+// Probe sequence works on whole groups: g, g+1, g+3, g+6... (triangular numbers),
+// which visits every group once when the group count is a power of two.
+// Returns the slot index holding key, or table->capacity if not present.
+static size_fx hmap_find_slot(const hmap_fx* map, const hmap_table* table, const void* key, size_fx hash){
+
+    size_fx groups_mask = table->capacity / HMAP_GROUP_WIDTH - 1;
+    size_fx group = hmap_h1(hash) & groups_mask;
+    signed char h2 = hmap_h2(hash);
+
+    for(size_fx probe = 1; probe <= groups_mask + 1; probe++){
+
+        size_fx base = group * HMAP_GROUP_WIDTH;
+        const signed char* ctrl = table->ctrl + base;
+
+        simd_mask match = simd_group_match(ctrl, h2);
+        while(match){
+            size_fx slot = base + simd_mask_next(&match);
+            if((*map->compare)(key, map->key_of(table->slots[slot])) == 0)
+                return slot;
+        }
+
+        if(simd_group_match_empty(ctrl))
+            break;
+
+        group = (group + probe) & groups_mask;
+    }
+
+    return table->capacity;
+}
+
+// hmap_find_slot for readers racing the writer: a slot may be emptied between its control byte
+// and its entry load (skipped), an entry found is compared on its key so reuse is harmless.
+// Byte by byte atomic loads, a vector load of the group would race the writer stores.
+static void* hmap_find_concurrent(const hmap_fx* map, const hmap_table* table, const void* key, size_fx hash){
+
+    size_fx groups_mask = table->capacity / HMAP_GROUP_WIDTH - 1;
+    size_fx group = hmap_h1(hash) & groups_mask;
+    signed char h2 = hmap_h2(hash);
+
+    for(size_fx probe = 1; probe <= groups_mask + 1; probe++){
+
+        size_fx base = group * HMAP_GROUP_WIDTH;
+        bool_t has_empty = 0;
+
+        for(size_fx i = 0; i < HMAP_GROUP_WIDTH; i++){
+            signed char ctrl = hmap_load_ctrl(table->ctrl + base + i);
+            if(ctrl == h2){
+                void* entry = hmap_load_slot(table->slots + base + i);
+                if(entry && (*map->compare)(key, map->key_of(entry)) == 0)
+                    return entry;
+            } else if(ctrl == HMAP_CTRL_EMPTY){
+                has_empty = 1;
+            }
+        }
+
+        if(has_empty)
+            break;
+
+        group = (group + probe) & groups_mask;
+    }
+
+    return 0;
+}
+
+// First EMPTY or DELETED slot on the probe sequence of hash.
+static size_fx hmap_find_free(const hmap_table* table, size_fx hash){
+
+    size_fx groups_mask = table->capacity / HMAP_GROUP_WIDTH - 1;
+    size_fx group = hmap_h1(hash) & groups_mask;
+
+    for(size_fx probe = 1; probe <= groups_mask + 1; probe++){
+
+        size_fx base = group * HMAP_GROUP_WIDTH;
+        simd_mask free_slots = simd_group_match_free(table->ctrl + base);
+        if(free_slots)
+            return base + simd_mask_next(&free_slots);
+
+        group = (group + probe) & groups_mask;
+    }
+
+    return table->capacity;
+}
+
+static void hmap_table_put(hmap_table* table, size_fx slot, size_fx hash, void* entry){
+
+    if(table->ctrl[slot] == HMAP_CTRL_EMPTY)
+        table->growth_left--;
+
+    hmap_store_slot(table->slots + slot, entry);
+    hmap_store_ctrl(table->ctrl + slot, hmap_h2(hash));
+}
+
+static void hmap_table_erase(hmap_table* table, size_fx slot){
+
+    // a lookup stops on the first group holding an EMPTY,
+    // so if this group already has one the slot can go back to EMPTY instead of a tombstone
+    size_fx base = slot & ~(size_fx)(HMAP_GROUP_WIDTH - 1);
+    if(simd_group_match_empty(table->ctrl + base)){
+        hmap_store_ctrl(table->ctrl + slot, HMAP_CTRL_EMPTY);
+        table->growth_left++;
+    } else{
+        hmap_store_ctrl(table->ctrl + slot, HMAP_CTRL_DELETED);
+    }
+
+    hmap_store_slot(table->slots + slot, 0);
+}
+
+bool_t hmap_migrate(hmap_fx* map, size_fx slots){
+
+    hmap_table* old = map->old;
+    if(!old)
+        return 0;
+
+    size_fx end = slots < old->capacity - map->migrated ? map->migrated + slots : old->capacity;
+
+    //published in the new table first: a concurrent reader probes old and then table
+    for(size_fx i = map->migrated; i < end; i++){
+        if(!hmap_is_full(old->ctrl[i]))
+            continue;
+
+        void* entry = old->slots[i];
+        size_fx hash = hmap_hash(map, map->key_of(entry));
+        hmap_table_put(map->table, hmap_find_free(map->table, hash), hash, entry);
+
+        hmap_store_ctrl(old->ctrl + i, HMAP_CTRL_DELETED);
+        hmap_store_slot(old->slots + i, 0);
+    }
+    map->migrated = end;
+
+    if(end < old->capacity)
+        return 1;
+
+    __atomic_store_n(&map->old, 0, __ATOMIC_RELEASE);
+    hmap_table_retire(map, old);
+    return 0;
+}
+
+// Starts a resize into a new table... doubles when the table is really full, keeps the capacity
+// when most of the used space is tombstones. The new table has room for every old entry plus the
+// writes made while HMAP_MIGRATE_SLOTS per write drain the old one.
+static int hmap_grow(hmap_fx* map){
+
+    //a resize still running is finished first, there is only one old table
+    hmap_migrate(map, (size_fx)-1);
+
+    hmap_table* old_table = map->table;
+    size_fx capacity = old_table->capacity;
+
+    if(map->size >= capacity / 2)
+        capacity <<= 1;
+
+    hmap_table* new_table = hmap_table_alloc(map->allocator, capacity);
+    if(!new_table)
+        return 0;
+
+    //old before table: a reader seeing the new table also sees the old one
+    map->migrated = 0;
+    __atomic_store_n(&map->old, old_table, __ATOMIC_RELEASE);
+    __atomic_store_n(&map->table, new_table, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+// slot of key in the new table, or in the old one during a resize... *table is 0 when not found
+static size_fx hmap_locate(const hmap_fx* map, const void* key, size_fx hash, hmap_table** table){
+
+    size_fx slot = hmap_find_slot(map, map->table, key, hash);
+    if(slot != map->table->capacity){
+        *table = map->table;
+        return slot;
+    }
+
+    if(map->old){
+        slot = hmap_find_slot(map, map->old, key, hash);
+        if(slot != map->old->capacity){
+            *table = map->old;
+            return slot;
+        }
+    }
+
+    *table = 0;
+    return 0;
+}
+
+void* hmap_get(const hmap_fx* map, const void* key){
+    return hmap_get_hashed(map, key, hmap_hash(map, key));
+}
+
+// old first: a moved entry reaches the new table before it leaves the old one... a resize starting
+// after the table load may move the entry out of sight, so the lookup runs again when table changed
+void* hmap_get_concurrent(const hmap_fx* map, const void* key){
+
+    size_fx hash = hmap_hash(map, key);
+
+    for(;;){
+        const hmap_table* table = __atomic_load_n(&map->table, __ATOMIC_ACQUIRE);
+        const hmap_table* old = __atomic_load_n(&map->old, __ATOMIC_ACQUIRE);
+
+        void* entry = old ? hmap_find_concurrent(map, old, key, hash) : 0;
+        if(!entry)
+            entry = hmap_find_concurrent(map, table, key, hash);
+
+        if(entry || __atomic_load_n(&map->table, __ATOMIC_ACQUIRE) == table)
+            return entry;
+    }
+}
+
+size_fx hmap_hash_of(const hmap_fx* map, const void* key){
+    return hmap_hash(map, key);
+}
+
+void hmap_prefetch(const hmap_fx* map, size_fx hash){
+
+    const hmap_table* table = map->table;
+    size_fx groups_mask = table->capacity / HMAP_GROUP_WIDTH - 1;
+    size_fx base = (hmap_h1(hash) & groups_mask) * HMAP_GROUP_WIDTH;
+
+    __builtin_prefetch(table->ctrl + base);
+    __builtin_prefetch(table->slots + base);
+}
+
+void* hmap_get_hashed(const hmap_fx* map, const void* key, size_fx hash){
+
+    hmap_table* table;
+    size_fx slot = hmap_locate(map, key, hash, &table);
+
+    return table ? table->slots[slot] : 0;
+}
+
+void* hmap_set(hmap_fx* map, const void* key, void* entry, int* ok){
+
+    size_fx hash = hmap_hash(map, key);
+    *ok = 1;
+
+    hmap_migrate(map, HMAP_MIGRATE_SLOTS);
+
+    hmap_table* table;
+    size_fx slot = hmap_locate(map, key, hash, &table);
+    if(table){
+        void* old = table->slots[slot];
+        hmap_store_slot(table->slots + slot, entry);
+        return old;
+    }
+
+    table = map->table;
+    slot = hmap_find_free(table, hash);
+    if(table->ctrl[slot] == HMAP_CTRL_EMPTY && table->growth_left == 0){
+        if(!hmap_grow(map)){
+            *ok = 0;
+            return 0;
+        }
+        table = map->table;
+        slot = hmap_find_free(table, hash);
+    }
+
+    hmap_table_put(table, slot, hash, entry);
+    map->size++;
+
+    return 0;
+}
+
+void* hmap_remove(hmap_fx* map, const void* key){
+
+    hmap_migrate(map, HMAP_MIGRATE_SLOTS);
+
+    hmap_table* table;
+    size_fx slot = hmap_locate(map, key, hmap_hash(map, key), &table);
+    if(!table)
+        return 0;
+
+    void* entry = table->slots[slot];
+    hmap_table_erase(table, slot);
+    map->size--;
+
+    return entry;
+}
+
+size_fx hmap_slots(const hmap_fx* map){
+    return map->table->capacity + (map->old ? map->old->capacity : 0);
+}
+
+// slot index over both tables, the old one first
+static FX_INLINE const hmap_table* hmap_slot_table(const hmap_fx* map, size_fx* slot){
+
+    if(map->old){
+        if(*slot < map->old->capacity)
+            return map->old;
+        *slot -= map->old->capacity;
+    }
+    return map->table;
+}
+
+void* hmap_next(const hmap_fx* map, size_fx* cursor){
+
+    size_fx total = hmap_slots(map);
+
+    for(size_fx i = *cursor; i < total; i++){
+        size_fx slot = i;
+        const hmap_table* table = hmap_slot_table(map, &slot);
+        if(hmap_is_full(table->ctrl[slot])){
+            *cursor = i + 1;
+            return table->slots[slot];
+        }
+    }
+
+    *cursor = total;
+    return 0;
+}
+
+void* hmap_random(const hmap_fx* map, size_fx rnd){
+
+    if(map->size == 0)
+        return 0;
+
+    size_fx total = hmap_slots(map);
+    for(size_fx i = 0; i < total; i++){
+        size_fx slot = (rnd + i) % total;
+        const hmap_table* table = hmap_slot_table(map, &slot);
+        if(hmap_is_full(table->ctrl[slot]))
+            return table->slots[slot];
+    }
+
+    return 0;
+}
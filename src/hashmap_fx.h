@@ -0,0 +1,102 @@
+#ifndef __HASHMAP_FX_H__
+#define __HASHMAP_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+// Open addressing hash index (swiss table layout).
+// Every slot has one control byte: EMPTY, DELETED or the low 7 bits of the hash (h2).
+// Slots are probed a group (HMAP_GROUP_WIDTH control bytes) at a time, so a lookup usually
+// touches one control line and one slot before comparing the key.
+// The map stores entries (void*) only, the key is read back through key_of.
+// Growing is incremental: a full table becomes old and every hmap_set / hmap_remove moves the next
+// HMAP_MIGRATE_SLOTS of its slots into the new one (or hmap_migrate from a maintenance tick), so no
+// single call rehashes the whole map. Until then a key lives in exactly one of both, lookups probe both.
+// One writer at a time (caller side lock), hmap_get_concurrent may run beside it without a lock:
+// slots and control bytes are published with release stores, a moved entry is published in the new
+// table before it leaves the old one, and the drained old table goes to reclaim (when set) since
+// readers may still probe it.
+
+#define HMAP_GROUP_WIDTH 16 //one simd_fx.h group
+#define HMAP_MIGRATE_SLOTS (2 * HMAP_GROUP_WIDTH) //old table slots moved by each write
+
+#define HMAP_CTRL_EMPTY   ((signed char)-128)
+#define HMAP_CTRL_DELETED ((signed char)-2)
+
+typedef struct hmap_fx hmap_fx;
+typedef struct hmap_table hmap_table;
+
+typedef const void* (*hmap_key_of)(const void* entry);
+
+//one allocation: header, slots, control bytes
+struct hmap_table{
+    size_fx          capacity; //power of two and multiple of HMAP_GROUP_WIDTH
+    size_fx          growth_left; //inserts into EMPTY slots before a rehash is needed
+    signed char*     ctrl;
+    void**           slots;
+};
+
+struct hmap_fx{
+    hmap_table*             table;
+    hmap_table*             old; //being drained into table, 0 when no resize is running
+    size_fx                 migrated; //old slots below this one are already moved
+    size_fx                 size;
+
+    const hash_func*        hash;
+    const cmp_func*         compare;
+    hmap_key_of             key_of;
+    const allocator_fx*     allocator;
+
+    reclaim_fx              reclaim; //OPTIONAL, replaced tables are freed right away when 0
+    void*                   reclaim_aux;
+};
+
+//capacity: expected entry count, the map does not resize before it is reached
+int hmap_init(hmap_fx* map, size_fx capacity, const hash_func* hash, const cmp_func* compare,
+                hmap_key_of key_of, const allocator_fx* allocator);
+
+void hmap_destroy(hmap_fx* map);
+
+void* hmap_get(const hmap_fx* map, const void* key);
+
+//lookup without the writer lock... the entry lifetime is up to the caller (epoch_fx)
+void* hmap_get_concurrent(const hmap_fx* map, const void* key);
+
+void hmap_set_reclaim(hmap_fx* map, reclaim_fx reclaim, void* aux_data);
+
+// batch lookups: hash every key first, prefetch its group, then probe
+size_fx hmap_hash_of(const hmap_fx* map, const void* key);
+
+void hmap_prefetch(const hmap_fx* map, size_fx hash);
+
+void* hmap_get_hashed(const hmap_fx* map, const void* key, size_fx hash);
+
+//returns the replaced entry, or 0... *ok is set to 0 when the table could not grow
+void* hmap_set(hmap_fx* map, const void* key, void* entry, int* ok);
+
+void* hmap_remove(hmap_fx* map, const void* key);
+
+static FX_INLINE size_fx hmap_size(const hmap_fx* map){
+    return map->size;
+}
+
+//moves up to slots old table slots, returns 1 while a resize is still running
+bool_t hmap_migrate(hmap_fx* map, size_fx slots);
+
+//slots hmap_next walks over: the old table ones come first during a resize
+size_fx hmap_slots(const hmap_fx* map);
+
+//iterate full slots: start with *cursor = 0 (or any slot below hmap_slots), returns 0 when done
+void* hmap_next(const hmap_fx* map, size_fx* cursor);
+
+//first entry at or after a random slot (rnd), 0 if the map is empty
+void* hmap_random(const hmap_fx* map, size_fx rnd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
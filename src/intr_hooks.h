@@ -5,13 +5,16 @@
 extern "C" {
 #endif
 
-#include "lib/rbtree.h"
-#include "lib/list.h"
+#include "lib3rd/rbtree.h"
+#include "lib3rd/list.h"
+#include "timer_wheel.h"
 
 typedef RBTreeNode map_hook_t;
 
 typedef ListNode list_hook_t;
 
+typedef twheel_node ttl_hook_t;
+
 #ifdef __cplusplus
 }
 #endif
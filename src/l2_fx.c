@@ -0,0 +1,518 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <stdatomic.h>
+
+#include "l2_fx.h"
+
+#define L2_DEFAULT_BYTES    (1UL << 30)
+#define L2_SEGMENTS         64 //segment files open at most, dead ones waiting for readers included
+#define L2_LIVE_SEGMENTS    16 //a segment is max_bytes / L2_LIVE_SEGMENTS
+#define L2_MIN_SEGMENT      (64UL * 1024)
+#define L2_MAX_SEGMENT      (1UL << 31) //record offsets are 32 bit
+#define L2_MIN_CAPACITY     1024
+#define L2_PATH_MAX         4096
+
+#define L2_EMPTY            0
+#define L2_DELETED          1
+
+//on disk ahead of the key and value bytes
+typedef struct l2_record{
+    unsigned long long  hash;
+    unsigned long long  expires;
+    unsigned int        key_len;
+    unsigned int        value_len;
+} l2_record;
+
+typedef struct l2_slot{
+    unsigned long long  hash; //L2_EMPTY, L2_DELETED or the key hash
+    unsigned int        segment;
+    unsigned int        offset;
+    unsigned int        len; //whole record
+} l2_slot;
+
+typedef struct l2_segment{
+    int                 fd; //-1 when the slot is free
+    size_fx             seq; //creation order, the oldest is dropped first
+    size_fx             bytes;
+    size_fx             live; //bytes of the records the index points to
+    size_fx             readers;
+    bool_t              dead; //out of the index and unlinked, closed once readers is 0
+} l2_segment;
+
+struct l2_fx{
+    pthread_mutex_t     lock;
+    const allocator_fx* allocator;
+    char                dir[L2_PATH_MAX - 32];
+    size_fx             max_bytes;
+    size_fx             segment_bytes;
+    size_fx             bytes; //every open segment
+    size_fx             next_seq;
+    size_fx             instance; //file name prefix, tiers may share a directory (one per shard)
+
+    l2_segment          segments[L2_SEGMENTS];
+    size_fx             active; //segment records are appended to
+
+    l2_slot*            index; //linear probing
+    size_fx             capacity; //power of two
+    size_fx             size;
+    size_fx             used; //size plus L2_DELETED slots
+};
+
+//FNV-1a and a final mix... 0 and 1 are the free slot marks
+static size_fx l2_hash(const void* key, size_fx len){
+
+    const unsigned char* bytes = key;
+    size_fx h = 0xcbf29ce484222325UL;
+    for(size_fx i = 0; i < len; i++)
+        h = (h ^ bytes[i]) * 0x100000001b3UL;
+
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93UL;
+    h ^= h >> 32;
+    return h < 2 ? h + 2 : h;
+}
+
+static FX_INLINE size_fx l2_record_len(size_fx key_len, size_fx value_len){
+    return sizeof(l2_record) + key_len + value_len;
+}
+
+static _Atomic size_fx l2_instances;
+
+static void l2_path(l2_fx* l2, size_fx segment, char* path){
+    snprintf(path, L2_PATH_MAX, "%s/l2-%d-%lu-%lu.log", l2->dir, (int)getpid(), l2->instance, segment);
+}
+
+static bool_t l2_index_alloc(l2_fx* l2, size_fx capacity){
+
+    l2_slot* index = (*l2->allocator->alloc)(capacity * sizeof(l2_slot));
+    if(!index)
+        return 0;
+
+    zero_mem_fx(index, capacity * sizeof(l2_slot));
+    l2->index = index;
+    l2->capacity = capacity;
+    return 1;
+}
+
+//slot of hash, or capacity
+static size_fx l2_find(l2_fx* l2, size_fx hash){
+
+    size_fx mask = l2->capacity - 1;
+    for(size_fx i = hash & mask, n = 0; n < l2->capacity; i = (i + 1) & mask, n++){
+        if(l2->index[i].hash == hash)
+            return i;
+        if(l2->index[i].hash == L2_EMPTY)
+            break;
+    }
+
+    return l2->capacity;
+}
+
+//hash is not in the index
+static void l2_insert(l2_fx* l2, const l2_slot* slot){
+
+    size_fx mask = l2->capacity - 1;
+    size_fx i = slot->hash & mask;
+    while(l2->index[i].hash > L2_DELETED)
+        i = (i + 1) & mask;
+
+    if(l2->index[i].hash == L2_EMPTY)
+        l2->used++;
+    l2->index[i] = *slot;
+    l2->size++;
+}
+
+static void l2_erase(l2_fx* l2, size_fx i){
+
+    l2->segments[l2->index[i].segment].live -= l2->index[i].len;
+    l2->index[i].hash = L2_DELETED;
+    l2->size--;
+}
+
+//keeps the probes short: rebuilt at 3/4 use, doubled when the live keys need it
+static bool_t l2_index_reserve(l2_fx* l2){
+
+    if((l2->used + 1) * 4 <= l2->capacity * 3)
+        return 1;
+
+    l2_slot* old = l2->index;
+    size_fx old_capacity = l2->capacity;
+    size_fx capacity = (l2->size + 1) * 2 > old_capacity / 2 ? old_capacity * 2 : old_capacity;
+
+    if(!l2_index_alloc(l2, capacity)){
+        l2->index = old;
+        return 0;
+    }
+
+    l2->size = 0;
+    l2->used = 0;
+    for(size_fx i = 0; i < old_capacity; i++)
+        if(old[i].hash > L2_DELETED)
+            l2_insert(l2, old + i);
+
+    (*l2->allocator->free)(old);
+    return 1;
+}
+
+static void l2_segment_close(l2_segment* segment){
+
+    close(segment->fd);
+    segment->fd = -1;
+    segment->dead = 0;
+}
+
+//reader done with the segment, the last one closes a dead segment
+static void l2_release(l2_fx* l2, size_fx s){
+
+    l2_segment* segment = l2->segments + s;
+    if(--segment->readers == 0 && segment->dead)
+        l2_segment_close(segment);
+}
+
+//whole segment out of the tier: its keys leave the index, the file goes now, the fd after the readers
+static void l2_segment_drop(l2_fx* l2, size_fx s){
+
+    l2_segment* segment = l2->segments + s;
+
+    for(size_fx i = 0; i < l2->capacity && segment->live > 0; i++)
+        if(l2->index[i].hash > L2_DELETED && l2->index[i].segment == s)
+            l2_erase(l2, i);
+
+    char path[L2_PATH_MAX];
+    l2_path(l2, s, path);
+    unlink(path);
+
+    l2->bytes -= segment->bytes;
+    segment->bytes = 0;
+    segment->live = 0;
+    segment->dead = 1;
+    if(segment->readers == 0)
+        l2_segment_close(segment);
+}
+
+static bool_t l2_drop_oldest(l2_fx* l2){
+
+    size_fx oldest = L2_SEGMENTS;
+    for(size_fx s = 0; s < L2_SEGMENTS; s++){
+        l2_segment* segment = l2->segments + s;
+        if(s == l2->active || segment->fd < 0 || segment->dead)
+            continue;
+        if(oldest == L2_SEGMENTS || segment->seq < l2->segments[oldest].seq)
+            oldest = s;
+    }
+
+    if(oldest == L2_SEGMENTS)
+        return 0;
+
+    l2_segment_drop(l2, oldest);
+    return 1;
+}
+
+//new active segment, L2_SEGMENTS when every slot is taken by segments still being read
+static size_fx l2_segment_open(l2_fx* l2){
+
+    for(;;){
+        for(size_fx s = 0; s < L2_SEGMENTS; s++){
+            l2_segment* segment = l2->segments + s;
+            if(segment->fd >= 0)
+                continue;
+
+            char path[L2_PATH_MAX];
+            l2_path(l2, s, path);
+            segment->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+            if(segment->fd < 0)
+                return L2_SEGMENTS;
+
+            segment->seq = l2->next_seq++;
+            segment->bytes = 0;
+            segment->live = 0;
+            segment->readers = 0;
+            segment->dead = 0;
+            return s;
+        }
+
+        if(!l2_drop_oldest(l2))
+            return L2_SEGMENTS;
+    }
+}
+
+// Appends a record to the active segment (a full one is sealed first) and makes room under
+// max_bytes by dropping the oldest segments... *slot gets its place, hash included.
+static bool_t l2_append(l2_fx* l2, size_fx hash, const void* key, size_fx key_len, const void* value,
+                        size_fx value_len, unsigned long long expires, l2_slot* slot){
+
+    size_fx len = l2_record_len(key_len, value_len);
+    if(len > l2->segment_bytes)
+        return 0;
+
+    if(l2->segments[l2->active].bytes + len > l2->segment_bytes){
+        size_fx s = l2_segment_open(l2);
+        if(s == L2_SEGMENTS)
+            return 0;
+        l2->active = s;
+    }
+
+    while(l2->bytes + len > l2->max_bytes && l2_drop_oldest(l2))
+        ;
+
+    l2_segment* segment = l2->segments + l2->active;
+    l2_record record = {hash, expires, (unsigned int)key_len, (unsigned int)value_len};
+    struct iovec parts[3] = {
+        {&record, sizeof(record)},
+        {(void*)key, key_len},
+        {(void*)value, value_len}
+    };
+
+    if(pwritev(segment->fd, parts, 3, (off_t)segment->bytes) != (ssize_t)len)
+        return 0;
+
+    slot->hash = hash;
+    slot->segment = (unsigned int)l2->active;
+    slot->offset = (unsigned int)segment->bytes;
+    slot->len = (unsigned int)len;
+
+    segment->bytes += len;
+    segment->live += len;
+    l2->bytes += len;
+    return 1;
+}
+
+l2_fx* l2_open(const char* dir, size_fx max_bytes, const allocator_fx* allocator){
+
+    if(strlen(dir) >= sizeof(((l2_fx*)0)->dir))
+        return 0;
+
+    l2_fx* l2 = (*allocator->alloc)(sizeof(l2_fx));
+    if(!l2)
+        return 0;
+
+    pthread_mutex_init(&l2->lock, 0);
+    l2->allocator = allocator;
+    strcpy(l2->dir, dir);
+    l2->max_bytes = max_bytes ? max_bytes : L2_DEFAULT_BYTES;
+    l2->segment_bytes = l2->max_bytes / L2_LIVE_SEGMENTS;
+    if(l2->segment_bytes < L2_MIN_SEGMENT)
+        l2->segment_bytes = L2_MIN_SEGMENT;
+    if(l2->segment_bytes > L2_MAX_SEGMENT)
+        l2->segment_bytes = L2_MAX_SEGMENT;
+    l2->bytes = 0;
+    l2->next_seq = 0;
+    l2->active = L2_SEGMENTS;
+    l2->instance = atomic_fetch_add(&l2_instances, 1);
+    l2->size = 0;
+    l2->used = 0;
+
+    for(size_fx s = 0; s < L2_SEGMENTS; s++){
+        l2->segments[s].fd = -1;
+        l2->segments[s].readers = 0;
+        l2->segments[s].dead = 0;
+    }
+
+    if(!l2_index_alloc(l2, L2_MIN_CAPACITY)){
+        (*allocator->free)(l2);
+        return 0;
+    }
+
+    l2->active = l2_segment_open(l2);
+    if(l2->active == L2_SEGMENTS){
+        (*allocator->free)(l2->index);
+        (*allocator->free)(l2);
+        return 0;
+    }
+
+    return l2;
+}
+
+//no l2_get may still be running
+void l2_close(l2_fx* l2){
+
+    const allocator_fx* allocator = l2->allocator;
+
+    for(size_fx s = 0; s < L2_SEGMENTS; s++){
+        if(l2->segments[s].fd < 0)
+            continue;
+        if(!l2->segments[s].dead){
+            char path[L2_PATH_MAX];
+            l2_path(l2, s, path);
+            unlink(path);
+        }
+        close(l2->segments[s].fd);
+    }
+
+    pthread_mutex_destroy(&l2->lock);
+    (*allocator->free)(l2->index);
+    (*allocator->free)(l2);
+}
+
+int l2_put(l2_fx* l2, const void* key, size_fx key_len, const void* value, size_fx value_len,
+            unsigned long long expires){
+
+    size_fx hash = l2_hash(key, key_len);
+    l2_slot slot;
+
+    pthread_mutex_lock(&l2->lock);
+
+    int ok = l2_index_reserve(l2) && l2_append(l2, hash, key, key_len, value, value_len, expires, &slot);
+    if(ok){
+        size_fx i = l2_find(l2, hash);
+        if(i != l2->capacity)
+            l2_erase(l2, i);
+        l2_insert(l2, &slot);
+    }
+
+    pthread_mutex_unlock(&l2->lock);
+    return ok;
+}
+
+void* l2_get(l2_fx* l2, const void* key, size_fx key_len, size_fx* value_len, unsigned long long* expires){
+
+    size_fx hash = l2_hash(key, key_len);
+
+    pthread_mutex_lock(&l2->lock);
+    size_fx i = l2_find(l2, hash);
+    if(i == l2->capacity){
+        pthread_mutex_unlock(&l2->lock);
+        return 0;
+    }
+
+    l2_slot slot = l2->index[i];
+    l2_segment* segment = l2->segments + slot.segment;
+    segment->readers++;
+    int fd = segment->fd;
+    pthread_mutex_unlock(&l2->lock);
+
+    //the read holds no lock... a put meanwhile only makes this record an older version
+    char* buffer = (*l2->allocator->alloc)(slot.len);
+    ssize_t got = buffer ? pread(fd, buffer, slot.len, (off_t)slot.offset) : -1;
+
+    pthread_mutex_lock(&l2->lock);
+    l2_release(l2, slot.segment);
+    pthread_mutex_unlock(&l2->lock);
+
+    l2_record record;
+    if(got == (ssize_t)slot.len)
+        memcpy(&record, buffer, sizeof(record));
+
+    if(got != (ssize_t)slot.len || record.hash != hash || record.key_len != key_len
+        || memcmp(buffer + sizeof(record), key, key_len) != 0){
+        (*l2->allocator->free)(buffer);
+        return 0;
+    }
+
+    memmove(buffer, buffer + sizeof(record) + key_len, record.value_len);
+    *value_len = record.value_len;
+    if(expires)
+        *expires = record.expires;
+
+    return buffer;
+}
+
+bool_t l2_remove(l2_fx* l2, const void* key, size_fx key_len){
+
+    size_fx hash = l2_hash(key, key_len);
+
+    pthread_mutex_lock(&l2->lock);
+    size_fx i = l2_find(l2, hash);
+    bool_t found = i != l2->capacity;
+    if(found)
+        l2_erase(l2, i);
+    pthread_mutex_unlock(&l2->lock);
+
+    return found;
+}
+
+//sealed segment with the lowest live share under half, L2_SEGMENTS when none
+static size_fx l2_compact_pick(l2_fx* l2){
+
+    size_fx pick = L2_SEGMENTS;
+    for(size_fx s = 0; s < L2_SEGMENTS; s++){
+        l2_segment* segment = l2->segments + s;
+        if(s == l2->active || segment->fd < 0 || segment->dead || segment->live * 2 >= segment->bytes)
+            continue;
+        if(pick == L2_SEGMENTS || segment->live * l2->segments[pick].bytes < l2->segments[pick].live * segment->bytes)
+            pick = s;
+    }
+
+    return pick;
+}
+
+// The segment is read without the lock, then its records the index still points to are
+// appended to the active segment and the segment is dropped.
+size_fx l2_compact(l2_fx* l2, size_fx segments){
+
+    size_fx done = 0;
+
+    for(; done < segments; done++){
+        pthread_mutex_lock(&l2->lock);
+        size_fx s = l2_compact_pick(l2);
+        if(s == L2_SEGMENTS){
+            pthread_mutex_unlock(&l2->lock);
+            break;
+        }
+
+        l2_segment* segment = l2->segments + s;
+        segment->readers++;
+        int fd = segment->fd;
+        size_fx bytes = segment->bytes;
+        pthread_mutex_unlock(&l2->lock);
+
+        char* buffer = (*l2->allocator->alloc)(bytes);
+        ssize_t got = buffer ? pread(fd, buffer, bytes, 0) : -1;
+
+        pthread_mutex_lock(&l2->lock);
+        for(size_fx offset = 0; got == (ssize_t)bytes && offset + sizeof(l2_record) <= bytes; ){
+            l2_record record;
+            memcpy(&record, buffer + offset, sizeof(record));
+            size_fx len = l2_record_len(record.key_len, record.value_len);
+            if(offset + len > bytes)
+                break;
+
+            size_fx i = l2_find(l2, record.hash);
+            if(i != l2->capacity && l2->index[i].segment == s && l2->index[i].offset == offset
+                && l2_index_reserve(l2)){
+                const char* key = buffer + offset + sizeof(record);
+                l2_slot slot;
+                if(l2_append(l2, record.hash, key, record.key_len, key + record.key_len, record.value_len,
+                                record.expires, &slot)){
+                    //the append may have dropped segments, the slot is looked up again
+                    i = l2_find(l2, record.hash);
+                    if(i != l2->capacity)
+                        l2_erase(l2, i);
+                    l2_insert(l2, &slot);
+                }
+            }
+            offset += len;
+        }
+
+        if(!segment->dead)
+            l2_segment_drop(l2, s);
+        l2_release(l2, s);
+        pthread_mutex_unlock(&l2->lock);
+
+        (*l2->allocator->free)(buffer);
+    }
+
+    return done;
+}
+
+size_fx l2_size(l2_fx* l2){
+
+    pthread_mutex_lock(&l2->lock);
+    size_fx size = l2->size;
+    pthread_mutex_unlock(&l2->lock);
+
+    return size;
+}
+
+size_fx l2_bytes(l2_fx* l2){
+
+    pthread_mutex_lock(&l2->lock);
+    size_fx bytes = l2->bytes;
+    pthread_mutex_unlock(&l2->lock);
+
+    return bytes;
+}
@@ -0,0 +1,48 @@
+#ifndef __L2_FX_H__
+#define __L2_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+// Second level store on local disk for the entries the cache evicts (flat keys and values).
+// Records are appended to segment files (dir/l2-<pid>-<tier>-<n>.log, tiers may share dir) and the
+// memory index keeps only the key hash and the record place, 24 bytes per key: the key itself is
+// checked on the disk read, so two keys with the same 64 bit hash keep only the last one (a cache
+// tier may lose entries).
+// Segments mostly dead are rewritten by l2_compact, the oldest segment is dropped when the files
+// pass max_bytes. Index work holds a mutex, the disk reads (pread) run outside it so a slow read
+// never blocks other lookups... a segment is only closed after its last reader.
+// The files are removed by l2_close, nothing survives a restart.
+
+typedef struct l2_fx l2_fx;
+
+//dir must exist, max_bytes bounds the segment files (0 for the default, 1 GiB)
+l2_fx* l2_open(const char* dir, size_fx max_bytes, const allocator_fx* allocator);
+
+void l2_close(l2_fx* l2);
+
+//expires: wheel ms (0 never), replaces an older record of the key
+int l2_put(l2_fx* l2, const void* key, size_fx key_len, const void* value, size_fx value_len,
+            unsigned long long expires);
+
+//value bytes of key in allocator memory (the caller frees them), 0 when not stored
+void* l2_get(l2_fx* l2, const void* key, size_fx key_len, size_fx* value_len, unsigned long long* expires);
+
+bool_t l2_remove(l2_fx* l2, const void* key, size_fx key_len);
+
+//rewrites up to segments segments holding less than half live records, returns the ones done
+size_fx l2_compact(l2_fx* l2, size_fx segments);
+
+size_fx l2_size(l2_fx* l2);
+
+//bytes in the segment files, dead records included
+size_fx l2_bytes(l2_fx* l2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __LFU_FX_H__
+#define __LFU_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+#include "flexnode.h"
+
+// LFU as a logarithmic 8 bit (Morris) counter per node with time based decay.
+// The counter grows with probability 1 / ((counter - LFU_INIT_VAL) * log_factor + 1),
+// so 255 is only reached after about a million hits (log_factor 10), and it loses one
+// point every decay_time minutes without access, so old hot keys age out.
+// Victims are picked by the sampled eviction pool, eviction cost is constant.
+
+#define LFU_INIT_VAL            5
+#define LFU_DEFAULT_LOG_FACTOR  10
+#define LFU_DEFAULT_DECAY_TIME  1 //minutes
+
+typedef struct lfu_config{
+    size_fx     log_factor;
+    size_fx     decay_time;
+} lfu_config;
+
+static FX_INLINE unsigned short lfu_minutes(time_fx now){
+    return (unsigned short)((now.tv_sec / 60) & 0xFFFF);
+}
+
+static FX_INLINE unsigned short lfu_elapsed(unsigned short now_min, unsigned short ldt){
+    return now_min >= ldt ? now_min - ldt : 0xFFFF - ldt + now_min;
+}
+
+//counter value after decay... does not write the node
+static FX_INLINE unsigned char lfu_decayed(const metadata_t* meta, unsigned short now_min, const lfu_config* config){
+
+    if(config->decay_time == 0)
+        return meta->freq;
+
+    size_fx periods = lfu_elapsed(now_min, meta->freq_ldt) / config->decay_time;
+    return periods >= meta->freq ? 0 : (unsigned char)(meta->freq - periods);
+}
+
+static FX_INLINE void lfu_reset(metadata_t* meta, time_fx now){
+    meta->freq = LFU_INIT_VAL;
+    meta->freq_ldt = lfu_minutes(now);
+}
+
+static FX_INLINE void lfu_touch(metadata_t* meta, time_fx now, size_fx rnd, const lfu_config* config){
+
+    unsigned short now_min = lfu_minutes(now);
+    unsigned char counter = lfu_decayed(meta, now_min, config);
+
+    if(counter < 255){
+        size_fx baseval = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+        // rnd < 2^64 / (baseval * log_factor + 1), without floating point
+        size_fx limit = ~(size_fx)0 / (baseval * config->log_factor + 1);
+        if(rnd <= limit)
+            counter++;
+    }
+
+    meta->freq = counter;
+    meta->freq_ldt = now_min;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+#include <string.h>
+#include <stdatomic.h>
+
+#include "repl_fx.h"
+
+#define REPL_MIN_CAPACITY   4096
+#define REPL_CACHE_LINE     64
+
+struct repl_fx{
+    const allocator_fx* allocator;
+    unsigned char*      ring;
+    size_fx             capacity; //power of two
+    size_fx             next_seq; //producer only
+
+    char                pad[REPL_CACHE_LINE];
+    _Atomic size_fx     head; //bytes ever appended, written by the producer
+    _Atomic size_fx     dropped;
+
+    char                pad2[REPL_CACHE_LINE];
+    _Atomic size_fx     tail; //bytes ever drained, written by the consumer
+};
+
+static FX_INLINE void repl_put(unsigned char* out, unsigned long long v, size_fx bytes){
+
+    for(size_fx i = 0; i < bytes; i++)
+        out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static FX_INLINE unsigned long long repl_get(const unsigned char* in, size_fx bytes){
+
+    unsigned long long v = 0;
+    for(size_fx i = 0; i < bytes; i++)
+        v |= (unsigned long long)in[i] << (8 * i);
+    return v;
+}
+
+//ring positions wrap, a copy is at most two pieces
+static void repl_ring_write(repl_fx* repl, size_fx pos, const void* src, size_fx len){
+
+    size_fx at = pos & (repl->capacity - 1);
+    size_fx first = len < repl->capacity - at ? len : repl->capacity - at;
+    memcpy(repl->ring + at, src, first);
+    memcpy(repl->ring, (const unsigned char*)src + first, len - first);
+}
+
+static void repl_ring_read(repl_fx* repl, size_fx pos, void* dst, size_fx len){
+
+    size_fx at = pos & (repl->capacity - 1);
+    size_fx first = len < repl->capacity - at ? len : repl->capacity - at;
+    memcpy(dst, repl->ring + at, first);
+    memcpy((unsigned char*)dst + first, repl->ring, len - first);
+}
+
+repl_fx* repl_new(size_fx capacity, const allocator_fx* allocator){
+
+    size_fx size = REPL_MIN_CAPACITY;
+    while(size < capacity)
+        size <<= 1;
+
+    repl_fx* repl = (*allocator->alloc)(sizeof(repl_fx));
+    if(!repl)
+        return 0;
+    repl->ring = (*allocator->alloc)(size);
+    if(!repl->ring){
+        (*allocator->free)(repl);
+        return 0;
+    }
+
+    repl->allocator = allocator;
+    repl->capacity = size;
+    repl->next_seq = 0;
+    atomic_init(&repl->head, 0);
+    atomic_init(&repl->dropped, 0);
+    atomic_init(&repl->tail, 0);
+    return repl;
+}
+
+void repl_free(repl_fx* repl){
+
+    const allocator_fx* allocator = repl->allocator;
+    (*allocator->free)(repl->ring);
+    (*allocator->free)(repl);
+}
+
+bool_t repl_append(repl_fx* repl, unsigned char op, const void* key, size_fx key_len,
+                    const void* value, size_fx value_len, unsigned long long expires){
+
+    size_fx seq = repl->next_seq++;
+    size_fx len = REPL_HEADER + key_len + value_len;
+
+    size_fx head = atomic_load_explicit(&repl->head, memory_order_relaxed);
+    size_fx tail = atomic_load_explicit(&repl->tail, memory_order_acquire);
+    if(len > repl->capacity - (head - tail)){
+        atomic_fetch_add_explicit(&repl->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    unsigned char header[REPL_HEADER];
+    repl_put(header, len - 4, 4);
+    repl_put(header + 4, seq, 8);
+    header[12] = op;
+    repl_put(header + 13, expires, 8);
+    repl_put(header + 21, key_len, 4);
+
+    repl_ring_write(repl, head, header, REPL_HEADER);
+    repl_ring_write(repl, head + REPL_HEADER, key, key_len);
+    if(value_len)
+        repl_ring_write(repl, head + REPL_HEADER + key_len, value, value_len);
+
+    atomic_store_explicit(&repl->head, head + len, memory_order_release);
+    return 1;
+}
+
+size_fx repl_drain(repl_fx* repl, void* buf, size_fx capacity){
+
+    size_fx tail = atomic_load_explicit(&repl->tail, memory_order_relaxed);
+    size_fx head = atomic_load_explicit(&repl->head, memory_order_acquire);
+
+    size_fx bytes = 0;
+    while(tail + bytes < head){
+        unsigned char prefix[4];
+        repl_ring_read(repl, tail + bytes, prefix, 4);
+        size_fx len = 4 + repl_get(prefix, 4);
+        if(bytes + len > capacity)
+            break;
+        bytes += len;
+    }
+
+    repl_ring_read(repl, tail, buf, bytes);
+    atomic_store_explicit(&repl->tail, tail + bytes, memory_order_release);
+    return bytes;
+}
+
+size_fx repl_pending(repl_fx* repl){
+
+    size_fx tail = atomic_load_explicit(&repl->tail, memory_order_acquire);
+    return atomic_load_explicit(&repl->head, memory_order_acquire) - tail;
+}
+
+size_fx repl_dropped(repl_fx* repl){
+    return atomic_load_explicit(&repl->dropped, memory_order_relaxed);
+}
+
+bool_t repl_next(const void* buf, size_fx len, size_fx* offset, repl_record* record){
+
+    if(*offset >= len || len - *offset < REPL_HEADER)
+        return 0;
+
+    const unsigned char* at = (const unsigned char*)buf + *offset;
+    size_fx left = len - *offset;
+
+    size_fx record_len = 4 + repl_get(at, 4);
+    size_fx key_len = repl_get(at + 21, 4);
+    if(record_len > left || record_len < REPL_HEADER + key_len)
+        return 0;
+
+    record->seq = repl_get(at + 4, 8);
+    record->op = at[12];
+    record->expires = repl_get(at + 13, 8);
+    record->key = at + REPL_HEADER;
+    record->key_len = key_len;
+    record->value = at + REPL_HEADER + key_len;
+    record->value_len = record_len - REPL_HEADER - key_len;
+
+    *offset += record_len;
+    return 1;
+}
@@ -0,0 +1,64 @@
+#ifndef __REPL_FX_H__
+#define __REPL_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+// Mutation log to keep replica caches warm: the cache appends one record per set, delete (removes
+// and memory evictions) and expiry, the application drains whole records in batches to the network
+// and the replica replays them (fcache_repl_apply).
+// Record, little endian: u32 len (bytes after it) | u64 seq | u8 op | u64 expires (ms, 0 never) |
+// u32 key_len | key | value (the rest, REPL_SET only).
+// The ring has one producer (the cache writer) and one consumer (the drainer), no lock. A record
+// that does not fit is dropped but still takes its seq: a gap in seq means the replica must resync.
+
+enum REPL_OP {
+    REPL_SET = 1,
+    REPL_DEL,
+    REPL_EXPIRE
+};
+
+#define REPL_HEADER 25 //u32 len, u64 seq, u8 op, u64 expires, u32 key_len
+
+typedef struct repl_fx repl_fx;
+
+typedef struct repl_record{
+    size_fx             seq;
+    unsigned char       op; //enum REPL_OP
+    unsigned long long  expires;
+    const void*         key; //into the drained buffer
+    size_fx             key_len;
+    const void*         value;
+    size_fx             value_len;
+} repl_record;
+
+//capacity bytes, rounded up to a power of two
+repl_fx* repl_new(size_fx capacity, const allocator_fx* allocator);
+
+void repl_free(repl_fx* repl);
+
+//0 when the ring has no room, the record is dropped and counted
+bool_t repl_append(repl_fx* repl, unsigned char op, const void* key, size_fx key_len,
+                    const void* value, size_fx value_len, unsigned long long expires);
+
+//whole records, oldest first, up to capacity bytes... returns the bytes written to buf.
+//a buf of the ring capacity always takes the next record
+size_fx repl_drain(repl_fx* repl, void* buf, size_fx capacity);
+
+//bytes waiting to be drained
+size_fx repl_pending(repl_fx* repl);
+
+size_fx repl_dropped(repl_fx* repl);
+
+//decodes the record at *offset of a drained batch and moves offset past it, 0 at the end or on a
+//torn record
+bool_t repl_next(const void* buf, size_fx len, size_fx* offset, repl_record* record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
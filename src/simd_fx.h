@@ -0,0 +1,92 @@
+#ifndef __SIMD_FX_H__
+#define __SIMD_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Group probing for the swiss table indexes (hashmap_fx, flexcache_define.h).
+// A group is 16 control bytes: EMPTY and DELETED are negative, a full slot holds h2 (0..127).
+// The masks have bit i set for byte i, walked with simd_mask_next.
+// SSE2 is part of x86-64 and NEON of AArch64, so these are chosen at compile time and stay inline,
+// a runtime dispatch would put an indirect call back on every probe. Other targets loop.
+
+#define SIMD_GROUP_WIDTH 16
+
+typedef unsigned int simd_mask;
+
+static FX_INLINE unsigned int simd_mask_next(simd_mask* mask){
+
+    unsigned int i = (unsigned int)__builtin_ctz(*mask);
+    *mask &= *mask - 1;
+    return i;
+}
+
+#if defined(__SSE2__)
+
+static FX_INLINE simd_mask simd_group_match(const signed char* ctrl, signed char h2){
+
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (simd_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
+
+//EMPTY and DELETED slots: the sign bit
+static FX_INLINE simd_mask simd_group_match_free(const signed char* ctrl){
+    return (simd_mask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+static FX_INLINE simd_mask simd_neon_mask(uint8x16_t bytes){
+
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t set = vandq_u8(bytes, vld1q_u8(bits));
+    return (simd_mask)vaddv_u8(vget_low_u8(set)) | ((simd_mask)vaddv_u8(vget_high_u8(set)) << 8);
+}
+
+static FX_INLINE simd_mask simd_group_match(const signed char* ctrl, signed char h2){
+    return simd_neon_mask(vceqq_s8(vld1q_s8(ctrl), vdupq_n_s8(h2)));
+}
+
+static FX_INLINE simd_mask simd_group_match_free(const signed char* ctrl){
+    return simd_neon_mask(vcltzq_s8(vld1q_s8(ctrl)));
+}
+
+#else
+
+static FX_INLINE simd_mask simd_group_match(const signed char* ctrl, signed char h2){
+
+    simd_mask mask = 0;
+    for(unsigned int i = 0; i < SIMD_GROUP_WIDTH; i++)
+        mask |= (simd_mask)(ctrl[i] == h2) << i;
+    return mask;
+}
+
+static FX_INLINE simd_mask simd_group_match_free(const signed char* ctrl){
+
+    simd_mask mask = 0;
+    for(unsigned int i = 0; i < SIMD_GROUP_WIDTH; i++)
+        mask |= (simd_mask)(ctrl[i] < 0) << i;
+    return mask;
+}
+
+#endif
+
+//a lookup may stop at a group holding an EMPTY (-128)
+static FX_INLINE simd_mask simd_group_match_empty(const signed char* ctrl){
+    return simd_group_match(ctrl, (signed char)-128);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
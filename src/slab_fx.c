@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "slab_fx.h"
+
+#define SLAB_MAGIC          0x51AB51ABu
+#define SLAB_LARGE          ((unsigned int)-1)
+#define SLAB_HEADER_SIZE    64 //keeps slots 16 bytes aligned
+
+#define SLAB_N_CLASSES      37
+
+//past 4096 the classes split a slab in 12 down to 2 slots, nothing left over but the header
+static const size_fx slab_class_size[SLAB_N_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096,
+    5440, 6528, 8160, 9312, 10880, 13056, 16320, 21760,
+    32736
+};
+
+typedef struct slab_header{
+    unsigned int    magic;
+    unsigned int    class_idx; //SLAB_LARGE for dedicated blocks
+    size_fx         block_size;
+} slab_header;
+
+//free slots are chained through their first word
+typedef struct slab_free_slot{
+    struct slab_free_slot* next;
+} slab_free_slot;
+
+typedef struct slab_depot{
+    pthread_mutex_t     lock;
+    slab_free_slot*     free_list;
+    size_fx             n_free;
+} slab_depot;
+
+typedef struct slab_magazine{
+    size_fx             count;
+    void*               slots[SLAB_FX_MAGAZINE];
+} slab_magazine;
+
+typedef struct slab_thread_cache{
+    bool_t              registered;
+    slab_magazine       mags[SLAB_N_CLASSES];
+} slab_thread_cache;
+
+static slab_depot slab_depots[SLAB_N_CLASSES];
+static unsigned char slab_class_of[SLAB_FX_MAX_CLASS / 16 + 1];
+
+static _Atomic size_fx slab_held = 0;
+
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slab_thread_key;
+
+static _Thread_local slab_thread_cache slab_tl_cache;
+
+static void slab_thread_exit(void* tl_cache);
+
+static void slab_init_once(void){
+
+    unsigned char class_idx = 0;
+    for(size_fx i = 0; i <= SLAB_FX_MAX_CLASS / 16; i++){
+        while(slab_class_size[class_idx] < i * 16)
+            class_idx++;
+        slab_class_of[i] = class_idx;
+    }
+
+    for(size_fx i = 0; i < SLAB_N_CLASSES; i++){
+        pthread_mutex_init(&slab_depots[i].lock, 0);
+        slab_depots[i].free_list = 0;
+        slab_depots[i].n_free = 0;
+    }
+
+    pthread_key_create(&slab_thread_key, slab_thread_exit);
+}
+
+static FX_INLINE unsigned int slab_class(size_fx size){
+    return slab_class_of[(size + 15) / 16];
+}
+
+static FX_INLINE size_fx slab_slots_per_slab(unsigned int class_idx){
+    return (SLAB_FX_SIZE - SLAB_HEADER_SIZE) / slab_class_size[class_idx];
+}
+
+static FX_INLINE slab_header* slab_header_of(void* ptr){
+    return (slab_header*)((size_fx)ptr & ~(size_fx)(SLAB_FX_SIZE - 1));
+}
+
+static slab_thread_cache* slab_thread(void){
+
+    slab_thread_cache* tl_cache = &slab_tl_cache;
+    if(!tl_cache->registered){
+        pthread_once(&slab_once, slab_init_once);
+        pthread_setspecific(slab_thread_key, tl_cache);
+        tl_cache->registered = 1;
+    }
+
+    return tl_cache;
+}
+
+// New slab from the system, every slot goes to the depot free list.
+// Called with the depot lock held.
+static int slab_carve(slab_depot* depot, unsigned int class_idx){
+
+    char* block = aligned_alloc(SLAB_FX_SIZE, SLAB_FX_SIZE);
+    if(!block)
+        return 0;
+
+    slab_header* header = (slab_header*)block;
+    header->magic = SLAB_MAGIC;
+    header->class_idx = class_idx;
+    header->block_size = SLAB_FX_SIZE;
+
+    size_fx slot_size = slab_class_size[class_idx];
+    size_fx n_slots = slab_slots_per_slab(class_idx);
+    char* slot = block + SLAB_HEADER_SIZE;
+
+    for(size_fx i = 0; i < n_slots; i++, slot += slot_size){
+        slab_free_slot* free_slot = (slab_free_slot*)slot;
+        free_slot->next = depot->free_list;
+        depot->free_list = free_slot;
+    }
+    depot->n_free += n_slots;
+
+    atomic_fetch_add_explicit(&slab_held, SLAB_FX_SIZE, memory_order_relaxed);
+    return 1;
+}
+
+static int slab_refill(slab_magazine* mag, unsigned int class_idx){
+
+    slab_depot* depot = &slab_depots[class_idx];
+
+    pthread_mutex_lock(&depot->lock);
+
+    if(!depot->free_list && !slab_carve(depot, class_idx)){
+        pthread_mutex_unlock(&depot->lock);
+        return 0;
+    }
+
+    while(depot->free_list && mag->count < SLAB_FX_MAGAZINE / 2){
+        slab_free_slot* free_slot = depot->free_list;
+        depot->free_list = free_slot->next;
+        depot->n_free--;
+        mag->slots[mag->count++] = free_slot;
+    }
+
+    pthread_mutex_unlock(&depot->lock);
+    return 1;
+}
+
+static void slab_flush(slab_magazine* mag, unsigned int class_idx, size_fx keep){
+
+    slab_depot* depot = &slab_depots[class_idx];
+
+    pthread_mutex_lock(&depot->lock);
+
+    while(mag->count > keep){
+        slab_free_slot* free_slot = mag->slots[--mag->count];
+        free_slot->next = depot->free_list;
+        depot->free_list = free_slot;
+        depot->n_free++;
+    }
+
+    pthread_mutex_unlock(&depot->lock);
+}
+
+static void* slab_alloc_large(size_fx size){
+
+    size_fx block_size = slab_usable(size);
+
+    char* block = aligned_alloc(SLAB_FX_SIZE, block_size);
+    if(!block)
+        return 0;
+
+    slab_header* header = (slab_header*)block;
+    header->magic = SLAB_MAGIC;
+    header->class_idx = SLAB_LARGE;
+    header->block_size = block_size;
+
+    atomic_fetch_add_explicit(&slab_held, block_size, memory_order_relaxed);
+    return block + SLAB_HEADER_SIZE;
+}
+
+void* slab_alloc(size_fx size){
+
+    if(size > SLAB_FX_MAX_CLASS){
+        pthread_once(&slab_once, slab_init_once);
+        return slab_alloc_large(size);
+    }
+
+    slab_thread_cache* tl_cache = slab_thread();
+    unsigned int class_idx = slab_class(size ? size : 1);
+    slab_magazine* mag = &tl_cache->mags[class_idx];
+
+    if(mag->count == 0 && !slab_refill(mag, class_idx))
+        return 0;
+
+    return mag->slots[--mag->count];
+}
+
+void slab_free(void* ptr){
+
+    if(!ptr)
+        return;
+
+    slab_header* header = slab_header_of(ptr);
+
+    if(header->class_idx == SLAB_LARGE){
+        atomic_fetch_sub_explicit(&slab_held, header->block_size, memory_order_relaxed);
+        free(header);
+        return;
+    }
+
+    unsigned int class_idx = header->class_idx;
+    slab_magazine* mag = &slab_thread()->mags[class_idx];
+
+    if(mag->count == SLAB_FX_MAGAZINE)
+        slab_flush(mag, class_idx, SLAB_FX_MAGAZINE / 2);
+
+    mag->slots[mag->count++] = ptr;
+}
+
+int slab_prefill(size_fx size, size_fx count){
+
+    if(size > SLAB_FX_MAX_CLASS)
+        return 0;
+
+    pthread_once(&slab_once, slab_init_once);
+
+    unsigned int class_idx = slab_class(size ? size : 1);
+    slab_depot* depot = &slab_depots[class_idx];
+
+    pthread_mutex_lock(&depot->lock);
+
+    int status = 1;
+    while(depot->n_free < count){
+        if(!slab_carve(depot, class_idx)){
+            status = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&depot->lock);
+    return status;
+}
+
+size_fx slab_usable(size_fx size){
+
+    if(size > SLAB_FX_MAX_CLASS)
+        return (size + SLAB_HEADER_SIZE + SLAB_FX_SIZE - 1) & ~(size_fx)(SLAB_FX_SIZE - 1);
+
+    pthread_once(&slab_once, slab_init_once);
+    return slab_class_size[slab_class(size ? size : 1)];
+}
+
+size_fx slab_held_memory(void){
+    return atomic_load_explicit(&slab_held, memory_order_relaxed);
+}
+
+void slab_thread_flush(void){
+
+    slab_thread_cache* tl_cache = &slab_tl_cache;
+    if(!tl_cache->registered)
+        return;
+
+    for(unsigned int i = 0; i < SLAB_N_CLASSES; i++){
+        if(tl_cache->mags[i].count)
+            slab_flush(&tl_cache->mags[i], i, 0);
+    }
+}
+
+static void slab_thread_exit(void* tl_cache){
+
+    (void)tl_cache;
+    slab_thread_flush();
+}
+
+static alloc_fx slab_alloc_fx = slab_alloc;
+static free_fx slab_free_fx = slab_free;
+static held_fx slab_held_fx = slab_held_memory;
+static usable_fx slab_usable_fx = slab_usable;
+
+static const allocator_fx slab_allocator_fx = {
+    .alloc = &slab_alloc_fx,
+    .free = &slab_free_fx,
+    .held = &slab_held_fx,
+    .usable = &slab_usable_fx
+};
+
+const allocator_fx* slab_allocator(void){
+    return &slab_allocator_fx;
+}
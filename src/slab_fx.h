@@ -0,0 +1,45 @@
+#ifndef __SLAB_FX_H__
+#define __SLAB_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+
+// Size class slab allocator implementing allocator_fx.
+// Memory is taken from the system in SLAB_FX_SIZE aligned slabs carved in equal slots,
+// freed slots go back to a thread local magazine and are reused by the next alloc of the same
+// class without touching the system allocator or any lock.
+// Magazines exchange slots with a per class depot (locked) only when they run empty or full.
+// Requests above SLAB_FX_MAX_CLASS get a dedicated aligned block (whole slabs).
+// Slabs are never given back to the system, slab_held_memory reports what is kept (process wide,
+// one slab serves every cache using it).
+
+#define SLAB_FX_SIZE        (64 * 1024)
+#define SLAB_FX_MAX_CLASS   32736 //two slots per slab
+#define SLAB_FX_MAGAZINE    64
+
+const allocator_fx* slab_allocator(void);
+
+void* slab_alloc(size_fx size);
+
+void slab_free(void* ptr);
+
+//carve slabs up front for count slots of size (ex: fnode_sizeof(), expected keys)
+int slab_prefill(size_fx size, size_fx count);
+
+//bytes an alloc of size takes: its class size, whole slabs for the dedicated blocks
+size_fx slab_usable(size_fx size);
+
+//bytes reserved from the system, including slots cached in magazines and depots
+size_fx slab_held_memory(void);
+
+//return the calling thread magazines to the depots (also done on thread exit)
+void slab_thread_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,28 +1,51 @@
 #include "stack_fx.h"
 // #include "com_types.h"
 
-#define DEFAULT_CAPACITY 8
 #define DEFAULT_EXPANSION_FACTOR 2
 
 #define CC_MAX_ELEMENTS ((size_fx) - 2)
 
-struct stack_fx{
-    size_fx          size;
-    size_fx          capacity;
-    void**          buffer;
-    allocator_fx   allocator;
-};
+void stack_init(stack_fx* stck, const allocator_fx* alloc){
 
-void stack_init(stack_fx* stck, allocator_fx* alloc){
-    
-    stck = (*alloc->alloc)(sizeof(stack_fx));
+    stck->size = 0;
+    stck->capacity = STACK_FX_INLINE;
+    stck->buffer = stck->inline_buf;
+    stck->allocator = *alloc;
+    stck->owned = 0;
+}
+
+stack_fx* stack_new(const allocator_fx* alloc){
+
+    stack_fx* stck = (*alloc->alloc)(sizeof(stack_fx));
     if (!stck)
-        return;
+        return 0;
+
+    stack_init(stck, alloc);
+    stck->owned = 1;
+
+    return stck;
+}
+
+static void release_buffer(stack_fx* stck){
 
+    if (stck->buffer != stck->inline_buf)
+        (*stck->allocator.free)(stck->buffer);
+
+    stck->buffer = stck->inline_buf;
+    stck->capacity = STACK_FX_INLINE;
+}
+
+void stack_free(stack_fx* stck){
+
+    release_buffer(stck);
     stck->size = 0;
-    stck->capacity = 0;
-    stck->buffer = 0;
-    stck->allocator = *alloc;
+
+    if (stck->owned)
+        (*stck->allocator.free)(stck);
+}
+
+size_fx stack_size(const stack_fx* stck){
+    return stck->size;
 }
 
 static int expand_capacity(stack_fx* stck){
@@ -39,10 +62,10 @@ static int expand_capacity(stack_fx* stck){
     if (!new_buff)
         return 0;
 
-    memcopy_fx(new_buff, stck->buffer, stck->size * sizeof(void*));
+    memcopy_fx(stck->buffer, new_buff, stck->size * sizeof(void*));
     // memcopy_zer_src_fx(new_buff, stck->buffer, stck->size * sizeof(void*)); //need zero old buffer ??
 
-    (*stck->allocator.free)(stck->buffer);
+    release_buffer(stck);
     stck->buffer = new_buff;
     stck->capacity = new_capacity;
 
@@ -52,15 +75,6 @@ static int expand_capacity(stack_fx* stck){
 
 int stack_push(stack_fx* stck, void *element){
 
-    if(stck->size == 0){
-        stck->buffer = (*stck->allocator.alloc)(DEFAULT_CAPACITY * sizeof(void*));
-        if (!stck->buffer)
-            return 0;
-
-        // zero_mem_fx(stck->buffer, DEFAULT_CAPACITY); //need zero new buffer ?
-        stck->capacity = DEFAULT_CAPACITY;
-    }
-
     if (stck->size >= stck->capacity) {
         int status = expand_capacity(stck);
         if (status == 0)
@@ -73,22 +87,33 @@ int stack_push(stack_fx* stck, void *element){
     return 1;
 }
 
+int stack_concat(stack_fx* dst, stack_fx* src){
+
+    for (size_fx i = 0; i < src->size; i++){
+        if (!stack_push(dst, src->buffer[i]))
+            return 0;
+    }
+
+    release_buffer(src);
+    src->size = 0;
+
+    return 1;
+}
+
 void* stack_pop(stack_fx* stck){
 
     if (stck->size == 0){
-        (*stck->allocator.free)(stck);
+        if (stck->owned)
+            stack_free(stck);
         return 0;
     }
 
-    void* tgt = 0;
-    swap_ptr_fx(stck->buffer[stck->size], tgt);
-
     stck->size--;
+    void* tgt = stck->buffer[stck->size];
 
-    if (stck->size == 0){
-        (*stck->allocator.free)(stck->buffer);
-        stck->buffer = 0;
-    }
+    //back to the inline buffer once empty
+    if (stck->size == 0)
+        release_buffer(stck);
 
     return tgt;
-}
\ No newline at end of file
+}
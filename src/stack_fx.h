@@ -1,4 +1,3 @@
-
 #ifndef STACK_FX_H
 #define STACK_FX_H
 
@@ -8,12 +7,36 @@ extern "C" {
 
 #include "commons.h"
 
+//elements held in the stack struct itself before the first heap buffer
+#define STACK_FX_INLINE 8
+
 typedef struct stack_fx stack_fx;
 
-void stack_init(stack_fx* stack, allocator_fx* alloc);
+// public so a stack can live on the caller stack (stack_init): short batches never touch the heap
+struct stack_fx{
+    size_fx          size;
+    size_fx          capacity;
+    void**           buffer; //inline_buf until it grows
+    allocator_fx     allocator;
+    bool_t           owned; //from stack_new: released with the last pop, or stack_free
+    void*            inline_buf[STACK_FX_INLINE];
+};
+
+void stack_init(stack_fx* stack, const allocator_fx* alloc);
+
+stack_fx* stack_new(const allocator_fx* alloc);
+
+//releases the heap buffer, and the stack itself when it came from stack_new
+void stack_free(stack_fx* stck);
+
+size_fx stack_size(const stack_fx* stck);
+
+//moves every element of src on top of dst, src is left empty
+int stack_concat(stack_fx* dst, stack_fx* src);
 
 int stack_push(stack_fx* stck, void *element);
 
+//pop on an empty stack_new stack releases it
 void* stack_pop(stack_fx* stck);
 
 #ifdef __cplusplus
@@ -0,0 +1,68 @@
+#include "stats_fx.h"
+
+_Thread_local size_fx stats_fx_tl_stripe = 0;
+
+static _Atomic size_fx stats_next_stripe = 0;
+
+//round robin, so the first STATS_FX_STRIPES threads never share a line
+size_fx stats_fx_assign(void){
+
+    size_fx stripe = atomic_fetch_add_explicit(&stats_next_stripe, 1, memory_order_relaxed) % STATS_FX_STRIPES;
+    stats_fx_tl_stripe = stripe + 1;
+    return stripe;
+}
+
+void stats_init(stats_fx* stats){
+
+    for(size_fx s = 0; s < STATS_FX_STRIPES; s++){
+        stats_stripe* stripe = &stats->stripes[s].stripe;
+
+        for(size_fx i = 0; i < STAT_N_COUNTERS; i++)
+            atomic_store_explicit(&stripe->counters[i], 0, memory_order_relaxed);
+#ifdef FCACHE_STATS_HISTOGRAM
+        for(size_fx i = 0; i < STATS_FX_HIST; i++){
+            atomic_store_explicit(&stripe->get_hist[i], 0, memory_order_relaxed);
+            atomic_store_explicit(&stripe->set_hist[i], 0, memory_order_relaxed);
+        }
+#endif
+    }
+}
+
+static FX_INLINE size_fx stats_load(const _Atomic size_fx* counter){
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+void stats_collect(const stats_fx* stats, fcache_stats_t* out){
+
+    size_fx sum[STAT_N_COUNTERS] = {0};
+#ifdef FCACHE_STATS_HISTOGRAM
+    zero_mem_fx(out->get_ns, sizeof(out->get_ns));
+    zero_mem_fx(out->set_ns, sizeof(out->set_ns));
+#endif
+
+    for(size_fx s = 0; s < STATS_FX_STRIPES; s++){
+        const stats_stripe* stripe = &stats->stripes[s].stripe;
+
+        for(size_fx i = 0; i < STAT_N_COUNTERS; i++)
+            sum[i] += stats_load(&stripe->counters[i]);
+#ifdef FCACHE_STATS_HISTOGRAM
+        for(size_fx i = 0; i < STATS_FX_HIST; i++){
+            out->get_ns[i] += stats_load(&stripe->get_hist[i]);
+            out->set_ns[i] += stats_load(&stripe->set_hist[i]);
+        }
+#endif
+    }
+
+    out->hits = sum[STAT_HITS];
+    out->misses = sum[STAT_MISSES];
+    out->sets = sum[STAT_SETS];
+    out->nx_rejects = sum[STAT_NX_REJECTS];
+    out->xx_rejects = sum[STAT_XX_REJECTS];
+    out->evicted_memory = sum[STAT_EVICTED_MEMORY];
+    out->evicted_ttl = sum[STAT_EVICTED_TTL];
+    out->bytes_evicted = sum[STAT_BYTES_EVICTED];
+    out->evict_ns = sum[STAT_EVICT_NS];
+    out->l2_hits = sum[STAT_L2_HITS];
+    out->l2_demoted = sum[STAT_L2_DEMOTED];
+    out->repl_dropped = sum[STAT_REPL_DROPPED];
+}
@@ -0,0 +1,105 @@
+#ifndef __STATS_FX_H__
+#define __STATS_FX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+#include <stdatomic.h>
+
+#include "commons.h"
+#include "flexcache.h"
+
+// Striped event counters: every thread adds to its own stripe (own cache line) with relaxed
+// atomics, readers sum the stripes. Threads beyond STATS_FX_STRIPES share stripes, still correct.
+
+#define STATS_FX_STRIPES    16
+#define STATS_FX_HIST       FCACHE_STATS_HIST
+
+enum STATS_FX_COUNTER{
+    STAT_HITS,
+    STAT_MISSES,
+    STAT_SETS,
+    STAT_NX_REJECTS,
+    STAT_XX_REJECTS,
+    STAT_EVICTED_MEMORY,
+    STAT_EVICTED_TTL,
+    STAT_BYTES_EVICTED,
+    STAT_EVICT_NS,
+    STAT_L2_HITS,
+    STAT_L2_DEMOTED,
+    STAT_REPL_DROPPED,
+    STAT_N_COUNTERS
+};
+
+typedef struct stats_stripe{
+    _Atomic size_fx     counters[STAT_N_COUNTERS];
+#ifdef FCACHE_STATS_HISTOGRAM
+    _Atomic size_fx     get_hist[STATS_FX_HIST];
+    _Atomic size_fx     set_hist[STATS_FX_HIST];
+#endif
+} stats_stripe;
+
+typedef union stats_stripe_slot{
+    stats_stripe        stripe;
+    char                pad[(sizeof(stats_stripe) + 63) / 64 * 64];
+} stats_stripe_slot;
+
+typedef struct stats_fx{
+    stats_stripe_slot   stripes[STATS_FX_STRIPES];
+} stats_fx;
+
+extern _Thread_local size_fx stats_fx_tl_stripe; //stripe + 1, 0 until the first event
+
+size_fx stats_fx_assign(void);
+
+void stats_init(stats_fx* stats);
+
+//sums every stripe into out
+void stats_collect(const stats_fx* stats, fcache_stats_t* out);
+
+static FX_INLINE stats_stripe* stats_local(stats_fx* stats){
+
+    size_fx stripe = stats_fx_tl_stripe;
+    return &stats->stripes[stripe ? stripe - 1 : stats_fx_assign()].stripe;
+}
+
+static FX_INLINE void stats_add(stats_fx* stats, enum STATS_FX_COUNTER counter, size_fx n){
+    atomic_fetch_add_explicit(&stats_local(stats)->counters[counter], n, memory_order_relaxed);
+}
+
+static FX_INLINE size_fx stats_now_ns(void){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_fx)ts.tv_sec * 1000000000UL + (size_fx)ts.tv_nsec;
+}
+
+#ifdef FCACHE_STATS_HISTOGRAM
+
+static FX_INLINE void stats_hist_add(_Atomic size_fx* hist, size_fx ns){
+
+    size_fx bucket = ns ? 63 - __builtin_clzl(ns) : 0;
+    if(bucket >= STATS_FX_HIST)
+        bucket = STATS_FX_HIST - 1;
+    atomic_fetch_add_explicit(&hist[bucket], 1, memory_order_relaxed);
+}
+
+#define STATS_TIMER_START(var) size_fx var = stats_now_ns()
+#define STATS_TIMER_GET(stats, var) stats_hist_add(stats_local(stats)->get_hist, stats_now_ns() - (var))
+#define STATS_TIMER_SET(stats, var) stats_hist_add(stats_local(stats)->set_hist, stats_now_ns() - (var))
+
+#else
+
+#define STATS_TIMER_START(var)
+#define STATS_TIMER_GET(stats, var)
+#define STATS_TIMER_SET(stats, var)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
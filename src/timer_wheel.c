@@ -0,0 +1,188 @@
+#include "timer_wheel.h"
+
+#define TWHEEL_MASK (TWHEEL_SLOTS - 1)
+
+static FX_INLINE twheel_node* twheel_entry(ListNode* hook){
+    return list_entry(hook, twheel_node, hook);
+}
+
+void twheel_init(twheel_fx* wheel, twheel_time now){
+
+    wheel->now = now;
+    wheel->count = 0;
+
+    for(int level = 0; level < TWHEEL_LEVELS; level++){
+        wheel->occupied[level] = 0;
+        for(int slot = 0; slot < TWHEEL_SLOTS; slot++)
+            list_init(&wheel->slots[level][slot]);
+    }
+}
+
+static void twheel_place(twheel_fx* wheel, twheel_node* node){
+
+    twheel_time expires = node->expires;
+    twheel_time delta = expires > wheel->now ? expires - wheel->now : 0;
+
+    int level = 0;
+    while(level < TWHEEL_LEVELS - 1 && delta >= ((twheel_time)1 << (TWHEEL_BITS * (level + 1))))
+        level++;
+
+    //beyond the last level: parked at its far end, placed again when cascaded
+    twheel_time max_delta = ((twheel_time)1 << (TWHEEL_BITS * TWHEEL_LEVELS)) - 1;
+    if(delta > max_delta)
+        expires = wheel->now + max_delta;
+
+    //already due: next tick, the current slot was handled when the wheel got here
+    if(expires <= wheel->now)
+        expires = wheel->now + 1;
+
+    int slot = (int)((expires >> (TWHEEL_BITS * level)) & TWHEEL_MASK);
+    List* bucket = &wheel->slots[level][slot];
+
+    list_insert_back(bucket, &node->hook);
+    node->bucket = bucket;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+void twheel_add(twheel_fx* wheel, twheel_node* node, twheel_time expires){
+
+    if(twheel_pending(node))
+        twheel_remove(wheel, node);
+
+    node->expires = expires;
+    twheel_place(wheel, node);
+    wheel->count++;
+}
+
+static FX_INLINE void twheel_unlink(twheel_fx* wheel, twheel_node* node){
+
+    List* bucket = node->bucket;
+    list_remove(bucket, &node->hook);
+    node->bucket = 0;
+
+    if(list_empty(bucket)){
+        size_fx index = (size_fx)(bucket - &wheel->slots[0][0]);
+        wheel->occupied[index / TWHEEL_SLOTS] &= ~(1ULL << (index % TWHEEL_SLOTS));
+    }
+}
+
+void twheel_remove(twheel_fx* wheel, twheel_node* node){
+
+    if(!twheel_pending(node))
+        return;
+
+    twheel_unlink(wheel, node);
+    wheel->count--;
+}
+
+// detach the whole slot, the nodes are handled from a local list
+static FX_INLINE void twheel_take_slot(twheel_fx* wheel, int level, int slot, List* out){
+
+    List* bucket = &wheel->slots[level][slot];
+    *out = *bucket;
+    list_init(bucket);
+    wheel->occupied[level] &= ~(1ULL << slot);
+}
+
+static void twheel_cascade(twheel_fx* wheel, int level, int slot){
+
+    List pending;
+    twheel_take_slot(wheel, level, slot, &pending);
+
+    ListNode* hook;
+    while((hook = list_front(&pending)) != 0){
+        list_remove(&pending, hook);
+        twheel_place(wheel, twheel_entry(hook));
+    }
+}
+
+static size_fx twheel_expire_slot(twheel_fx* wheel, int slot, twheel_expire_cb cb, void* aux_data){
+
+    List pending;
+    twheel_take_slot(wheel, 0, slot, &pending);
+
+    size_fx expired = 0;
+    ListNode* hook;
+    while((hook = list_front(&pending)) != 0){
+        list_remove(&pending, hook);
+        twheel_node* node = twheel_entry(hook);
+
+        //parked timers (beyond the last level) go back in
+        if(node->expires > wheel->now){
+            twheel_place(wheel, node);
+            continue;
+        }
+
+        node->bucket = 0;
+        wheel->count--;
+        expired++;
+        cb(node, aux_data);
+    }
+
+    return expired;
+}
+
+// next time level has work: the next occupied slot ahead in its current rotation, else the first
+// occupied one in the next rotation... 0 when the level is empty
+static FX_INLINE twheel_time twheel_next_event(twheel_fx* wheel, int level){
+
+    unsigned long long occupied = wheel->occupied[level];
+    if(!occupied)
+        return 0;
+
+    int shift = TWHEEL_BITS * level;
+    int index = (int)((wheel->now >> shift) & TWHEEL_MASK);
+    twheel_time rotation = (twheel_time)1 << (shift + TWHEEL_BITS);
+    twheel_time base = wheel->now & ~(rotation - 1);
+
+    unsigned long long ahead = index == TWHEEL_MASK ? 0 : occupied & (~0ULL << (index + 1));
+    if(!ahead){
+        base += rotation;
+        ahead = occupied;
+    }
+
+    return base | ((twheel_time)__builtin_ctzll(ahead) << shift);
+}
+
+// Jumps from event to event: a level 0 slot to expire, or a boundary where an upper level slot
+// cascades... idle gaps cost one step per level, not one per rotation.
+size_fx twheel_advance(twheel_fx* wheel, twheel_time now, twheel_expire_cb cb, void* aux_data){
+
+    size_fx expired = 0;
+
+    while(wheel->now < now){
+
+        if(wheel->count == 0)
+            break;
+
+        twheel_time next = 0;
+        for(int level = 0; level < TWHEEL_LEVELS; level++){
+            twheel_time event = twheel_next_event(wheel, level);
+            if(event && (!next || event < next))
+                next = event;
+        }
+        if(!next || next > now)
+            break;
+        wheel->now = next;
+
+        //rotation boundary: cascade the upper levels whose index turns over
+        if((next & TWHEEL_MASK) == 0){
+            for(int level = 1; level < TWHEEL_LEVELS; level++){
+                int slot = (int)((next >> (TWHEEL_BITS * level)) & TWHEEL_MASK);
+                if(wheel->occupied[level] & (1ULL << slot))
+                    twheel_cascade(wheel, level, slot);
+                if(slot != 0)
+                    break;
+            }
+        }
+
+        int slot = (int)(next & TWHEEL_MASK);
+        if(wheel->occupied[0] & (1ULL << slot))
+            expired += twheel_expire_slot(wheel, slot, cb, aux_data);
+    }
+
+    if(wheel->now < now)
+        wheel->now = now;
+
+    return expired;
+}
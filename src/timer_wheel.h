@@ -0,0 +1,63 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "commons.h"
+#include "lib3rd/list.h"
+
+// Hierarchical timing wheel for TTL expiry, 1 ms ticks.
+// TWHEEL_LEVELS levels of TWHEEL_SLOTS slots, level L holds timers due in [64^L, 64^(L+1)) ms,
+// they are cascaded to the lower levels when the wheel reaches their slot.
+// twheel_advance only visits slots that hold timers (bitmap per level),
+// so expiring costs O(expired + cascaded) instead of a scan of every volatile key.
+// Embed a twheel_node into the struct to be expired.
+
+#define TWHEEL_BITS     6
+#define TWHEEL_SLOTS    (1 << TWHEEL_BITS)
+#define TWHEEL_LEVELS   6
+
+typedef unsigned long long twheel_time; //ms
+
+typedef struct twheel_node twheel_node;
+typedef struct twheel_fx twheel_fx;
+
+struct twheel_node{
+    ListNode        hook;
+    List*           bucket; //0 when not in the wheel
+    twheel_time     expires;
+};
+
+struct twheel_fx{
+    twheel_time             now;
+    size_fx                 count;
+    unsigned long long      occupied[TWHEEL_LEVELS];
+    List                    slots[TWHEEL_LEVELS][TWHEEL_SLOTS];
+};
+
+typedef void (*twheel_expire_cb)(twheel_node* node, void* aux_data);
+
+void twheel_init(twheel_fx* wheel, twheel_time now);
+
+static FX_INLINE void twheel_node_init(twheel_node* node){
+    node->bucket = 0;
+}
+
+static FX_INLINE bool_t twheel_pending(const twheel_node* node){
+    return node->bucket != 0;
+}
+
+void twheel_add(twheel_fx* wheel, twheel_node* node, twheel_time expires);
+
+void twheel_remove(twheel_fx* wheel, twheel_node* node);
+
+//moves the wheel to now, every timer due is detached and given to cb... returns how many
+size_fx twheel_advance(twheel_fx* wheel, twheel_time now, twheel_expire_cb cb, void* aux_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+#include "wrap_dllist.h"
+
+void dllist_init(dllist_fx* list){
+    list_init(list);
+}
+
+void dllist_remove(dllist_fx* list, flexnode* node){
+    list_remove(list, fnode_list_hook(node));
+}
+
+flexnode* dllist_iter(dllist_fx* list){
+
+    ListNode* head = list_front(list);
+    return head ? fnode_from_list_hook(head) : 0;
+}
+
+flexnode* dllist_next(flexnode* iter){
+
+    ListNode* next = list_next(fnode_list_hook(iter));
+    return next ? fnode_from_list_hook(next) : 0;
+}
+
+//a hit goes to the back, the head stays the least recently used
+void dllist_touch_LRU(dllist_fx* list, flexnode* node){
+
+    if(list_back(list) == fnode_list_hook(node))
+        return;
+    dllist_remove(list, node);
+    dllist_insert(list, node);
+}
+
+//insertion order is the eviction order, hits change nothing
+void dllist_touch_TTL(dllist_fx* list, flexnode* node){
+    (void)list;
+    (void)node;
+}
+
+void dllist_touch_FIFO(dllist_fx* list, flexnode* node){
+    (void)list;
+    (void)node;
+}
+
+void dllist_touch_RANDOM(dllist_fx* list, flexnode* node){
+    (void)list;
+    (void)node;
+}
+
+//position 0 inserts at the back, like dllist_insert
+void dllist_insert_before(dllist_fx* dllist, flexnode* node, flexnode* position){
+
+    if(!position){
+        dllist_insert(dllist, node);
+        return;
+    }
+    list_insert_left(dllist, fnode_list_hook(node), fnode_list_hook(position));
+}
@@ -5,7 +5,7 @@
 extern "C" {
 #endif
 
-#include "lib/list.h"
+#include "lib3rd/list.h"
 #include "flexnode.h"
 
 typedef List dllist_fx;
@@ -18,12 +18,17 @@ typedef void (*dllist_touch)(dllist_fx* list, flexnode* node);
 
 void dllist_init(dllist_fx* list);
 
-FX_INLINE void dllist_insert(dllist_fx* dllist, dllist_node_fx* node){
-    return list_insert_front(dllist, node);
+// head is the oldest node (the next victim), inserts go to the back
+static FX_INLINE void dllist_insert(dllist_fx* dllist, flexnode* node){
+    list_insert_back(dllist, fnode_list_hook(node));
 }
 
-FX_INLINE void dllist_concat(dllist_fx* dllist1, dllist_fx* dllist2){
-    return;
+void dllist_insert_before(dllist_fx* dllist, flexnode* node, flexnode* position);
+
+//moves every node of dllist2 to the back of dllist1
+static FX_INLINE void dllist_concat(dllist_fx* dllist1, dllist_fx* dllist2){
+    if(!list_empty(dllist2))
+        list_splice_back(dllist1, dllist2);
 }
 
 void dllist_remove(dllist_fx* list, flexnode* node);
@@ -32,14 +37,8 @@ flexnode* dllist_iter(dllist_fx* list);
 
 flexnode* dllist_next(flexnode* iter);
 
-dllist_fx dllist_full_scan_clean(dllist_fx* list, size_t now);
-
-dllist_fx dllist_scan_clean_until(dllist_fx* list, size_t until);
-
 void dllist_touch_LRU(dllist_fx* list, flexnode* node);
 
-void dllist_touch_LFU(dllist_fx* list, flexnode* node);
-
 void dllist_touch_TTL(dllist_fx* list, flexnode* node);
 
 void dllist_touch_FIFO(dllist_fx* list, flexnode* node);
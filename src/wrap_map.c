@@ -0,0 +1,244 @@
+#include "wrap_map.h"
+
+// rbtree compare only gets (key, node)... the lookup key travels with the user compare func
+typedef struct map_probe{
+    const void*       key;
+    const cmp_func*   compare;
+} map_probe;
+
+static int map_tree_compare(const void *key, const RBTreeNode *node){
+
+    const map_probe* probe = key;
+    flexnode* fnode = fnode_from_map_hook((map_hook_t*)node);
+
+    return (*probe->compare)(probe->key, fnode_get_key(fnode));
+}
+
+static const void* map_hash_key_of(const void* entry){
+    return fnode_get_key((flexnode*)entry);
+}
+
+int map_init(map_fx* map, enum INDEX_TYPE type, const data_aux_funcs_t* funcs, size_fx capacity){
+
+    map->type = type;
+    map->funcs = funcs;
+
+    if(type == INDEX_HASH){
+        if(!funcs->hash)
+            return 0;
+        return hmap_init(&map->index.hash, capacity, funcs->hash, funcs->compare,
+                            map_hash_key_of, funcs->allocator);
+    }
+
+    rbtree_init(&map->index.tree, map_tree_compare, 0, 0);
+    return 1;
+}
+
+void map_destroy(map_fx* map){
+
+    if(map->type == INDEX_HASH)
+        hmap_destroy(&map->index.hash);
+}
+
+int map_set(map_fx* map,  void* key, flexnode* value){
+
+    if(map->type == INDEX_HASH){
+        int ok;
+        hmap_set(&map->index.hash, key, value, &ok);
+        return ok;
+    }
+
+    map_probe probe = {key, map->funcs->compare};
+    rbtree_insert(&map->index.tree, &probe, fnode_map_hook(value));
+    return 1;
+}
+
+flexnode* map_get(map_fx* map,  void* key){
+
+    if(map->type == INDEX_HASH)
+        return hmap_get(&map->index.hash, key);
+
+    map_probe probe = {key, map->funcs->compare};
+    RBTreeNode* hook = rbtree_lookup_key(&map->index.tree, &probe);
+    if(!hook)
+        return 0;
+
+    return fnode_from_map_hook(hook);
+}
+
+#define MAP_PREFETCH_WINDOW 16
+
+void map_get_many(map_fx* map, void** keys, size_fx n, flexnode** nodes){
+
+    if(map->type != INDEX_HASH){
+        for(size_fx i = 0; i < n; i++)
+            nodes[i] = map_get(map, keys[i]);
+        return;
+    }
+
+    hmap_fx* hash = &map->index.hash;
+    size_fx hashes[MAP_PREFETCH_WINDOW];
+
+    for(size_fx start = 0; start < n; start += MAP_PREFETCH_WINDOW){
+        size_fx count = n - start < MAP_PREFETCH_WINDOW ? n - start : MAP_PREFETCH_WINDOW;
+
+        for(size_fx i = 0; i < count; i++){
+            hashes[i] = hmap_hash_of(hash, keys[start + i]);
+            hmap_prefetch(hash, hashes[i]);
+        }
+
+        for(size_fx i = 0; i < count; i++){
+            nodes[start + i] = hmap_get_hashed(hash, keys[start + i], hashes[i]);
+            if(nodes[start + i])
+                __builtin_prefetch(nodes[start + i]);
+        }
+    }
+}
+
+bool_t map_contains(map_fx* map,  void* key){
+    return map_get(map, key) != 0;
+}
+
+flexnode* map_get_concurrent(map_fx* map,  void* key){
+
+    if(map->type != INDEX_HASH)
+        return 0;
+
+    return hmap_get_concurrent(&map->index.hash, key);
+}
+
+void map_set_reclaim(map_fx* map, reclaim_fx reclaim, void* aux_data){
+
+    if(map->type == INDEX_HASH)
+        hmap_set_reclaim(&map->index.hash, reclaim, aux_data);
+}
+
+flexnode* map_remove(map_fx* map,  void* key){
+
+    if(map->type == INDEX_HASH)
+        return hmap_remove(&map->index.hash, key);
+
+    flexnode* node = map_get(map, key);
+    if(node)
+        rbtree_remove(&map->index.tree, fnode_map_hook(node));
+
+    return node;
+}
+
+size_fx map_size(map_fx* map){
+
+    if(map->type == INDEX_HASH)
+        return hmap_size(&map->index.hash);
+
+    return rbtree_size(&map->index.tree);
+}
+
+size_fx map_entry_overhead(map_fx* map){
+    return map->type == INDEX_HASH ? (sizeof(void*) + 1) * 8 / 7 : 0;
+}
+
+bool_t map_ordered(map_fx* map){
+    return map->type != INDEX_HASH;
+}
+
+static RBTreeNode* map_tree_lower_bound(map_fx* map, const void* key){
+
+    map_probe probe = {key, map->funcs->compare};
+    RBTreeNode* bound = 0;
+
+    for(RBTreeNode* hook = map->index.tree.root; hook; ){
+        int cmp = map_tree_compare(&probe, hook);
+        if(cmp > 0){
+            hook = hook->right_child;
+        } else{
+            bound = hook;
+            if(cmp == 0)
+                break;
+            hook = hook->left_child;
+        }
+    }
+
+    return bound;
+}
+
+flexnode* map_seek(map_fx* map, map_cursor* cursor, const void* key){
+
+    if(map->type == INDEX_HASH){
+        cursor->slot = 0;
+        return hmap_next(&map->index.hash, &cursor->slot);
+    }
+
+    cursor->hook = key ? map_tree_lower_bound(map, key) : rbtree_first(&map->index.tree);
+    return cursor->hook ? fnode_from_map_hook(cursor->hook) : 0;
+}
+
+flexnode* map_cursor_next(map_fx* map, map_cursor* cursor){
+
+    if(map->type == INDEX_HASH)
+        return hmap_next(&map->index.hash, &cursor->slot);
+
+    if(cursor->hook)
+        cursor->hook = rbtree_next(cursor->hook);
+    return cursor->hook ? fnode_from_map_hook(cursor->hook) : 0;
+}
+
+bool_t map_migrate(map_fx* map, size_fx slots){
+    return map->type == INDEX_HASH && hmap_migrate(&map->index.hash, slots);
+}
+
+size_fx map_split(map_fx* map, size_fx parts, map_cursor* cursors, flexnode** firsts){
+
+    if(map->type == INDEX_HASH){
+        size_fx capacity = hmap_slots(&map->index.hash);
+        if(parts > capacity)
+            parts = capacity;
+
+        for(size_fx i = 0; i < parts; i++){
+            cursors[i].slot = i * capacity / parts;
+            firsts[i] = hmap_next(&map->index.hash, &cursors[i].slot);
+        }
+        return parts;
+    }
+
+    RBTreeNode* root = map->index.tree.root;
+    if(!root)
+        return 0;
+
+    //cut by subtrees, no walk: the 2^depth nodes of the deepest full level (at most parts of them),
+    //chunk i starts at the leftmost key under node i. A red black tree is full down to about half
+    //its height, chunks are of the same order. O(parts log n)
+    size_fx depth = 0;
+    while(((size_fx)2 << depth) <= parts)
+        depth++;
+
+    for(;; depth--){
+        size_fx count = (size_fx)1 << depth;
+        size_fx i = 0;
+        for(; i < count; i++){
+            RBTreeNode* hook = root;
+            for(size_fx bit = depth; hook && bit > 0; bit--)
+                hook = (i >> (bit - 1)) & 1 ? hook->right_child : hook->left_child;
+            if(!hook)
+                break;
+
+            while(hook->left_child)
+                hook = hook->left_child;
+            cursors[i].hook = hook;
+            firsts[i] = fnode_from_map_hook(hook);
+        }
+        if(i == count)
+            return count;
+    }
+}
+
+flexnode* map_random(map_fx* map, size_fx rnd){
+
+    if(map->type == INDEX_HASH)
+        return hmap_random(&map->index.hash, rnd);
+
+    size_fx size = rbtree_size(&map->index.tree);
+    if(size == 0)
+        return 0;
+
+    return fnode_from_map_hook(rbtree_at(&map->index.tree, rnd % size));
+}
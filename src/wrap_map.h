@@ -5,31 +5,78 @@
 extern "C" {
 #endif
 
-#include "com_types.h"
-#include "lib/rbtree.h"
+#include "commons.h"
+#include "lib3rd/rbtree.h"
+#include "hashmap_fx.h"
 #include "flexnode.h"
 
-typedef RBTree map_fx;
+// key index of the cache... the backend is picked once at map_init:
+// INDEX_RBTREE keeps keys ordered (O(log n)), INDEX_HASH is an open addressing table (O(1))
+typedef struct map_fx map_fx;
 
-FX_INLINE void map_init(map_fx* map){
-    return rbtree_init(map);
-}
+struct map_fx{
+    enum INDEX_TYPE          type;
+    const data_aux_funcs_t*  funcs;
+    union{
+        RBTree               tree;
+        hmap_fx              hash;
+    } index;
+};
 
-FX_INLINE void map_set(map_fx* map,  void* key, flexnode* value){
-    return rbtree_insert(map, key, value);
-}
+int map_init(map_fx* map, enum INDEX_TYPE type, const data_aux_funcs_t* funcs, size_fx capacity);
 
-FX_INLINE flexnode* map_get(map_fx* map,  void* key){
-    return rbtree_lookup_key(map, key);
-}
+void map_destroy(map_fx* map);
 
-FX_INLINE bool_t map_contains(map_fx* map,  void* key){
-    return rbtree_contains_key(map, key);
-}
+int map_set(map_fx* map,  void* key, flexnode* value);
 
-FX_INLINE flexnode* map_remove(map_fx* map,  void* key){
-    return rbtree_remove(map, key);
-}
+flexnode* map_get(map_fx* map,  void* key);
+
+bool_t map_contains(map_fx* map,  void* key);
+
+//lookup racing the writer, INDEX_HASH only (0 with INDEX_RBTREE)
+flexnode* map_get_concurrent(map_fx* map,  void* key);
+
+//replaced index memory goes to reclaim instead of the allocator
+void map_set_reclaim(map_fx* map, reclaim_fx reclaim, void* aux_data);
+
+//nodes[i] = map_get(keys[i]), with the index memory of the next keys prefetched
+void map_get_many(map_fx* map, void** keys, size_fx n, flexnode** nodes);
+
+flexnode* map_remove(map_fx* map,  void* key);
+
+size_fx map_size(map_fx* map);
+
+//index bytes per key outside the node: the hash slot and control byte at max load, 0 for the
+//RBTREE (its hook is in the node)
+size_fx map_entry_overhead(map_fx* map);
+
+// Walk over the index: INDEX_RBTREE in key order, INDEX_HASH in slot order.
+// The map must not change while a cursor is in use.
+typedef struct map_cursor{
+    RBTreeNode*     hook;
+    size_fx         slot;
+} map_cursor;
+
+//first node of a walk: RBTREE seeks the first key >= key (the first key when key is 0), O(log n)...
+//HASH ignores key and starts at the first slot
+flexnode* map_seek(map_fx* map, map_cursor* cursor, const void* key);
+
+flexnode* map_cursor_next(map_fx* map, map_cursor* cursor);
+
+bool_t map_ordered(map_fx* map);
+
+//cuts the walk in at most parts chunks, returns the chunk count (0 on an empty RBTREE):
+//chunk i starts at firsts[i] (cursors[i] on it) and ends where chunk i + 1 starts, the last one at the end.
+//HASH splits the slots evenly (O(parts)), RBTREE cuts by subtrees, a power of two of chunks of
+//comparable sizes (O(parts log n))
+size_fx map_split(map_fx* map, size_fx parts, map_cursor* cursors, flexnode** firsts);
+
+//INDEX_HASH resize step (hmap_migrate), returns 1 while a resize is still running
+bool_t map_migrate(map_fx* map, size_fx slots);
+
+//random node, O(1) with INDEX_HASH... O(n) with INDEX_RBTREE (in order walk), the sampled evictions
+//do not use it there
+flexnode* map_random(map_fx* map, size_fx rnd);
 
 #ifdef __cplusplus
 }
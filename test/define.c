@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/flexcache_define.h"
+
+extern SUITE(defineFX);
+
+FLEXCACHE_DEFINE(u64cache, unsigned long long, long, flexcache_hash_scalar, flexcache_eq_scalar)
+
+typedef struct name16{
+    char s[16];
+} name16;
+
+FLEXCACHE_DEFINE(strcache, name16, int, flexcache_hash_bytes, flexcache_eq_bytes)
+
+static name16 make_name(int i){
+    name16 name = {{0}};
+    for(int j = 0; j < 15 && i; j++, i /= 10)
+        name.s[j] = (char)('0' + i % 10);
+    return name;
+}
+
+TEST u64_set_get_remove(void) {
+
+    u64cache* cache = u64cache_new(&test_allocator, 1000 * sizeof(u64cache_entry));
+    ASSERT(cache);
+
+    for(unsigned long long k = 0; k < 1000; k++)
+        ASSERT_EQ(0, u64cache_set(cache, k * 7919, (long)k, 0, 0));
+    ASSERT_EQ(1000, u64cache_size(cache));
+
+    for(unsigned long long k = 0; k < 1000; k++){
+        long* value = u64cache_get(cache, k * 7919);
+        ASSERT(value);
+        ASSERT_EQ((long)k, *value);
+    }
+
+    long old;
+    ASSERT_EQ(1, u64cache_set(cache, 7919, -1, 0, &old));
+    ASSERT_EQ(1, old);
+    ASSERT_EQ(-1, *u64cache_get(cache, 7919));
+
+    ASSERT(u64cache_remove(cache, 7919, &old));
+    ASSERT_EQ(-1, old);
+    ASSERT_FALSE(u64cache_contains(cache, 7919));
+    ASSERT_FALSE(u64cache_remove(cache, 7919, 0));
+    ASSERT_EQ(999, u64cache_size(cache));
+
+    u64cache_free(cache);
+    PASS();
+}
+
+TEST u64_evicts_lru(void) {
+
+    u64cache* cache = u64cache_new(&test_allocator, 4 * sizeof(u64cache_entry));
+    ASSERT(cache);
+
+    for(unsigned long long k = 1; k <= 4; k++)
+        u64cache_set(cache, k, (long)k, 0, 0);
+    u64cache_get(cache, 1);
+
+    unsigned long long key;
+    long value;
+    ASSERT_EQ(1, u64cache_set(cache, 5, 5, &key, &value));
+    ASSERT_EQ(2, key);
+    ASSERT_EQ(2, value);
+    ASSERT(u64cache_contains(cache, 1));
+    ASSERT_FALSE(u64cache_contains(cache, 2));
+
+    //churn: tombstones never fill the index
+    for(unsigned long long k = 100; k < 100000; k++)
+        u64cache_set(cache, k, 0, 0, 0);
+    ASSERT_EQ(4, u64cache_size(cache));
+    ASSERT(u64cache_contains(cache, 99999));
+    ASSERT_FALSE(u64cache_contains(cache, 99995));
+
+    u64cache_free(cache);
+    PASS();
+}
+
+TEST fixed_string_keys(void) {
+
+    strcache* cache = strcache_new(&test_allocator, 256 * sizeof(strcache_entry));
+    ASSERT(cache);
+
+    for(int i = 1; i <= 512; i++)
+        strcache_set(cache, make_name(i), i, 0, 0);
+    ASSERT_EQ(256, strcache_size(cache));
+
+    for(int i = 1; i <= 256; i++)
+        ASSERT_FALSE(strcache_contains(cache, make_name(i)));
+    for(int i = 257; i <= 512; i++){
+        int* value = strcache_get(cache, make_name(i));
+        ASSERT(value);
+        ASSERT_EQ(i, *value);
+    }
+
+    strcache_free(cache);
+    PASS();
+}
+
+SUITE(defineFX) {
+    RUN_TEST(u64_set_get_remove);
+    RUN_TEST(u64_evicts_lru);
+    RUN_TEST(fixed_string_keys);
+}
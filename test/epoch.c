@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/epoch_fx.h"
+#include "../src/hashmap_fx.h"
+
+extern SUITE(epochFX);
+
+static _Atomic int freed;
+
+static void count_free(void* ptr){
+    atomic_fetch_add(&freed, 1);
+    free(ptr);
+}
+
+TEST retire_without_readers(void) {
+
+    epoch_fx* domain = epoch_new(&test_allocator);
+    ASSERT(domain);
+    atomic_store(&freed, 0);
+
+    for(int i = 0; i < 10; i++)
+        epoch_retire(domain, malloc(8), count_free);
+
+    for(int i = 0; i < 3; i++)
+        epoch_collect(domain);
+    ASSERT_EQ(10, atomic_load(&freed));
+
+    epoch_free(domain);
+    PASS();
+}
+
+typedef struct reader_ctx{
+    epoch_fx*       domain;
+    _Atomic int     step;
+} reader_ctx;
+
+static void* pinned_reader(void* arg){
+
+    reader_ctx* ctx = arg;
+
+    epoch_enter(ctx->domain);
+    atomic_store(&ctx->step, 1);
+    while(atomic_load(&ctx->step) != 2)
+        ;
+    epoch_exit(ctx->domain);
+
+    return 0;
+}
+
+TEST reader_holds_grace_period(void) {
+
+    reader_ctx ctx;
+    ctx.domain = epoch_new(&test_allocator);
+    atomic_init(&ctx.step, 0);
+    atomic_store(&freed, 0);
+
+    pthread_t reader;
+    pthread_create(&reader, 0, pinned_reader, &ctx);
+    while(atomic_load(&ctx.step) != 1)
+        ;
+
+    epoch_retire(ctx.domain, malloc(8), count_free);
+    for(int i = 0; i < 10; i++)
+        epoch_collect(ctx.domain);
+    ASSERT_EQ(0, atomic_load(&freed));
+
+    atomic_store(&ctx.step, 2);
+    pthread_join(reader, 0);
+
+    for(int i = 0; i < 3; i++)
+        epoch_collect(ctx.domain);
+    ASSERT_EQ(1, atomic_load(&freed));
+
+    epoch_free(ctx.domain);
+    PASS();
+}
+
+// one writer (inserts, replaces, removes, grows) against lock free readers
+typedef struct entry_t{
+    long key;
+    long value; //always key * 3
+} entry_t;
+
+static size_fx long_hash(const void* key){
+    return (size_fx)*(const long*)key;
+}
+
+static int long_cmp(const void* key1, const void* key2){
+    long a = *(const long*)key1;
+    long b = *(const long*)key2;
+    return (a > b) - (a < b);
+}
+
+static const hash_func long_hash_fx = long_hash;
+static const cmp_func long_cmp_fx = long_cmp;
+
+static const void* entry_key(const void* entry){
+    return &((const entry_t*)entry)->key;
+}
+
+static void hmap_epoch_reclaim(void* aux_data, void* ptr, free_fx* free){
+    epoch_retire(aux_data, ptr, *free);
+}
+
+#define N_KEYS 2048
+#define N_READERS 3
+
+typedef struct stress_ctx{
+    hmap_fx         map;
+    epoch_fx*       domain;
+    _Atomic int     done;
+    _Atomic int     bad;
+} stress_ctx;
+
+static void* stress_reader(void* arg){
+
+    stress_ctx* ctx = arg;
+    size_fx rnd = (size_fx)arg | 1;
+
+    while(!atomic_load(&ctx->done)){
+        long key = (long)(rand_fx(&rnd) % N_KEYS);
+
+        epoch_enter(ctx->domain);
+        entry_t* entry = hmap_get_concurrent(&ctx->map, &key);
+        if(entry && (entry->key != key || entry->value != key * 3))
+            atomic_store(&ctx->bad, 1);
+        epoch_exit(ctx->domain);
+    }
+
+    return 0;
+}
+
+TEST concurrent_hmap_reads(void) {
+
+    stress_ctx ctx;
+    ctx.domain = epoch_new(&test_allocator);
+    atomic_init(&ctx.done, 0);
+    atomic_init(&ctx.bad, 0);
+    ASSERT(hmap_init(&ctx.map, 0, &long_hash_fx, &long_cmp_fx, entry_key, &test_allocator));
+    hmap_set_reclaim(&ctx.map, hmap_epoch_reclaim, ctx.domain);
+
+    pthread_t readers[N_READERS];
+    for(int i = 0; i < N_READERS; i++)
+        pthread_create(&readers[i], 0, stress_reader, &ctx);
+
+    size_fx rnd = 42;
+    for(int round = 0; round < 20000; round++){
+        long key = (long)(rand_fx(&rnd) % N_KEYS);
+        entry_t* old;
+
+        if(round % 3 == 2){
+            old = hmap_remove(&ctx.map, &key);
+        } else{
+            entry_t* entry = malloc(sizeof(entry_t));
+            entry->key = key;
+            entry->value = key * 3;
+            int ok;
+            old = hmap_set(&ctx.map, &entry->key, entry, &ok);
+        }
+
+        if(old)
+            epoch_retire(ctx.domain, old, free);
+    }
+
+    atomic_store(&ctx.done, 1);
+    for(int i = 0; i < N_READERS; i++)
+        pthread_join(readers[i], 0);
+    ASSERT_EQ(0, atomic_load(&ctx.bad));
+
+    size_fx cursor = 0;
+    entry_t* entry;
+    while((entry = hmap_next(&ctx.map, &cursor)))
+        free(entry);
+    hmap_destroy(&ctx.map);
+    epoch_free(ctx.domain);
+    PASS();
+}
+
+SUITE(epochFX) {
+    RUN_TEST(retire_without_readers);
+    RUN_TEST(reader_holds_grace_period);
+    RUN_TEST(concurrent_hmap_reads);
+}
@@ -0,0 +1,1213 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/flexcache.h"
+#include "../src/slab_fx.h"
+
+extern SUITE(flexcacheFX);
+
+#define N_KEYS 64
+
+//node time resolution: ms, whole seconds with the compact layout
+#ifdef FCACHE_COMPACT_NODE
+#define TICK_MS 1000
+#else
+#define TICK_MS 1
+#endif
+
+static long keys[N_KEYS];
+static long values[N_KEYS];
+
+static time_fx test_clock;
+static set_option no_ttl;
+
+static size_fx long_len(void* data){
+    (void)data;
+    return sizeof(long);
+}
+
+static void* long_copy(void* data){
+
+    long* copy = malloc(sizeof(long));
+    *copy = *(long*)data;
+    return copy;
+}
+
+static int long_cmp(const void* key1, const void* key2){
+
+    long a = *(const long*)key1;
+    long b = *(const long*)key2;
+    return (a > b) - (a < b);
+}
+
+static size_fx long_hash(const void* key){
+    return (size_fx)*(const long*)key;
+}
+
+static void test_now(time_fx* now){
+    *now = test_clock;
+}
+
+//values are the static array, nothing to free
+static void no_free(void* data){
+    (void)data;
+}
+
+static len_func test_len_fx = long_len;
+static copy_func test_copy_fx = long_copy;
+static cmp_func test_cmp_fx = long_cmp;
+static hash_func test_hash_fx = long_hash;
+static now_func test_now_fx = test_now;
+static free_fx no_free_fx = no_free;
+static free_fx heap_free_fx = free;
+
+static const data_aux_funcs_t test_funcs = {
+    .len_func = &test_len_fx,
+    .key_len = 0,
+    .copy_func = &test_copy_fx,
+    .compare = &test_cmp_fx,
+    .hash = &test_hash_fx,
+    .allocator = &test_allocator,
+    .now = &test_now_fx
+};
+
+static flexcache* new_cache(enum EVICTION_POLICY policy, init_option* options){
+
+    for(long i = 0; i < N_KEYS; i++){
+        keys[i] = i;
+        values[i] = i;
+    }
+    test_clock.tv_sec = 1000;
+    test_clock.tv_nsec = 0;
+
+    flexcache* cache = fcache_new(&test_allocator);
+    if(cache && !fcache_init(cache, policy, test_funcs, 1UL << 30, options)){
+        free(cache);
+        return 0;
+    }
+    return cache;
+}
+
+//every entry costs the same, measured on the first one
+static size_fx entry_cost(flexcache* cache){
+
+    stack_fx* removed = fcache_set(cache, &keys[N_KEYS - 1], &values[N_KEYS - 1], &no_ttl);
+    if(removed)
+        stack_free(removed);
+    size_fx cost = fcache_used_memory(cache);
+    fcache_remove(cache, &keys[N_KEYS - 1]);
+    return cost;
+}
+
+//the one value key's set evicted, -1 when none
+static long set_evicts(flexcache* cache, long key){
+
+    stack_fx* removed = fcache_set(cache, &keys[key], &values[key], &no_ttl);
+    if(!removed)
+        return -1;
+    long* value = stack_size(removed) == 1 ? stack_pop(removed) : 0;
+    stack_free(removed);
+    return value ? *value : -2;
+}
+
+TEST slru_probation_order(void) {
+
+    init_option options = {0};
+    options.slru_protected = 60;
+    flexcache* cache = new_cache(SLRU, &options);
+    ASSERT(cache);
+
+    //four entries fit, two of them protected
+    fcache_set_maxmemory(cache, 4 * entry_cost(cache));
+
+    for(long key = 0; key < 4; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+
+    //1, 2, 3 promoted: the protected LRU (1) is demoted to the probation MRU end
+    for(long key = 1; key < 4; key++)
+        ASSERT(fcache_get_ptr(cache, &keys[key]));
+
+    //probation is 0, 1 and new keys go after it, the protected 2 and 3 outlive them
+    ASSERT_EQ(0, set_evicts(cache, 4));
+    ASSERT_EQ(1, set_evicts(cache, 5));
+    ASSERT_EQ(4, set_evicts(cache, 6));
+    ASSERT_EQ(5, set_evicts(cache, 7));
+    ASSERT(fcache_key_exists(cache, &keys[2]));
+    ASSERT(fcache_key_exists(cache, &keys[3]));
+
+    //with probation down to one key, a hit promotes it and demotes 2
+    ASSERT(fcache_get_ptr(cache, &keys[7]));
+    ASSERT_EQ(6, set_evicts(cache, 8));
+    ASSERT_EQ(2, set_evicts(cache, 9));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+static void advance_ms(long ms){
+
+    test_clock.tv_nsec += ms * 1000000L;
+    test_clock.tv_sec += test_clock.tv_nsec / NS_PER_SECOND;
+    test_clock.tv_nsec %= NS_PER_SECOND;
+}
+
+TEST lru_evict_under_pressure(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    size_fx cost = entry_cost(cache);
+    fcache_set_maxmemory(cache, 8 * cost);
+
+    for(long key = 0; key < 8; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    ASSERT_EQ(8 * cost, fcache_used_memory(cache));
+
+    //a hit moves 0 away from the head, 1 goes first
+    ASSERT(fcache_get_ptr(cache, &keys[0]));
+    ASSERT_EQ(1, set_evicts(cache, 8));
+
+    for(long key = 9; key < 15; key++)
+        ASSERT_EQ(key - 7, set_evicts(cache, key));
+    ASSERT_EQ(0, set_evicts(cache, 15));
+
+    //from then on every set evicts the oldest key, the budget holds after each of them
+    for(long key = 16; key < N_KEYS; key++){
+        ASSERT_EQ(key - 8, set_evicts(cache, key));
+        ASSERT(fcache_used_memory(cache) <= 8 * cost);
+    }
+
+    fcache_stats_t stats;
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(N_KEYS - 8, stats.evicted_memory);
+    ASSERT_EQ(0, stats.evicted_ttl);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+TEST ttl_expires_on_read(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+
+    set_option px = {0};
+    px.PX = 50 * TICK_MS;
+    stack_fx* removed = fcache_set(cache, &keys[0], &values[0], &px);
+    ASSERT_EQ(0, removed);
+    ASSERT_EQ(-1, set_evicts(cache, 1));
+
+    //exact to the tick (ms, no rounding to the second with the full layout)
+    long total;
+    ASSERT_EQ(50 * TICK_MS, fcache_ttl_ms(cache, &keys[0], &total));
+    ASSERT_EQ(50 * TICK_MS, total);
+    ASSERT_EQ(-1, fcache_ttl_ms(cache, &keys[1], 0));
+
+    advance_ms(49 * TICK_MS);
+    ASSERT_EQ(TICK_MS, fcache_ttl_ms(cache, &keys[0], 0));
+    ASSERT(fcache_get_ptr(cache, &keys[0]));
+
+    //due now, the wheel did not run: the read expires it
+    advance_ms(TICK_MS);
+    ASSERT_EQ(0, fcache_get_ptr(cache, &keys[0]));
+    ASSERT_FALSE(fcache_key_exists(cache, &keys[0]));
+    ASSERT_EQ(-2, fcache_ttl_ms(cache, &keys[0], 0));
+    ASSERT(fcache_get_ptr(cache, &keys[1]));
+
+    //and the next set reports its value
+    ASSERT_EQ(0, set_evicts(cache, 2));
+
+    fcache_stats_t stats;
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(1, stats.evicted_ttl);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+TEST ttl_expires_on_set(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+
+    set_option px = {0};
+    for(long key = 0; key < 32; key++){
+        px.PX = (10 + key) * TICK_MS;
+        stack_fx* removed = fcache_set(cache, &keys[key], &values[key], &px);
+        ASSERT_EQ(0, removed);
+    }
+
+    //keys 0 to 9 are due, the wheel expires them with the next set
+    advance_ms(19 * TICK_MS);
+    stack_fx* removed = fcache_set(cache, &keys[40], &values[40], &no_ttl);
+    ASSERT(removed);
+    ASSERT_EQ(10, stack_size(removed));
+    while(stack_size(removed)){
+        long* value = stack_pop(removed);
+        ASSERT(*value < 10);
+    }
+    stack_free(removed);
+
+    for(long key = 0; key < 32; key++)
+        ASSERT_EQ(key >= 10, fcache_key_exists(cache, &keys[key]));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//every ttl gets its own random extra, never past JITTER percent
+TEST ttl_jitter_bounds(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+
+    set_option px = {0};
+    px.PX = 1000 * TICK_MS;
+    px.JITTER = 10;
+    set_option ex = {0};
+    ex.EX = 10 * TICK_MS;
+    ex.JITTER = 50;
+
+    long low = -1, high = -1;
+    for(long key = 0; key < N_KEYS; key++){
+        stack_fx* removed = fcache_set(cache, &keys[key], &values[key], key % 2 ? &ex : &px);
+        ASSERT_EQ(0, removed);
+
+        long ttl = fcache_ttl_ms(cache, &keys[key], 0);
+        long base = key % 2 ? 10000 * TICK_MS : 1000 * TICK_MS;
+        long extra = key % 2 ? 5000 * TICK_MS : 100 * TICK_MS;
+        ASSERT(ttl >= base && ttl <= base + extra);
+        if(key % 2 == 0){
+            low = low < 0 || ttl < low ? ttl : low;
+            high = ttl > high ? ttl : high;
+        }
+    }
+    //keys set together do not expire together
+    ASSERT(high > low);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//reads of key 0 XFetch turned into misses
+static long early_misses(flexcache* cache, long reads){
+
+    long misses = 0;
+    for(long i = 0; i < reads; i++)
+        misses += fcache_get_ptr(cache, &keys[0]) == 0;
+    return misses;
+}
+
+// XFetch: a miss for the reader only, more likely as the expiry gets close against
+// xfetch_delta_ms... the entry and its value stay
+TEST xfetch_early_expiry(void) {
+
+    init_option options = {0};
+    options.xfetch_delta_ms = 10 * TICK_MS;
+    flexcache* cache = new_cache(LRU, &options);
+    ASSERT(cache);
+
+    set_option px = {0};
+    px.PX = 10000 * TICK_MS;
+    stack_fx* removed = fcache_set(cache, &keys[0], &values[0], &px);
+    ASSERT_EQ(0, removed);
+
+    //far from the expiry (1000 deltas): exp(-1000), never
+    ASSERT_EQ(0, early_misses(cache, 1000));
+
+    //one tick left, a tenth of the delta: exp(-0.1), about 9 reads in 10
+    advance_ms(9999 * TICK_MS);
+    long misses = early_misses(cache, 200);
+    ASSERT(misses > 100 && misses < 200);
+
+    ASSERT(fcache_key_exists(cache, &keys[0]));
+    ASSERT_EQ(&values[0], fcache_peek(cache, &keys[0]));
+    fcache_stats_t stats;
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(0, stats.evicted_ttl);
+
+    //without XFetch the same read always hits
+    init_option no_xfetch = {0};
+    flexcache* plain = new_cache(LRU, &no_xfetch);
+    ASSERT(plain);
+    removed = fcache_set(plain, &keys[0], &values[0], &px);
+    ASSERT_EQ(0, removed);
+    advance_ms(9999 * TICK_MS);
+    ASSERT_EQ(0, early_misses(plain, 200));
+    fcache_free(plain, &no_free_fx);
+
+    //the value it held comes back whole on remove, nothing freed it
+    ASSERT_EQ(&values[0], fcache_remove(cache, &keys[0]));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+TEST slab_fills_budget(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    //a slab allocator holds whole slabs for every cache using it, entries are charged their classes
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.allocator = slab_allocator();
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT(fcache_init(cache, LRU, funcs, 1UL << 30, 0));
+
+    size_fx cost = entry_cost(cache);
+    ASSERT(cost >= (*funcs.allocator->usable)(sizeof(long)));
+    fcache_set_maxmemory(cache, 32 * cost);
+
+    for(long key = 0; key < 32; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    ASSERT_EQ(32 * cost, fcache_used_memory(cache));
+    ASSERT_EQ(0, set_evicts(cache, 32));
+
+    fcache_free(cache, &no_free_fx);
+    slab_thread_flush();
+    PASS();
+}
+
+//INDEX_RBTREE samples round the key list, the keys read since go last
+TEST approx_lru_tree_samples(void) {
+
+    init_option options = {0};
+    options.index = INDEX_RBTREE;
+    options.evict_samples = 8;
+    flexcache* cache = new_cache(APPROX_LRU, &options);
+    ASSERT(cache);
+    fcache_set_maxmemory(cache, 16 * entry_cost(cache));
+
+    for(long key = 0; key < 16; key++){
+        ASSERT_EQ(-1, set_evicts(cache, key));
+        advance_ms(TICK_MS);
+    }
+    for(long key = 8; key < 16; key++)
+        ASSERT(fcache_get_ptr(cache, &keys[key]));
+
+    for(long key = 16; key < 24; key++){
+        advance_ms(TICK_MS);
+        long victim = set_evicts(cache, key);
+        ASSERT(victim >= 0 && victim < 8);
+    }
+    for(long key = 8; key < 24; key++)
+        ASSERT(fcache_key_exists(cache, &keys[key]));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+#define SNAP_PATH "/tmp/flexcache_test.snap"
+
+static flexcache* snap_cache(void){
+
+    //snapshots need key_len
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.key_len = &test_len_fx;
+
+    flexcache* cache = fcache_new(funcs.allocator);
+    if(cache && !fcache_init(cache, LRU, funcs, 1UL << 30, 0)){
+        free(cache);
+        return 0;
+    }
+    return cache;
+}
+
+//LIST and MAP keys come back with their elements, their ttl and next to the plain keys
+TEST snapshot_containers(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    cache = snap_cache();
+    ASSERT(cache);
+
+    set_option px = {0};
+    px.PX = 1000;
+    ASSERT_EQ(-1, set_evicts(cache, 0));
+    for(long i = 10; i < 13; i++)
+        ASSERT_EQ((size_fx)(i - 9), fcache_lpush(cache, &keys[1], &values[i], 0, &px, 0));
+    ASSERT(fcache_hset(cache, &keys[2], &keys[20], &values[21], &no_ttl, 0));
+    ASSERT(fcache_hset(cache, &keys[2], &keys[22], &values[23], &no_ttl, 0));
+
+    ASSERT_EQ(1, fcache_snapshot(cache, SNAP_PATH));
+    fcache_free(cache, &no_free_fx);
+
+    //plain values come back as copy_func copies, keys point into the mapping
+    cache = snap_cache();
+    ASSERT(cache);
+    ASSERT_EQ(1, fcache_load(cache, SNAP_PATH, &heap_free_fx));
+    remove(SNAP_PATH);
+
+    ASSERT_EQ(0, *(const long*)fcache_get_ptr(cache, &keys[0]));
+
+    const void* elements[4];
+    ASSERT_EQ(3, fcache_llen(cache, &keys[1]));
+    ASSERT_EQ(3, fcache_lrange(cache, &keys[1], 0, -1, elements, 4));
+    for(long i = 0; i < 3; i++)
+        ASSERT_EQ(10 + i, *(const long*)elements[i]);
+    ASSERT_EQ(1000, fcache_ttl_ms(cache, &keys[1], 0));
+
+    ASSERT_EQ(2, fcache_hlen(cache, &keys[2]));
+    ASSERT_EQ(21, *(const long*)fcache_hget(cache, &keys[2], &keys[20]));
+    ASSERT_EQ(23, *(const long*)fcache_hget(cache, &keys[2], &keys[22]));
+    ASSERT_EQ(-1, fcache_ttl_ms(cache, &keys[2], 0));
+
+    fcache_free(cache, &heap_free_fx);
+    PASS();
+}
+
+//the set evicting a value load copied (copy_func), that one is freed here
+static long set_evicts_copy(flexcache* cache, long key){
+
+    stack_fx* removed = fcache_set(cache, &keys[key], &values[key], &no_ttl);
+    if(!removed)
+        return -1;
+    long* value = stack_size(removed) == 1 ? stack_pop(removed) : 0;
+    stack_free(removed);
+    long evicted = value ? *value : -2;
+    free(value);
+    return evicted;
+}
+
+//protected keys come back protected: the load gives the slru_probation_order victims again
+TEST snapshot_slru_segments(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.key_len = &test_len_fx;
+    init_option options = {0};
+    options.slru_protected = 60;
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT(fcache_init(cache, SLRU, funcs, 1UL << 30, &options));
+    size_fx cost = entry_cost(cache);
+    fcache_set_maxmemory(cache, 4 * cost);
+
+    for(long key = 0; key < 4; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    for(long key = 1; key < 4; key++)
+        ASSERT(fcache_get_ptr(cache, &keys[key]));
+    ASSERT_EQ(1, fcache_snapshot(cache, SNAP_PATH));
+    fcache_free(cache, &no_free_fx);
+
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT(fcache_init(cache, SLRU, funcs, 4 * cost, &options));
+    ASSERT_EQ(1, fcache_load(cache, SNAP_PATH, &heap_free_fx));
+    remove(SNAP_PATH);
+
+    //probation 0, 1 then the new keys, the protected 2 and 3 outlive them
+    ASSERT_EQ(0, set_evicts_copy(cache, 4));
+    ASSERT_EQ(1, set_evicts_copy(cache, 5));
+    ASSERT_EQ(4, set_evicts(cache, 6));
+    ASSERT_EQ(5, set_evicts(cache, 7));
+    ASSERT(fcache_key_exists(cache, &keys[2]));
+    ASSERT(fcache_key_exists(cache, &keys[3]));
+
+    //the loaded copies of 2 and 3, the static 6 and 7 are not freed
+    free(fcache_remove(cache, &keys[2]));
+    free(fcache_remove(cache, &keys[3]));
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+static bool_t even_key(const void* key, const void* value, void* aux_data){
+    (void)value;
+    (void)aux_data;
+    return *(const long*)key % 2 == 0;
+}
+
+//the subtree chunks of INDEX_RBTREE cover every key once
+TEST find_all_tree_chunks(void) {
+
+    init_option options = {0};
+    options.index = INDEX_RBTREE;
+    options.search_threads = 4;
+    flexcache* cache = new_cache(LRU, &options);
+    ASSERT(cache);
+
+    for(long key = 0; key < N_KEYS; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+
+    fcache_find_iter* iter = fcache_find_all(cache, even_key, 0);
+    ASSERT(iter);
+
+    int seen[N_KEYS] = {0};
+    const void* key;
+    for(const long* value = fcache_find_next(iter, &key); value; value = fcache_find_next(iter, &key)){
+        ASSERT_EQ(*value, *(const long*)key);
+        seen[*value]++;
+    }
+    fcache_find_end(iter);
+
+    for(long key = 0; key < N_KEYS; key++)
+        ASSERT_EQ(key % 2 == 0, seen[key]);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+static bool_t any_key(const void* key, const void* value, void* aux_data){
+    (void)key;
+    (void)value;
+    (void)aux_data;
+    return 1;
+}
+
+//scan callback counting the keys seen into aux_data
+static bool_t count_key(const void* key, const void* value, void* aux_data){
+    (void)key;
+    (void)value;
+    (*(long*)aux_data)++;
+    return 1;
+}
+
+//LIST and MAP keys never hand their container out as a value
+TEST container_keys_hidden_from_reads(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.key_len = &test_len_fx;
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT(fcache_init(cache, LRU, funcs, 1UL << 30, &options));
+
+    ASSERT_EQ(-1, set_evicts(cache, 0));
+    ASSERT_EQ(1, fcache_lpush(cache, &keys[1], &values[10], 0, &no_ttl, 0));
+    ASSERT(fcache_hset(cache, &keys[2], &keys[20], &values[21], &no_ttl, 0));
+
+    for(long key = 1; key < 3; key++){
+        ASSERT_EQ(0, fcache_get_ptr(cache, &keys[key]));
+        ASSERT_EQ(0, fcache_get_copy(cache, &keys[key]));
+        ASSERT_EQ(0, fcache_acquire(cache, &keys[key]));
+        bool_t expired = 1;
+        ASSERT_EQ(0, fcache_get_ptr_concurrent(cache, &keys[key], &expired));
+        ASSERT_FALSE(expired);
+        ASSERT(fcache_key_exists(cache, &keys[key]));
+    }
+
+    void* batch[3] = {&keys[0], &keys[1], &keys[2]};
+    const void* found[3];
+    ASSERT_EQ(1, fcache_mget(cache, batch, 3, found));
+    ASSERT_EQ(&values[0], found[0]);
+    ASSERT_EQ(0, found[1]);
+    ASSERT_EQ(0, found[2]);
+
+    long seen = 0;
+    ASSERT_EQ(1, fcache_range(cache, 0, 0, count_key, &seen));
+    ASSERT_EQ(1, seen);
+    ASSERT_EQ(&values[0], fcache_find_any(cache, any_key, 0));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//a malloc allocator failing the big requests (index tables) while fail_big is set
+static bool_t fail_big;
+
+static void* grow_fail_alloc(size_fx size){
+    return fail_big && size > 300 ? 0 : malloc(size);
+}
+
+static alloc_fx grow_fail_alloc_fx = grow_fail_alloc;
+static const allocator_fx grow_fail_allocator = {
+    .alloc = &grow_fail_alloc_fx,
+    .free = &test_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+//a set the index can not grow for fails whole: not linked, not charged, never a victim
+TEST set_index_grow_fails(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.allocator = &grow_fail_allocator;
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT(fcache_init(cache, LRU, funcs, 1UL << 30, &options));
+    size_fx cost = entry_cost(cache);
+
+    fail_big = 1;
+    long stored = 0;
+    for(long key = 0; key < N_KEYS; key++){
+        ASSERT_EQ(-1, set_evicts(cache, key));
+        stored += fcache_key_exists(cache, &keys[key]);
+    }
+    fail_big = 0;
+    ASSERT(stored > 0 && stored < N_KEYS);
+    ASSERT_EQ(stored * cost, fcache_used_memory(cache));
+
+    //the stored keys are the first ones, each new set evicts one of them, the oldest first
+    fcache_set_maxmemory(cache, stored * cost);
+    for(long i = 0; i < stored; i++)
+        ASSERT_EQ(i, set_evicts(cache, N_KEYS - 1 - i));
+    ASSERT_EQ(stored * cost, fcache_used_memory(cache));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//the key list order means nothing to LFU: hits raise the counter, the lowest one goes
+TEST lfu_evicts_least_frequent(void) {
+
+    init_option options = {0};
+    options.index = INDEX_RBTREE;
+    options.evict_samples = 8;
+    flexcache* cache = new_cache(LFU, &options);
+    ASSERT(cache);
+    fcache_set_maxmemory(cache, 8 * entry_cost(cache));
+
+    for(long key = 0; key < 8; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+
+    //up to LFU_INIT_VAL a hit always counts
+    for(long key = 1; key < 8; key++)
+        ASSERT(fcache_get_ptr(cache, &keys[key]));
+    ASSERT_EQ(0, set_evicts(cache, 8));
+
+    //a new key starts below the ones hit, it goes next
+    ASSERT_EQ(8, set_evicts(cache, 9));
+    for(long key = 1; key < 8; key++)
+        ASSERT(fcache_key_exists(cache, &keys[key]));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//an idle counter loses a point per lfu_decay_time minutes, the key hit most long ago goes first
+TEST lfu_counters_decay(void) {
+
+    init_option options = {0};
+    options.index = INDEX_RBTREE;
+    options.evict_samples = 8;
+    options.lfu_decay_time = 1;
+    flexcache* cache = new_cache(LFU, &options);
+    ASSERT(cache);
+    fcache_set_maxmemory(cache, 8 * entry_cost(cache));
+
+    for(long key = 0; key < 8; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    ASSERT(fcache_get_ptr(cache, &keys[0]));
+
+    //ten idle minutes take every counter to 0, the hits after that count again
+    test_clock.tv_sec += 10 * 60;
+    for(long key = 1; key < 8; key++)
+        ASSERT(fcache_get_ptr(cache, &keys[key]));
+    ASSERT_EQ(0, set_evicts(cache, 8));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//batches behave as their single key calls, in order: evictions and removed values come back together
+TEST batch_mset_mget_mdel(void) {
+
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    flexcache* cache = new_cache(LRU, &options);
+    ASSERT(cache);
+    size_fx cost = entry_cost(cache);
+    fcache_set_maxmemory(cache, 8 * cost);
+
+    void* batch[N_KEYS];
+    const void* batch_values[N_KEYS];
+    for(long i = 0; i < N_KEYS; i++){
+        batch[i] = &keys[i];
+        batch_values[i] = &values[i];
+    }
+
+    ASSERT_EQ(0, fcache_mset(cache, batch, batch_values, 8, &no_ttl));
+
+    //four more: the four oldest go, in one stack
+    stack_fx* removed = fcache_mset(cache, batch + 8, batch_values + 8, 4, &no_ttl);
+    ASSERT(removed);
+    ASSERT_EQ(4, stack_size(removed));
+    while(stack_size(removed)){
+        long* value = stack_pop(removed);
+        ASSERT(*value < 4);
+    }
+    stack_free(removed);
+
+    //hits and misses keep their slots
+    const void* found[12];
+    ASSERT_EQ(8, fcache_mget(cache, batch, 12, found));
+    for(long i = 0; i < 12; i++)
+        ASSERT_EQ(i < 4 ? 0 : &values[i], found[i]);
+
+    //a key set twice in the batch keeps the last value, the first one is handed back
+    void* twice[2] = {&keys[4], &keys[4]};
+    const void* twice_values[2] = {&values[20], &values[21]};
+    removed = fcache_mset(cache, twice, twice_values, 2, &no_ttl);
+    ASSERT(removed);
+    ASSERT_EQ(2, stack_size(removed));
+    stack_free(removed);
+    ASSERT_EQ(&values[21], fcache_get_ptr(cache, &keys[4]));
+
+    ASSERT_EQ(0, fcache_mdel(cache, batch, 4));
+    removed = fcache_mdel(cache, batch, 8);
+    ASSERT(removed);
+    ASSERT_EQ(4, stack_size(removed));
+    stack_free(removed);
+    ASSERT_EQ(4, fcache_mget(cache, batch, 12, found));
+    ASSERT_EQ(4 * cost, fcache_used_memory(cache));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//every read and write lands in one counter, peeks and existence checks in none
+TEST stats_counters(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    size_fx cost = entry_cost(cache);
+    fcache_stats_reset(cache);
+    fcache_set_maxmemory(cache, 4 * cost);
+
+    for(long key = 0; key < 6; key++)
+        set_evicts(cache, key);
+
+    set_option nx = {0};
+    nx.NX = 1;
+    set_option xx = {0};
+    xx.XX = 1;
+    ASSERT_EQ(0, fcache_set(cache, &keys[5], &values[5], &nx));
+    ASSERT_EQ(0, fcache_set(cache, &keys[0], &values[0], &xx));
+
+    ASSERT(fcache_get_ptr(cache, &keys[5]));
+    ASSERT_EQ(0, fcache_get_ptr(cache, &keys[0]));
+    void* batch[3] = {&keys[2], &keys[3], &keys[1]};
+    const void* found[3];
+    ASSERT_EQ(2, fcache_mget(cache, batch, 3, found));
+    ASSERT(fcache_peek(cache, &keys[4]));
+    ASSERT(fcache_key_exists(cache, &keys[4]));
+
+    fcache_stats_t stats;
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(3, stats.hits);
+    ASSERT_EQ(2, stats.misses);
+    ASSERT_EQ(6, stats.sets);
+    ASSERT_EQ(1, stats.nx_rejects);
+    ASSERT_EQ(1, stats.xx_rejects);
+    ASSERT_EQ(2, stats.evicted_memory);
+    ASSERT_EQ(0, stats.evicted_ttl);
+    ASSERT_EQ(2 * cost, stats.bytes_evicted);
+    ASSERT_EQ(4 * cost, stats.used_memory);
+    ASSERT_EQ(4 * (cost - sizeof(long)), stats.overhead_memory);
+
+    //reset clears the counters, the memory gauges stay
+    fcache_stats_reset(cache);
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(0, stats.hits);
+    ASSERT_EQ(0, stats.sets);
+    ASSERT_EQ(0, stats.evicted_memory);
+    ASSERT_EQ(4 * cost, stats.used_memory);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//values handed to cb_free, counted
+static long freed_values;
+
+static void count_free(void* data){
+    (void)data;
+    freed_values++;
+}
+
+static free_fx count_free_fx = count_free;
+
+//deferred sets only admit: the budget runs over and removed values wait for fcache_tick
+TEST deferred_tick(void) {
+
+    init_option options = {0};
+    options.deferred_maintenance = 1;
+    flexcache* cache = new_cache(LRU, &options);
+    ASSERT(cache);
+    size_fx cost = entry_cost(cache);
+    fcache_set_maxmemory(cache, 4 * cost);
+
+    for(long key = 0; key < 8; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    set_option px = {0};
+    px.PX = 10 * TICK_MS;
+    ASSERT_EQ(0, fcache_set(cache, &keys[8], &values[8], &px));
+    ASSERT_EQ(0, fcache_set(cache, &keys[0], &values[10], &no_ttl));
+    ASSERT_EQ(9 * cost, fcache_used_memory(cache));
+
+    //the oldest five go, with the value 0 replaced
+    freed_values = 0;
+    ASSERT(fcache_tick(cache, 1000000, &count_free_fx));
+    ASSERT_EQ(6, freed_values);
+    ASSERT_EQ(4 * cost, fcache_used_memory(cache));
+    for(long key = 1; key < 6; key++)
+        ASSERT_FALSE(fcache_key_exists(cache, &keys[key]));
+    ASSERT_EQ(&values[10], fcache_get_ptr(cache, &keys[0]));
+
+    //nothing left to do
+    ASSERT(fcache_tick(cache, 1000000, &count_free_fx));
+    ASSERT_EQ(6, freed_values);
+
+    //expiry waits for the tick too
+    advance_ms(10 * TICK_MS);
+    ASSERT_EQ(-1, set_evicts(cache, 9));
+    ASSERT(fcache_tick(cache, 1000000, &count_free_fx));
+    ASSERT_EQ(7, freed_values);
+    ASSERT_FALSE(fcache_key_exists(cache, &keys[8]));
+
+    fcache_stats_t stats;
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(5, stats.evicted_memory);
+    ASSERT_EQ(1, stats.evicted_ttl);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//scan callback keeping the keys seen, in order, it stops after stop keys (0 never)
+typedef struct scan_seen{
+    long        keys[N_KEYS];
+    long        count;
+    long        stop;
+} scan_seen;
+
+static bool_t seen_key(const void* key, const void* value, void* aux_data){
+    (void)value;
+    scan_seen* seen = aux_data;
+    seen->keys[seen->count++] = *(const long*)key;
+    return seen->stop == 0 || seen->count < seen->stop;
+}
+
+//[lo, hi) holds on both ends, present or not, a 0 bound is open
+TEST range_bounds(void) {
+
+    init_option options = {0};
+    options.index = INDEX_RBTREE;
+    flexcache* cache = new_cache(LRU, &options);
+    ASSERT(cache);
+    for(long key = 0; key < N_KEYS; key += 2)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+
+    scan_seen seen = {0};
+    ASSERT_EQ(5, fcache_range(cache, &keys[10], &keys[20], seen_key, &seen));
+    for(long i = 0; i < 5; i++)
+        ASSERT_EQ(10 + 2 * i, seen.keys[i]);
+
+    seen = (scan_seen){0};
+    ASSERT_EQ(4, fcache_range(cache, &keys[11], &keys[19], seen_key, &seen));
+    ASSERT_EQ(12, seen.keys[0]);
+    ASSERT_EQ(18, seen.keys[3]);
+
+    seen = (scan_seen){0};
+    ASSERT_EQ(2, fcache_range(cache, &keys[60], 0, seen_key, &seen));
+    ASSERT_EQ(62, seen.keys[1]);
+    seen = (scan_seen){0};
+    ASSERT_EQ(2, fcache_range(cache, 0, &keys[4], seen_key, &seen));
+    ASSERT_EQ(0, seen.keys[0]);
+    seen = (scan_seen){0};
+    ASSERT_EQ(N_KEYS / 2, fcache_range(cache, 0, 0, seen_key, &seen));
+    ASSERT_EQ(0, fcache_range(cache, &keys[20], &keys[20], seen_key, &seen));
+
+    //a callback returning 0 ends the scan, its key counts
+    seen = (scan_seen){0};
+    seen.stop = 3;
+    ASSERT_EQ(3, fcache_range(cache, &keys[10], 0, seen_key, &seen));
+    ASSERT_EQ(14, seen.keys[2]);
+    fcache_free(cache, &no_free_fx);
+
+    //INDEX_HASH scans every key for the same result, in no order
+    options.index = INDEX_HASH;
+    cache = new_cache(LRU, &options);
+    ASSERT(cache);
+    for(long key = 0; key < N_KEYS; key += 2)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    seen = (scan_seen){0};
+    ASSERT_EQ(4, fcache_range(cache, &keys[11], &keys[19], seen_key, &seen));
+    for(long i = 0; i < 4; i++)
+        ASSERT(seen.keys[i] >= 12 && seen.keys[i] <= 18 && seen.keys[i] % 2 == 0);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+static size_fx str_len(void* data){
+    return strlen(data) + 1;
+}
+
+static int str_cmp(const void* key1, const void* key2){
+    return strcmp(key1, key2);
+}
+
+static len_func str_len_fx = str_len;
+static cmp_func str_cmp_fx = str_cmp;
+
+typedef struct prefix_seen{
+    const char* keys[8];
+    long        count;
+} prefix_seen;
+
+static bool_t seen_prefix(const void* key, const void* value, void* aux_data){
+    (void)value;
+    prefix_seen* seen = aux_data;
+    seen->keys[seen->count++] = key;
+    return 1;
+}
+
+//the keys starting with the prefix and only them, in key order... the prefix key itself too
+TEST prefix_bounds(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.key_len = &str_len_fx;
+    funcs.compare = &str_cmp_fx;
+    init_option options = {0};
+    options.index = INDEX_RBTREE;
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT(fcache_init(cache, LRU, funcs, 1UL << 30, &options));
+
+    static char* names[] = {"b", "abd", "a", "ab", "ac", "abc", "aa"};
+    for(long i = 0; i < 7; i++)
+        ASSERT_EQ(0, fcache_set(cache, names[i], &values[i], &no_ttl));
+
+    prefix_seen seen = {0};
+    ASSERT_EQ(3, fcache_prefix(cache, "ab", 2, seen_prefix, &seen));
+    ASSERT_STR_EQ("ab", seen.keys[0]);
+    ASSERT_STR_EQ("abc", seen.keys[1]);
+    ASSERT_STR_EQ("abd", seen.keys[2]);
+
+    seen = (prefix_seen){0};
+    ASSERT_EQ(6, fcache_prefix(cache, "a", 1, seen_prefix, &seen));
+    ASSERT_EQ(0, fcache_prefix(cache, "abe", 3, seen_prefix, &seen));
+    ASSERT_EQ(0, fcache_prefix(cache, "c", 1, seen_prefix, &seen));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//used_memory follows every way in and out of the cache, and a lowered maxmemory holds from the next set
+TEST budget_accounting(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    size_fx cost = entry_cost(cache);
+    ASSERT_EQ(0, fcache_used_memory(cache));
+
+    //the node and its index slot are charged besides the value bytes
+    fcache_stats_t stats;
+    ASSERT_EQ(-1, set_evicts(cache, 0));
+    fcache_stats(cache, &stats);
+    ASSERT(cost > sizeof(long));
+    ASSERT_EQ(cost - sizeof(long), stats.overhead_memory);
+
+    for(long key = 1; key < 8; key++)
+        ASSERT_EQ(-1, set_evicts(cache, key));
+    ASSERT_EQ(8 * cost, fcache_used_memory(cache));
+
+    //a replace costs nothing more, a remove and an expiry give the cost back
+    ASSERT_EQ(0, set_evicts(cache, 0));
+    ASSERT_EQ(8 * cost, fcache_used_memory(cache));
+    ASSERT_EQ(&values[1], fcache_remove(cache, &keys[1]));
+    ASSERT_EQ(7 * cost, fcache_used_memory(cache));
+    set_option px = {0};
+    px.PX = 10 * TICK_MS;
+    ASSERT_EQ(0, fcache_set(cache, &keys[1], &values[1], &px));
+    ASSERT_EQ(8 * cost, fcache_used_memory(cache));
+    advance_ms(10 * TICK_MS);
+    ASSERT_EQ(0, fcache_get_ptr(cache, &keys[1]));
+    ASSERT_EQ(7 * cost, fcache_used_memory(cache));
+    stack_fx* removed = fcache_set(cache, &keys[1], &values[1], &no_ttl);
+    ASSERT(removed);
+    stack_free(removed);
+
+    //four entries fit now: the next set evicts five, the oldest (2 to 6, 0 was replaced)
+    fcache_set_maxmemory(cache, 4 * cost);
+    removed = fcache_set(cache, &keys[8], &values[8], &no_ttl);
+    ASSERT(removed);
+    ASSERT_EQ(5, stack_size(removed));
+    while(stack_size(removed)){
+        long* value = stack_pop(removed);
+        ASSERT(*value >= 2 && *value < 7);
+    }
+    stack_free(removed);
+    ASSERT_EQ(4 * cost, fcache_used_memory(cache));
+    ASSERT_EQ(7, set_evicts(cache, 9));
+
+    for(long key = 0; key < 10; key++)
+        fcache_remove(cache, &keys[key]);
+    ASSERT_EQ(0, fcache_used_memory(cache));
+    fcache_stats(cache, &stats);
+    ASSERT_EQ(0, stats.overhead_memory);
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+//a failed init gives back what it took before the failure, the cache struct stays the caller's
+TEST init_failure_releases(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    char dir[] = "/tmp/fcache_initXXXXXX";
+    ASSERT(mkdtemp(dir));
+
+    //the tier is open when WTINYLFU finds no funcs.hash
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.key_len = &test_len_fx;
+    funcs.hash = 0;
+    init_option options = {0};
+    options.l2_dir = dir;
+    options.l2_free = &no_free_fx;
+    options.inline_max = 16;
+    cache = fcache_new(funcs.allocator);
+    ASSERT(cache);
+    ASSERT_FALSE(fcache_init(cache, WTINYLFU, funcs, 1UL << 30, &options));
+    free(cache);
+
+    //its segment files are gone with it
+    ASSERT_EQ(0, rmdir(dir));
+    PASS();
+}
+
+//malloc allocator counting the blocks it has out, it fails once allocs_left runs out (-1 never)
+static long live_blocks;
+static long allocs_left;
+
+static void* counting_alloc(size_fx size){
+    if(allocs_left == 0)
+        return 0;
+    if(allocs_left > 0)
+        allocs_left--;
+    live_blocks++;
+    return malloc(size);
+}
+
+static void counting_free(void* ptr){
+    if(ptr)
+        live_blocks--;
+    free(ptr);
+}
+
+static alloc_fx counting_alloc_fx = counting_alloc;
+static free_fx counting_free_fx = counting_free;
+static const allocator_fx counting_allocator = {
+    .alloc = &counting_alloc_fx,
+    .free = &counting_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+//init fails on funcs or after allocs allocations (-1 no limit), every block it took before comes back
+static long init_failure_blocks(enum EVICTION_POLICY policy, data_aux_funcs_t funcs, init_option* options, long allocs){
+
+    funcs.allocator = &counting_allocator;
+    live_blocks = 0;
+    allocs_left = -1;
+    flexcache* cache = fcache_new(funcs.allocator);
+    allocs_left = allocs;
+    bool_t ok = cache && fcache_init(cache, policy, funcs, 1UL << 30, options);
+    allocs_left = -1;
+    if(ok || !cache)
+        return -1;
+    (*funcs.allocator->free)(cache);
+    return live_blocks;
+}
+
+//the mutation log is allocated when the index can not be built (INDEX_HASH without funcs.hash)
+TEST init_failure_releases_repl(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    fcache_free(cache, &no_free_fx);
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.key_len = &test_len_fx;
+    funcs.hash = 0;
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    options.repl_log_bytes = 4096;
+    ASSERT_EQ(0, init_failure_blocks(LRU, funcs, &options, -1));
+    PASS();
+}
+
+//the sketch is allocated when the index table allocation fails
+TEST init_failure_releases_sketch(void) {
+
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    ASSERT_EQ(0, init_failure_blocks(WTINYLFU, test_funcs, &options, 1));
+    PASS();
+}
+
+TEST release_twice(void) {
+
+    flexcache* cache = new_cache(LRU, 0);
+    ASSERT(cache);
+    ASSERT_EQ(-1, set_evicts(cache, 0));
+
+    fcache_handle* handle = fcache_acquire(cache, &keys[0]);
+    ASSERT(handle);
+    ASSERT_EQ(&values[0], fcache_handle_value(handle));
+    fcache_release(cache, handle, &no_free_fx);
+    fcache_release(cache, handle, &no_free_fx);
+
+    //not pinned anymore: remove hands back the value itself, not a copy
+    ASSERT_EQ(&values[0], fcache_remove(cache, &keys[0]));
+
+    fcache_free(cache, &no_free_fx);
+    PASS();
+}
+
+GREATEST_SUITE(flexcacheFX) {
+
+    RUN_TEST(slru_probation_order);
+    RUN_TEST(lru_evict_under_pressure);
+    RUN_TEST(ttl_expires_on_read);
+    RUN_TEST(ttl_expires_on_set);
+    RUN_TEST(ttl_jitter_bounds);
+    RUN_TEST(xfetch_early_expiry);
+    RUN_TEST(slab_fills_budget);
+    RUN_TEST(approx_lru_tree_samples);
+    RUN_TEST(find_all_tree_chunks);
+    RUN_TEST(snapshot_containers);
+    RUN_TEST(snapshot_slru_segments);
+    RUN_TEST(container_keys_hidden_from_reads);
+    RUN_TEST(set_index_grow_fails);
+    RUN_TEST(lfu_evicts_least_frequent);
+    RUN_TEST(lfu_counters_decay);
+    RUN_TEST(batch_mset_mget_mdel);
+    RUN_TEST(stats_counters);
+    RUN_TEST(deferred_tick);
+    RUN_TEST(range_bounds);
+    RUN_TEST(prefix_bounds);
+    RUN_TEST(budget_accounting);
+    RUN_TEST(init_failure_releases);
+    RUN_TEST(init_failure_releases_repl);
+    RUN_TEST(init_failure_releases_sketch);
+    RUN_TEST(release_twice);
+
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/fvalue_fx.h"
+
+extern SUITE(fvalueFX);
+
+static size_fx str_hash(const void* key){
+
+    size_fx h = 5381;
+    for(const char* c = key; *c; c++)
+        h = h * 33 + (unsigned char)*c;
+    return h;
+}
+
+static int str_cmp(const void* a, const void* b){
+    return strcmp(a, b);
+}
+
+static hash_func test_hash = str_hash;
+static cmp_func test_cmp = str_cmp;
+
+TEST list_push_pop_both_ends(void) {
+
+    flist_fx* list = flist_new(&test_allocator);
+    ASSERT(list);
+
+    for(long i = 0; i < 20; i++)
+        ASSERT(flist_push(list, &i, sizeof(i), i % 2));
+    ASSERT_EQ(20, flist_len(list));
+
+    //odd ones went to the front (19 first), even ones to the back
+    ASSERT_EQ(19, *(const long*)flist_at(list, 0)->data);
+    ASSERT_EQ(18, *(const long*)flist_at(list, 19)->data);
+    ASSERT_FALSE(flist_at(list, 20));
+
+    size_fx bytes = flist_bytes(list);
+    fvalue_bytes* front = flist_pop(list, 1);
+    ASSERT_EQ(19, *(long*)front->data);
+    ASSERT(flist_bytes(list) < bytes);
+    free(front);
+
+    fvalue_bytes* back = flist_pop(list, 0);
+    ASSERT_EQ(18, *(long*)back->data);
+    free(back);
+
+    ASSERT_EQ(18, flist_len(list));
+    flist_free(list);
+    PASS();
+}
+
+TEST map_set_replace_del(void) {
+
+    fmap_fx* map = fmap_new(&test_hash, &test_cmp, &test_allocator);
+    ASSERT(map);
+
+    ASSERT(fmap_set(map, "user", 5, "ana", 4));
+    ASSERT(fmap_set(map, "cart", 5, "3", 2));
+    ASSERT_EQ(2, fmap_len(map));
+    ASSERT_STR_EQ("ana", fmap_get(map, "user")->data);
+
+    size_fx bytes = fmap_bytes(map);
+    ASSERT(fmap_set(map, "user", 5, "bruno", 6));
+    ASSERT_EQ(2, fmap_len(map));
+    ASSERT_EQ(bytes + 2, fmap_bytes(map));
+    ASSERT_STR_EQ("bruno", fmap_get(map, "user")->data);
+
+    //the walk sees each field once, with its value
+    size_fx cursor = 0;
+    size_fx field_len;
+    const fvalue_bytes* value;
+    int user = 0, cart = 0;
+    for(const char* field; (field = fmap_next(map, &cursor, &field_len, &value)) != 0;){
+        ASSERT_EQ(5, field_len);
+        if(strcmp(field, "user") == 0){
+            user++;
+            ASSERT_STR_EQ("bruno", value->data);
+        } else{
+            cart++;
+            ASSERT_STR_EQ("cart", field);
+        }
+    }
+    ASSERT_EQ(1, user);
+    ASSERT_EQ(1, cart);
+
+    ASSERT(fmap_del(map, "cart"));
+    ASSERT_FALSE(fmap_del(map, "cart"));
+    ASSERT_FALSE(fmap_get(map, "cart"));
+    ASSERT_EQ(1, fmap_len(map));
+
+    fmap_free(map);
+    PASS();
+}
+
+SUITE(fvalueFX) {
+    RUN_TEST(list_push_pop_both_ends);
+    RUN_TEST(map_set_replace_del);
+}
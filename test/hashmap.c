@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/hashmap_fx.h"
+#include "../src/simd_fx.h"
+
+extern SUITE(hashmapFX);
+
+typedef struct entry_t{
+    long key;
+    long value;
+} entry_t;
+
+static size_fx long_hash(const void* key){
+    return (size_fx)*(const long*)key;
+}
+
+static int long_cmp(const void* key1, const void* key2){
+    long a = *(const long*)key1;
+    long b = *(const long*)key2;
+    return (a > b) - (a < b);
+}
+
+static const hash_func long_hash_fx = long_hash;
+static const cmp_func long_cmp_fx = long_cmp;
+
+static const void* entry_key(const void* entry){
+    return &((const entry_t*)entry)->key;
+}
+
+#define N_ENTRIES 1000
+
+static entry_t entries[N_ENTRIES];
+
+TEST set_get_remove(void) {
+
+    hmap_fx map;
+    ASSERT(hmap_init(&map, 0, &long_hash_fx, &long_cmp_fx, entry_key, &test_allocator));
+
+    for(long i = 0; i < N_ENTRIES; i++){
+        int ok;
+        entries[i].key = i * 7;
+        entries[i].value = i;
+        ASSERT_EQ(0, hmap_set(&map, &entries[i].key, &entries[i], &ok));
+        ASSERT(ok);
+    }
+    ASSERT_EQ(N_ENTRIES, hmap_size(&map));
+
+    for(long i = 0; i < N_ENTRIES; i++){
+        long key = i * 7;
+        entry_t* found = hmap_get(&map, &key);
+        ASSERT(found);
+        ASSERT_EQ(i, found->value);
+    }
+
+    long missing = 3;
+    ASSERT_EQ(0, hmap_get(&map, &missing));
+
+    for(long i = 0; i < N_ENTRIES; i += 2){
+        long key = i * 7;
+        ASSERT_EQ(&entries[i], hmap_remove(&map, &key));
+    }
+    ASSERT_EQ(N_ENTRIES / 2, hmap_size(&map));
+
+    for(long i = 0; i < N_ENTRIES; i++){
+        long key = i * 7;
+        entry_t* found = hmap_get(&map, &key);
+        if(i % 2)
+            ASSERT_EQ(&entries[i], found);
+        else
+            ASSERT_EQ(0, found);
+    }
+
+    hmap_destroy(&map);
+    PASS();
+}
+
+TEST replace_and_iterate(void) {
+
+    hmap_fx map;
+    ASSERT(hmap_init(&map, N_ENTRIES, &long_hash_fx, &long_cmp_fx, entry_key, &test_allocator));
+
+    int ok;
+    entry_t first = {42, 1};
+    entry_t second = {42, 2};
+    ASSERT_EQ(0, hmap_set(&map, &first.key, &first, &ok));
+    ASSERT_EQ(&first, hmap_set(&map, &second.key, &second, &ok));
+    ASSERT_EQ(1, hmap_size(&map));
+
+    size_fx cursor = 0;
+    size_fx seen = 0;
+    entry_t* iter;
+    while((iter = hmap_next(&map, &cursor)) != 0){
+        ASSERT_EQ(&second, iter);
+        seen++;
+    }
+    ASSERT_EQ(1, seen);
+
+    hmap_destroy(&map);
+    PASS();
+}
+
+TEST incremental_resize(void) {
+
+    hmap_fx map;
+    ASSERT(hmap_init(&map, 0, &long_hash_fx, &long_cmp_fx, entry_key, &test_allocator));
+
+    int ok;
+    size_fx resizes = 0;
+    for(long i = 0; i < N_ENTRIES; i++){
+        entries[i].key = i;
+        entries[i].value = i;
+        hmap_set(&map, &entries[i].key, &entries[i], &ok);
+        ASSERT(ok);
+        resizes += map.old != 0 && map.migrated == 0;
+
+        //every key stays visible while the old table drains
+        for(long k = 0; k <= i; k += 7)
+            ASSERT_EQ(&entries[k], hmap_get(&map, &k));
+    }
+    ASSERT(resizes > 0);
+
+    size_fx cursor = 0, seen = 0;
+    while(hmap_next(&map, &cursor))
+        seen++;
+    ASSERT_EQ(N_ENTRIES, seen);
+
+    while(hmap_migrate(&map, HMAP_MIGRATE_SLOTS))
+        ;
+    ASSERT_EQ(0, map.old);
+    ASSERT_EQ(N_ENTRIES, hmap_size(&map));
+
+    //pre-sized: no resize at all
+    hmap_fx sized;
+    ASSERT(hmap_init(&sized, N_ENTRIES, &long_hash_fx, &long_cmp_fx, entry_key, &test_allocator));
+    hmap_table* table = sized.table;
+    for(long i = 0; i < N_ENTRIES; i++)
+        hmap_set(&sized, &entries[i].key, &entries[i], &ok);
+    ASSERT_EQ(table, sized.table);
+
+    hmap_destroy(&sized);
+    hmap_destroy(&map);
+    PASS();
+}
+
+TEST group_match(void) {
+
+    signed char ctrl[SIMD_GROUP_WIDTH];
+    for(int i = 0; i < SIMD_GROUP_WIDTH; i++)
+        ctrl[i] = i % 3 == 0 ? 5 : HMAP_CTRL_EMPTY;
+    ctrl[1] = HMAP_CTRL_DELETED;
+
+    ASSERT_EQ(0x9249, simd_group_match(ctrl, 5));
+    ASSERT_EQ(0xFFFF & ~0x9249, simd_group_match_free(ctrl));
+    ASSERT_EQ(0xFFFF & ~0x9249 & ~0x2, simd_group_match_empty(ctrl));
+
+    PASS();
+}
+
+GREATEST_SUITE(hashmapFX) {
+
+    RUN_TEST(set_get_remove);
+    RUN_TEST(replace_and_iterate);
+    RUN_TEST(group_match);
+    RUN_TEST(incremental_resize);
+
+}
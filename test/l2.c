@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/l2_fx.h"
+
+extern SUITE(l2FX);
+
+#define N_KEYS 2000
+
+static char dir[64];
+
+static l2_fx* open_tier(size_fx max_bytes){
+
+    strcpy(dir, "/tmp/l2_testXXXXXX");
+    if(!mkdtemp(dir))
+        return 0;
+    return l2_open(dir, max_bytes, &test_allocator);
+}
+
+static void close_tier(l2_fx* l2){
+    l2_close(l2);
+    rmdir(dir);
+}
+
+TEST put_get_remove(void) {
+
+    l2_fx* l2 = open_tier(0);
+    ASSERT(l2);
+
+    char value[100];
+    for(long key = 0; key < N_KEYS; key++){
+        memset(value, (int)(key & 0x7F), sizeof(value));
+        ASSERT(l2_put(l2, &key, sizeof(key), value, (size_fx)(key % 100), (unsigned long long)key));
+    }
+    ASSERT_EQ(N_KEYS, l2_size(l2));
+
+    for(long key = 0; key < N_KEYS; key++){
+        size_fx len;
+        unsigned long long expires;
+        char* got = l2_get(l2, &key, sizeof(key), &len, &expires);
+        ASSERT(got);
+        ASSERT_EQ((size_fx)(key % 100), len);
+        ASSERT_EQ((unsigned long long)key, expires);
+        for(size_fx i = 0; i < len; i++)
+            ASSERT_EQ((char)(key & 0x7F), got[i]);
+        free(got);
+    }
+
+    long key = 7;
+    ASSERT(l2_remove(l2, &key, sizeof(key)));
+    ASSERT_FALSE(l2_remove(l2, &key, sizeof(key)));
+    size_fx len;
+    ASSERT_EQ(0, l2_get(l2, &key, sizeof(key), &len, 0));
+
+    //same bytes, other length: not the same key
+    int short_key = 8;
+    ASSERT_EQ(0, l2_get(l2, &short_key, sizeof(short_key), &len, 0));
+
+    close_tier(l2);
+    PASS();
+}
+
+TEST compact_and_bound(void) {
+
+    //64 KiB segments under a 256 KiB bound
+    l2_fx* l2 = open_tier(256 * 1024);
+    ASSERT(l2);
+
+    char value[200] = {0};
+    for(int round = 0; round < 4; round++){
+        for(long key = 0; key < 200; key++){
+            value[0] = (char)round;
+            ASSERT(l2_put(l2, &key, sizeof(key), value, sizeof(value), 0));
+        }
+    }
+    ASSERT_EQ(200, l2_size(l2));
+
+    //older rounds are dead records, compaction keeps only the last one
+    size_fx before = l2_bytes(l2);
+    ASSERT(l2_compact(l2, 16) > 0);
+    ASSERT(l2_bytes(l2) < before);
+    ASSERT_EQ(200, l2_size(l2));
+
+    for(long key = 0; key < 200; key++){
+        size_fx len;
+        char* got = l2_get(l2, &key, sizeof(key), &len, 0);
+        ASSERT(got);
+        ASSERT_EQ(3, got[0]);
+        free(got);
+    }
+
+    //way over the bound: the oldest segments go, the newest keys stay
+    for(long key = 1000; key < 5000; key++)
+        ASSERT(l2_put(l2, &key, sizeof(key), value, sizeof(value), 0));
+
+    ASSERT(l2_bytes(l2) <= 256 * 1024);
+    long newest = 4999;
+    size_fx len;
+    char* got = l2_get(l2, &newest, sizeof(newest), &len, 0);
+    ASSERT(got);
+    free(got);
+    long oldest = 0;
+    ASSERT_EQ(0, l2_get(l2, &oldest, sizeof(oldest), &len, 0));
+
+    close_tier(l2);
+    PASS();
+}
+
+GREATEST_SUITE(l2FX) {
+
+    RUN_TEST(put_get_remove);
+    RUN_TEST(compact_and_bound);
+
+}
@@ -2,6 +2,17 @@
 
 /* Define a suite, compiled seperately. */
 SUITE_EXTERN(stackFX);
+SUITE_EXTERN(hashmapFX);
+SUITE_EXTERN(slabFX);
+SUITE_EXTERN(twheelFX);
+SUITE_EXTERN(epochFX);
+SUITE_EXTERN(sketchFX);
+SUITE_EXTERN(defineFX);
+SUITE_EXTERN(fvalueFX);
+SUITE_EXTERN(l2FX);
+SUITE_EXTERN(replFX);
+SUITE_EXTERN(flexcacheFX);
+SUITE_EXTERN(shardedFX);
 
 /* Add all the definitions that need to be in the test runner's main file. */
 GREATEST_MAIN_DEFS();
@@ -11,6 +22,17 @@ int main(int argc, char **argv) {
 
     // RUN_SUITE(suite);
     RUN_SUITE(stackFX);
+    RUN_SUITE(hashmapFX);
+    RUN_SUITE(slabFX);
+    RUN_SUITE(twheelFX);
+    RUN_SUITE(epochFX);
+    RUN_SUITE(sketchFX);
+    RUN_SUITE(defineFX);
+    RUN_SUITE(fvalueFX);
+    RUN_SUITE(l2FX);
+    RUN_SUITE(replFX);
+    RUN_SUITE(flexcacheFX);
+    RUN_SUITE(shardedFX);
 
     GREATEST_MAIN_END();        /* display results */
 }
\ No newline at end of file
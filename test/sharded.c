@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/fcache_sharded.h"
+
+extern SUITE(shardedFX);
+
+#define N_KEYS      4096
+#define N_THREADS   4
+#define N_OPS       50000
+#define N_SHARDS    8
+
+//node time resolution: ms, whole seconds with the compact layout
+#ifdef FCACHE_COMPACT_NODE
+#define TICK_MS 1000
+#else
+#define TICK_MS 1
+#endif
+
+static long keys[N_KEYS];
+
+static _Atomic size_fx live_values;
+
+static size_fx long_len(void* data){
+    (void)data;
+    return sizeof(long);
+}
+
+static long* value_new(long v){
+
+    long* value = malloc(sizeof(long));
+    *value = v;
+    atomic_fetch_add_explicit(&live_values, 1, memory_order_relaxed);
+    return value;
+}
+
+static void* long_copy(void* data){
+    return value_new(*(long*)data);
+}
+
+static void value_free(void* data){
+
+    atomic_fetch_sub_explicit(&live_values, 1, memory_order_relaxed);
+    free(data);
+}
+
+static int long_cmp(const void* key1, const void* key2){
+
+    long a = *(const long*)key1;
+    long b = *(const long*)key2;
+    return (a > b) - (a < b);
+}
+
+static size_fx long_hash(const void* key){
+
+    size_fx h = (size_fx)*(const long*)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void real_now(time_fx* now){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now->tv_sec = ts.tv_sec;
+    now->tv_nsec = ts.tv_nsec;
+}
+
+static len_func test_len_fx = long_len;
+static copy_func test_copy_fx = long_copy;
+static cmp_func test_cmp_fx = long_cmp;
+static hash_func test_hash_fx = long_hash;
+static now_func test_now_fx = real_now;
+static free_fx value_free_fx = value_free;
+
+static const data_aux_funcs_t test_funcs = {
+    .len_func = &test_len_fx,
+    .key_len = 0,
+    .copy_func = &test_copy_fx,
+    .compare = &test_cmp_fx,
+    .hash = &test_hash_fx,
+    .allocator = &test_allocator,
+    .now = &test_now_fx
+};
+
+typedef struct worker_t{
+    pthread_t           thread;
+    fcache_sharded*     cache;
+    size_fx             seed;
+    size_fx             bad_values;
+} worker_t;
+
+// mixed writers and readers over the same keys: sets (a third with a 1 ms ttl), removes and all
+// the read paths, lock free ones with concurrent_reads
+static void* worker_main(void* arg){
+
+    worker_t* worker = arg;
+    set_option no_ttl = {0};
+    set_option px = {0};
+#ifdef FCACHE_COMPACT_NODE
+    px.PXAT = 1; //1 ms would round up to a second, longer than the run: already due
+#else
+    px.PX = 1;
+#endif
+
+    for(size_fx i = 0; i < N_OPS; i++){
+        size_fx r = rand_fx(&worker->seed);
+        long* key = &keys[(r >> 8) % N_KEYS];
+
+        switch(r % 8){
+            case 0:
+            case 1:
+                fcache_sharded_set_free(worker->cache, key, value_new(*key), r & 0x100 ? &px : &no_ttl, &value_free_fx);
+                break;
+            case 2:{
+                void* removed = fcache_sharded_remove(worker->cache, key);
+                if(removed)
+                    fcache_sharded_retire(worker->cache, removed, &value_free_fx);
+                break;
+            }
+            case 3:
+                fcache_sharded_key_exists(worker->cache, key);
+                break;
+            //values are their key, whatever a reader gets must match it
+            case 4:{
+                fcache_handle* handle = fcache_sharded_acquire(worker->cache, key);
+                if(handle){
+                    worker->bad_values += *(const long*)fcache_handle_value(handle) != *key;
+                    fcache_sharded_release(worker->cache, key, handle, &value_free_fx);
+                }
+                break;
+            }
+            default:{
+                long* copy = fcache_sharded_get_copy(worker->cache, key);
+                if(copy){
+                    worker->bad_values += *copy != *key;
+                    value_free(copy);
+                }
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+static int run_workers(enum EVICTION_POLICY policy, bool_t concurrent_reads, size_fx* bad_values){
+
+    for(long i = 0; i < N_KEYS; i++)
+        keys[i] = i;
+
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    options.concurrent_reads = concurrent_reads;
+
+    //about a quarter of the keys fit, the writers evict all along
+    size_fx maxmemory = N_KEYS / 4 * 128;
+    fcache_sharded* cache = fcache_sharded_init(N_SHARDS, policy, test_funcs, maxmemory, &options);
+    if(!cache)
+        return 0;
+
+    worker_t workers[N_THREADS];
+    for(size_fx t = 0; t < N_THREADS; t++){
+        workers[t].cache = cache;
+        workers[t].seed = 0x9E3779B97F4A7C15UL * (t + 1);
+        workers[t].bad_values = 0;
+        pthread_create(&workers[t].thread, 0, worker_main, &workers[t]);
+    }
+
+    *bad_values = 0;
+    for(size_fx t = 0; t < N_THREADS; t++){
+        pthread_join(workers[t].thread, 0);
+        *bad_values += workers[t].bad_values;
+    }
+
+    //the global counter agrees with the shards once the calls are done, reads included... the
+    //budget the shards share is a soft bound, only the evictions are checked
+    fcache_stats_t total;
+    fcache_sharded_stats(cache, &total, 0);
+    bool_t accounted = total.used_memory == fcache_sharded_used_memory(cache) && total.evicted_memory > 0 &&
+                        total.evicted_ttl > 0;
+
+    fcache_sharded_free(cache, &value_free_fx);
+    return accounted ? 1 : -1;
+}
+
+TEST concurrent_set_evict_expire(void) {
+
+    size_fx bad_values;
+    atomic_store(&live_values, 0);
+    ASSERT_EQ(1, run_workers(LRU, 0, &bad_values));
+    ASSERT_EQ(0, bad_values);
+    ASSERT_EQ(0, atomic_load(&live_values));
+    PASS();
+}
+
+TEST concurrent_lock_free_reads(void) {
+
+    size_fx bad_values;
+    atomic_store(&live_values, 0);
+    ASSERT_EQ(1, run_workers(LRU, 1, &bad_values));
+    ASSERT_EQ(0, bad_values);
+    ASSERT_EQ(0, atomic_load(&live_values));
+    PASS();
+}
+
+//lock free readers stamp lst_used while the writers sample it for victims
+TEST concurrent_approx_lru(void) {
+
+    size_fx bad_values;
+    atomic_store(&live_values, 0);
+    ASSERT_EQ(1, run_workers(APPROX_LRU, 1, &bad_values));
+    ASSERT_EQ(0, bad_values);
+    ASSERT_EQ(0, atomic_load(&live_values));
+    PASS();
+}
+
+// get or load: a loader counting its calls, held while hold_loader is set, its values are 100 + the
+// call count... a 100 tick ttl on the stored value
+static _Atomic size_fx loads;
+static _Atomic int hold_loader;
+static _Atomic int fail_loader;
+static time_fx load_clock;
+
+static void load_now(time_fx* now){
+    *now = load_clock;
+}
+
+static now_func load_now_fx = load_now;
+
+static void* counting_loader(void* key, void* ctx, set_option* options){
+
+    (void)key;
+    (void)ctx;
+    size_fx call = atomic_fetch_add(&loads, 1) + 1;
+    while(atomic_load(&hold_loader))
+        sched_yield();
+
+    if(atomic_load(&fail_loader))
+        return 0;
+    options->PX = 100 * TICK_MS;
+    return value_new(100 + (long)call);
+}
+
+static fcache_sharded* load_cache(size_fx refresh_ahead){
+
+    atomic_store(&loads, 0);
+    atomic_store(&hold_loader, 0);
+    atomic_store(&fail_loader, 0);
+    atomic_store(&live_values, 0);
+    load_clock.tv_sec = 1000;
+    load_clock.tv_nsec = 0;
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.now = &load_now_fx;
+
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    options.refresh_ahead = refresh_ahead;
+    return fcache_sharded_init(N_SHARDS, LRU, funcs, 1UL << 30, &options);
+}
+
+typedef struct loader_t{
+    pthread_t           thread;
+    fcache_sharded*     cache;
+    long*               value;
+} loader_t;
+
+static void* loader_main(void* arg){
+
+    loader_t* loader = arg;
+    loader->value = fcache_sharded_get_or_load(loader->cache, &keys[7], counting_loader, 0, &value_free_fx);
+    return 0;
+}
+
+static void wait_loads(size_fx count){
+    while(atomic_load(&loads) < count)
+        sched_yield();
+}
+
+//callers missing while a load runs wait for it, the loader runs once
+TEST get_or_load_coalesced(void) {
+
+    fcache_sharded* cache = load_cache(0);
+    ASSERT(cache);
+
+    atomic_store(&hold_loader, 1);
+    loader_t loaders[N_THREADS];
+    for(size_fx t = 0; t < N_THREADS; t++){
+        loaders[t].cache = cache;
+        pthread_create(&loaders[t].thread, 0, loader_main, &loaders[t]);
+    }
+    wait_loads(1);
+    atomic_store(&hold_loader, 0);
+
+    for(size_fx t = 0; t < N_THREADS; t++){
+        pthread_join(loaders[t].thread, 0);
+        ASSERT(loaders[t].value);
+        ASSERT_EQ(101, *loaders[t].value);
+        value_free(loaders[t].value);
+    }
+    ASSERT_EQ(1, atomic_load(&loads));
+    ASSERT(fcache_sharded_key_exists(cache, &keys[7]));
+
+    fcache_sharded_free(cache, &value_free_fx);
+    ASSERT_EQ(0, atomic_load(&live_values));
+    PASS();
+}
+
+//a failed load stores nothing, the next caller loads again
+TEST get_or_load_failing(void) {
+
+    fcache_sharded* cache = load_cache(0);
+    ASSERT(cache);
+
+    atomic_store(&fail_loader, 1);
+    ASSERT_EQ(0, fcache_sharded_get_or_load(cache, &keys[7], counting_loader, 0, &value_free_fx));
+    ASSERT_FALSE(fcache_sharded_key_exists(cache, &keys[7]));
+    ASSERT_EQ(0, fcache_sharded_get_or_load(cache, &keys[7], counting_loader, 0, &value_free_fx));
+    ASSERT_EQ(2, atomic_load(&loads));
+
+    atomic_store(&fail_loader, 0);
+    long* value = fcache_sharded_get_or_load(cache, &keys[7], counting_loader, 0, &value_free_fx);
+    ASSERT(value);
+    ASSERT_EQ(103, *value);
+    value_free(value);
+
+    fcache_sharded_free(cache, &value_free_fx);
+    ASSERT_EQ(0, atomic_load(&live_values));
+    PASS();
+}
+
+//a hit with less than half its ttl left reloads, the other callers keep the current value meanwhile
+TEST get_or_load_stale_while_revalidate(void) {
+
+    fcache_sharded* cache = load_cache(50);
+    ASSERT(cache);
+
+    long* value = fcache_sharded_get_or_load(cache, &keys[7], counting_loader, 0, &value_free_fx);
+    ASSERT_EQ(101, *value);
+    value_free(value);
+
+    //40 ticks left of 100: the next hit refreshes
+    load_clock.tv_sec += 60 * TICK_MS / 1000;
+    load_clock.tv_nsec += 60 * TICK_MS % 1000 * 1000000L;
+    atomic_store(&hold_loader, 1);
+    loader_t refresher = {.cache = cache};
+    pthread_create(&refresher.thread, 0, loader_main, &refresher);
+    wait_loads(2);
+
+    value = fcache_sharded_get_or_load(cache, &keys[7], counting_loader, 0, &value_free_fx);
+    ASSERT_EQ(101, *value);
+    value_free(value);
+
+    atomic_store(&hold_loader, 0);
+    pthread_join(refresher.thread, 0);
+    ASSERT_EQ(102, *refresher.value);
+    value_free(refresher.value);
+
+    //fresh again, a plain hit
+    value = fcache_sharded_get_or_load(cache, &keys[7], counting_loader, 0, &value_free_fx);
+    ASSERT_EQ(102, *value);
+    value_free(value);
+    ASSERT_EQ(2, atomic_load(&loads));
+
+    fcache_sharded_free(cache, &value_free_fx);
+    ASSERT_EQ(0, atomic_load(&live_values));
+    PASS();
+}
+
+//malloc allocator counting the blocks it has out, it fails once allocs_left runs out (-1 never)
+static long live_blocks;
+static long allocs_left;
+
+static void* counting_alloc(size_fx size){
+    if(allocs_left == 0)
+        return 0;
+    if(allocs_left > 0)
+        allocs_left--;
+    live_blocks++;
+    return malloc(size);
+}
+
+static void counting_free(void* ptr){
+    if(ptr)
+        live_blocks--;
+    free(ptr);
+}
+
+static alloc_fx counting_alloc_fx = counting_alloc;
+static free_fx counting_free_fx = counting_free;
+static const allocator_fx counting_allocator = {
+    .alloc = &counting_alloc_fx,
+    .free = &counting_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+//an allocation failing at any point of init leaves nothing behind: the shards, the epoch and the arrays
+TEST init_failure_releases(void) {
+
+    data_aux_funcs_t funcs = test_funcs;
+    funcs.allocator = &counting_allocator;
+    init_option options = {0};
+    options.index = INDEX_HASH;
+    options.concurrent_reads = 1;
+
+    bool_t built = 0;
+    for(long allocs = 0; !built; allocs++){
+        ASSERT(allocs < 1000);
+        live_blocks = 0;
+        allocs_left = allocs;
+        fcache_sharded* cache = fcache_sharded_init(N_SHARDS, LRU, funcs, 1UL << 30, &options);
+        allocs_left = -1;
+
+        built = cache != 0;
+        if(cache)
+            fcache_sharded_free(cache, 0);
+        ASSERT_EQ(0, live_blocks);
+    }
+
+    PASS();
+}
+
+GREATEST_SUITE(shardedFX) {
+
+    RUN_TEST(concurrent_set_evict_expire);
+    RUN_TEST(concurrent_lock_free_reads);
+    RUN_TEST(concurrent_approx_lru);
+    RUN_TEST(get_or_load_coalesced);
+    RUN_TEST(get_or_load_failing);
+    RUN_TEST(get_or_load_stale_while_revalidate);
+    RUN_TEST(init_failure_releases);
+
+}
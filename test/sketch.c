@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include "greatest.h"
+#include "test_alloc.h"
+#include "../src/cm_sketch.h"
+
+extern SUITE(sketchFX);
+
+TEST never_underestimates(void) {
+
+    cm_sketch_fx sketch;
+    ASSERT(cm_sketch_init(&sketch, 1024, &test_allocator));
+
+    for(size_fx key = 0; key < 512; key++){
+        for(size_fx i = 0; i < key % 8; i++)
+            cm_sketch_increment(&sketch, key);
+    }
+
+    for(size_fx key = 0; key < 512; key++)
+        ASSERT(cm_sketch_estimate(&sketch, key) >= key % 8);
+
+    cm_sketch_destroy(&sketch);
+    PASS();
+}
+
+TEST hot_over_cold(void) {
+
+    cm_sketch_fx sketch;
+    ASSERT(cm_sketch_init(&sketch, 4096, &test_allocator));
+
+    for(size_fx i = 0; i < 12; i++)
+        cm_sketch_increment(&sketch, 42);
+    for(size_fx key = 1000; key < 3000; key++)
+        cm_sketch_increment(&sketch, key);
+
+    ASSERT_EQ(12, cm_sketch_estimate(&sketch, 42));
+
+    size_fx cold_over = 0;
+    for(size_fx key = 1000; key < 3000; key++)
+        cold_over += cm_sketch_estimate(&sketch, key) > 2;
+    ASSERT(cold_over < 20);
+
+    cm_sketch_destroy(&sketch);
+    PASS();
+}
+
+TEST saturates_and_ages(void) {
+
+    cm_sketch_fx sketch;
+    ASSERT(cm_sketch_init(&sketch, 64, &test_allocator));
+
+    for(size_fx i = 0; i < 40; i++)
+        cm_sketch_increment(&sketch, 7);
+    ASSERT_EQ(15, cm_sketch_estimate(&sketch, 7));
+
+    //enough distinct keys to reach the sample size: every counter is halved
+    size_fx key = 100;
+    while(sketch.additions > 0 && cm_sketch_estimate(&sketch, 7) == 15)
+        cm_sketch_increment(&sketch, key++);
+
+    ASSERT(cm_sketch_estimate(&sketch, 7) <= 8);
+
+    cm_sketch_destroy(&sketch);
+    PASS();
+}
+
+TEST ensure_grows(void) {
+
+    cm_sketch_fx sketch;
+    ASSERT(cm_sketch_init(&sketch, 16, &test_allocator));
+    size_fx words = sketch.mask + 1;
+
+    ASSERT(cm_sketch_ensure(&sketch, 16));
+    ASSERT_EQ(words, sketch.mask + 1);
+
+    ASSERT(cm_sketch_ensure(&sketch, 100000));
+    ASSERT(sketch.mask + 1 > words);
+    ASSERT_EQ(0, cm_sketch_estimate(&sketch, 3));
+
+    cm_sketch_destroy(&sketch);
+    PASS();
+}
+
+SUITE(sketchFX) {
+    RUN_TEST(never_underestimates);
+    RUN_TEST(hot_over_cold);
+    RUN_TEST(saturates_and_ages);
+    RUN_TEST(ensure_grows);
+}
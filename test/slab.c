@@ -0,0 +1,100 @@
+#include <string.h>
+#include "greatest.h"
+#include "../src/slab_fx.h"
+
+extern SUITE(slabFX);
+
+TEST reuse_freed_slots(void) {
+
+    void* first = slab_alloc(40);
+    ASSERT(first);
+    ASSERT_EQ(0, (size_fx)first % 16);
+
+    size_fx held = slab_held_memory();
+    ASSERT(held >= SLAB_FX_SIZE);
+
+    slab_free(first);
+    void* again = slab_alloc(48);
+    ASSERT_EQ(first, again);
+    ASSERT_EQ(held, slab_held_memory());
+
+    slab_free(again);
+    PASS();
+}
+
+TEST classes_do_not_overlap(void) {
+
+    char* ptrs[512];
+    for(int i = 0; i < 512; i++){
+        ptrs[i] = slab_alloc(1 + i * 7);
+        ASSERT(ptrs[i]);
+        memset(ptrs[i], i & 0xFF, 1 + i * 7);
+    }
+
+    for(int i = 0; i < 512; i++){
+        for(int j = 0; j < 1 + i * 7; j++)
+            ASSERT_EQ((char)(i & 0xFF), ptrs[i][j]);
+        slab_free(ptrs[i]);
+    }
+
+    PASS();
+}
+
+TEST large_blocks(void) {
+
+    size_fx held = slab_held_memory();
+
+    char* big = slab_alloc(SLAB_FX_SIZE * 2);
+    ASSERT(big);
+    memset(big, 1, SLAB_FX_SIZE * 2);
+    ASSERT(slab_held_memory() > held);
+
+    slab_free(big);
+    ASSERT_EQ(held, slab_held_memory());
+
+    //past 4096 a slot of its class, not a block of its own
+    char* medium = slab_alloc(5000);
+    ASSERT(medium);
+    memset(medium, 1, 5000);
+    char* next = slab_alloc(5000);
+    ASSERT(next);
+    ASSERT(slab_held_memory() - held <= SLAB_FX_SIZE);
+    slab_free(medium);
+    slab_free(next);
+    slab_thread_flush();
+
+    PASS();
+}
+
+TEST prefill_and_allocator(void) {
+
+    ASSERT(slab_prefill(64, 4096));
+
+    const allocator_fx* allocator = slab_allocator();
+    size_fx held = (*allocator->held)();
+
+    void* ptr = (*allocator->alloc)(64);
+    ASSERT(ptr);
+    (*allocator->free)(ptr);
+    ASSERT_EQ(held, (*allocator->held)());
+
+    //what a cache charges per allocation: the class, or whole slabs past the last class
+    ASSERT_EQ(16, (*allocator->usable)(1));
+    ASSERT_EQ(80, (*allocator->usable)(65));
+    ASSERT_EQ(5440, (*allocator->usable)(5000));
+    ASSERT_EQ(32736, (*allocator->usable)(21761));
+    ASSERT_EQ(SLAB_FX_MAX_CLASS, (*allocator->usable)(SLAB_FX_MAX_CLASS));
+    ASSERT_EQ(SLAB_FX_SIZE, (*allocator->usable)(SLAB_FX_MAX_CLASS + 1));
+
+    slab_thread_flush();
+    PASS();
+}
+
+GREATEST_SUITE(slabFX) {
+
+    RUN_TEST(reuse_freed_slots);
+    RUN_TEST(classes_do_not_overlap);
+    RUN_TEST(large_blocks);
+    RUN_TEST(prefill_and_allocator);
+
+}
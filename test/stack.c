@@ -1,26 +1,103 @@
 
+#include <stdlib.h>
 #include "greatest.h"
 #include "../src/stack_fx.h"
 
 extern SUITE(stackFX);
 
+static size_fx heap_allocs;
+
+static void* count_alloc(size_fx size){
+    heap_allocs++;
+    return malloc(size);
+}
+
+static alloc_fx count_alloc_fx = count_alloc;
+static free_fx count_free_fx = free;
+static const allocator_fx count_allocator = {
+    .alloc = &count_alloc_fx,
+    .free = &count_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+static long items[64];
+
+TEST inline_batch_no_heap(void) {
+
+    stack_fx stck;
+    heap_allocs = 0;
+    stack_init(&stck, &count_allocator);
+
+    for(int i = 0; i < STACK_FX_INLINE; i++)
+        ASSERT(stack_push(&stck, &items[i]));
+    ASSERT_EQ(STACK_FX_INLINE, stack_size(&stck));
+
+    for(int i = STACK_FX_INLINE - 1; i >= 0; i--)
+        ASSERT_EQ(&items[i], stack_pop(&stck));
+
+    ASSERT_EQ(0, stack_pop(&stck));
+    ASSERT_EQ(0, heap_allocs);
+    PASS();
+}
+
+TEST grow_keeps_order(void) {
+
+    stack_fx stck;
+    heap_allocs = 0;
+    stack_init(&stck, &count_allocator);
+
+    for(int i = 0; i < 64; i++)
+        ASSERT(stack_push(&stck, &items[i]));
+    ASSERT_EQ(64, stack_size(&stck));
+    ASSERT(heap_allocs > 0);
+
+    for(int i = 63; i >= 0; i--)
+        ASSERT_EQ(&items[i], stack_pop(&stck));
+
+    stack_free(&stck);
+    PASS();
+}
+
+TEST concat_and_free(void) {
+
+    stack_fx* dst = stack_new(&count_allocator);
+    stack_fx* src = stack_new(&count_allocator);
+    ASSERT(dst && src);
+
+    for(int i = 0; i < 20; i++)
+        stack_push(i < 10 ? dst : src, &items[i]);
+
+    ASSERT(stack_concat(dst, src));
+    ASSERT_EQ(20, stack_size(dst));
+    ASSERT_EQ(0, stack_size(src));
+    ASSERT_EQ(&items[19], stack_pop(dst));
+
+    stack_free(src);
+    stack_free(dst);
+    PASS();
+}
+
 static void setup_cb(void *data) {
-    
+    (void)data;
     printf("setup callback for each test case\n");
 }
 
 static void teardown_cb(void *data) {
+    (void)data;
     printf("teardown callback for each test case\n");
 }
 
 GREATEST_SUITE(stackFX) {
 
-    stack_fx* stck;
+    stack_fx* stck = 0;
 
     SET_SETUP(setup_cb, stck);
     SET_TEARDOWN(teardown_cb, stck);
 
-    // RUN_TEST(example);
+    RUN_TEST(inline_batch_no_heap);
+    RUN_TEST(grow_keeps_order);
+    RUN_TEST(concat_and_free);
 
 }
 
@@ -0,0 +1,22 @@
+#ifndef __TEST_ALLOC_H__
+#define __TEST_ALLOC_H__
+
+#include <stdlib.h>
+#include "../src/allocator.h"
+
+// malloc / free allocator shared by the suites, it reports no held bytes and no rounding
+
+static void* test_alloc(size_fx size){
+    return malloc(size);
+}
+
+static alloc_fx test_alloc_fx = test_alloc;
+static free_fx test_free_fx = free;
+static const allocator_fx test_allocator = {
+    .alloc = &test_alloc_fx,
+    .free = &test_free_fx,
+    .held = 0,
+    .usable = 0
+};
+
+#endif
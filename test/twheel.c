@@ -0,0 +1,119 @@
+#include "greatest.h"
+#include "../src/timer_wheel.h"
+
+extern SUITE(twheelFX);
+
+#define N_TIMERS 2000
+
+typedef struct test_timer{
+    twheel_node     node;
+    twheel_time     fired_at;
+} test_timer;
+
+static test_timer timers[N_TIMERS];
+static twheel_fx wheel;
+
+static void on_expire(twheel_node* node, void* aux_data){
+
+    twheel_fx* w = aux_data;
+    test_timer* timer = (test_timer*)node;
+    timer->fired_at = w->now;
+}
+
+TEST expire_in_order(void) {
+
+    twheel_init(&wheel, 1000);
+
+    size_fx seed = 88172645463325252UL;
+    for(int i = 0; i < N_TIMERS; i++){
+        twheel_node_init(&timers[i].node);
+        timers[i].fired_at = 0;
+        twheel_add(&wheel, &timers[i].node, 1000 + rand_fx(&seed) % 500000);
+    }
+    ASSERT_EQ(N_TIMERS, wheel.count);
+
+    size_fx expired = 0;
+    for(twheel_time now = 1000; now <= 1000 + 500000; now += 37)
+        expired += twheel_advance(&wheel, now, on_expire, &wheel);
+    expired += twheel_advance(&wheel, 1000 + 500001, on_expire, &wheel);
+
+    ASSERT_EQ(N_TIMERS, expired);
+    ASSERT_EQ(0, wheel.count);
+
+    for(int i = 0; i < N_TIMERS; i++){
+        twheel_time expires = timers[i].node.expires;
+        ASSERT(timers[i].fired_at >= expires);
+        ASSERT(timers[i].fired_at <= expires + 37);
+        ASSERT_FALSE(twheel_pending(&timers[i].node));
+    }
+
+    PASS();
+}
+
+TEST remove_before_due(void) {
+
+    twheel_init(&wheel, 0);
+
+    for(int i = 0; i < 10; i++){
+        twheel_node_init(&timers[i].node);
+        timers[i].fired_at = 0;
+        twheel_add(&wheel, &timers[i].node, 100000 + i);
+    }
+
+    for(int i = 0; i < 10; i += 2)
+        twheel_remove(&wheel, &timers[i].node);
+    ASSERT_EQ(5, wheel.count);
+
+    ASSERT_EQ(0, twheel_advance(&wheel, 99999, on_expire, &wheel));
+    ASSERT_EQ(5, twheel_advance(&wheel, 200000, on_expire, &wheel));
+
+    for(int i = 0; i < 10; i++)
+        ASSERT_EQ(i % 2 ? 1 : 0, timers[i].fired_at != 0);
+
+    PASS();
+}
+
+//timers a month apart, each advance jumps the idle gap straight to the next one... one step per
+//64 ms rotation would be 400 million steps here
+TEST advance_idle_gaps(void) {
+
+    twheel_init(&wheel, 5);
+
+    twheel_time day = 24ULL * 3600 * 1000;
+    for(int i = 0; i < 10; i++){
+        twheel_node_init(&timers[i].node);
+        timers[i].fired_at = 0;
+        twheel_add(&wheel, &timers[i].node, 5 + (twheel_time)(i + 1) * 30 * day + (twheel_time)i * 7919);
+    }
+
+    for(int i = 0; i < 10; i++){
+        twheel_time expires = timers[i].node.expires;
+        ASSERT_EQ(0, twheel_advance(&wheel, expires - 1, on_expire, &wheel));
+        ASSERT_EQ(expires - 1, wheel.now);
+        ASSERT_EQ(1, twheel_advance(&wheel, expires + 1, on_expire, &wheel));
+        ASSERT(timers[i].fired_at >= expires && timers[i].fired_at <= expires + 1);
+    }
+    ASSERT_EQ(0, wheel.count);
+
+    //empty wheel: straight to now
+    ASSERT_EQ(0, twheel_advance(&wheel, 1ULL << 40, on_expire, &wheel));
+    ASSERT_EQ(1ULL << 40, wheel.now);
+
+    //a timer past the last level is parked and placed again, it still fires on time
+    twheel_node_init(&timers[0].node);
+    twheel_time far = wheel.now + (1ULL << (TWHEEL_BITS * TWHEEL_LEVELS)) * 3 + 12345;
+    twheel_add(&wheel, &timers[0].node, far);
+    ASSERT_EQ(0, twheel_advance(&wheel, far - 1, on_expire, &wheel));
+    ASSERT_EQ(1, twheel_advance(&wheel, far + 1, on_expire, &wheel));
+    ASSERT(timers[0].fired_at >= far && timers[0].fired_at <= far + 1);
+
+    PASS();
+}
+
+GREATEST_SUITE(twheelFX) {
+
+    RUN_TEST(expire_in_order);
+    RUN_TEST(remove_before_due);
+    RUN_TEST(advance_idle_gaps);
+
+}